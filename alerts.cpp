@@ -0,0 +1,348 @@
+#include "alerts.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  /**
+   *  Splits a token such as "2.5g" into its number and its suffix.
+   *
+   *  @return false if the token does not start with a number.
+   */
+  bool split_number(const std::string& token, double& number,
+                    std::string& suffix)
+  {
+    std::size_t end = 0;
+    while (end < token.size()
+           && (std::isdigit(static_cast<unsigned char>(token[end]))
+               || token[end] == '.'))
+      { ++end; }
+    if (end == 0) { return false; }
+    std::istringstream in(token.substr(0, end));
+    if (!(in >> number) || !in.eof()) { return false; }
+    suffix = token.substr(end);
+    return true;
+  }
+
+  /**
+   *  @return false if the value has a suffix that does not fit the column.
+   */
+  bool parse_value(const std::string& token, int top_column, float& value)
+  {
+    double number;
+    std::string suffix;
+    if (!split_number(token, number, suffix)) { return false; }
+    if (top_column == CPU_COL)
+      {
+        if (!suffix.empty() && suffix != "%") { return false; }
+      }
+    else if (suffix == "m") { number *= 1024.0; }
+    else if (suffix == "g") { number *= 1048576.0; }
+    else if (!suffix.empty() && suffix != "k") { return false; }
+    value = static_cast<float>(number);
+    return true;
+  }
+
+  /**
+   *  Reads a duration from the tokens, either "5min" or "5 min".
+   */
+  bool parse_duration(std::istringstream& tokens, alert_rule& rule)
+  {
+    std::string token, unit;
+    double number;
+    if (!(tokens >> token) || !split_number(token, number, unit)
+        || number != static_cast<std::int64_t>(number))
+      { return false; }
+    if (unit.empty() && !(tokens >> unit)) { return false; }
+    rule.duration = static_cast<std::int64_t>(number);
+    rule.in_seconds = true;
+    if (unit == "s" || unit == "sec") { }
+    else if (unit == "min") { rule.duration *= 60; }
+    else if (unit == "h") { rule.duration *= 3600; }
+    else if (unit == "snapshot" || unit == "snapshots")
+      { rule.in_seconds = false; }
+    else { return false; }
+    return true;
+  }
+}
+
+bool parse_alert_rules(std::istream& in, const std::string& file,
+                       const std::vector<std::string>& processes,
+                       int top_column, std::vector<alert_rule>& rules)
+{
+  std::string line;
+  for (unsigned number = 1; std::getline(in, line); ++number)
+    {
+      auto comment = line.find('#');
+      if (comment != std::string::npos) { line.erase(comment); }
+      std::istringstream tokens(line);
+      alert_rule rule;
+      std::string column, op, value;
+      if (!(tokens >> rule.process)) { continue; }
+      auto error = [&](const std::string& message)
+        {
+          std::cerr << "Error: " << file << ":" << number << ": " << message
+                    << std::endl;
+          return false;
+        };
+
+      auto begin = line.find_first_not_of(" \t");
+      auto end = line.find_last_not_of(" \t\r");
+      rule.text = line.substr(begin, end - begin + 1);
+      if (!(tokens >> column >> op >> value))
+        { return error("incomplete rule '" + rule.text + "'"); }
+      std::transform(column.begin(), column.end(), column.begin(),
+                     [](unsigned char c) { return std::toupper(c); });
+      if (column == "VIRT") { rule.top_column = VIRT_COL; }
+      else if (column == "CPU" || column == "%CPU")
+        { rule.top_column = CPU_COL; }
+      else { return error("unknown column '" + column + "'"); }
+      if (rule.top_column != top_column)
+        {
+          return error("rules on " + column + " require "
+                       + (rule.top_column == VIRT_COL ? "--mem" : "--cpu"));
+        }
+      auto found = std::find(processes.begin(), processes.end(),
+                             rule.process);
+      if (found == processes.end())
+        {
+          return error("process '" + rule.process
+                       + "' is not one of the processes analysed");
+        }
+      rule.column = static_cast<int>(found - processes.begin());
+      if (op != ">" && op != "<")
+        { return error("unknown comparison '" + op + "'"); }
+      rule.above = op == ">";
+      if (!parse_value(value, top_column, rule.threshold))
+        { return error("invalid value '" + value + "'"); }
+      rule.clear = rule.threshold;
+      rule.in_seconds = false;
+      rule.duration = 1;
+
+      std::string keyword;
+      while (tokens >> keyword)
+        {
+          if (keyword == "for")
+            {
+              if (!parse_duration(tokens, rule))
+                { return error("invalid duration in '" + rule.text + "'"); }
+            }
+          else if (keyword == "clear")
+            {
+              if (!(tokens >> value)
+                  || !parse_value(value, top_column, rule.clear))
+                { return error("invalid value in '" + rule.text + "'"); }
+            }
+          else { return error("unexpected '" + keyword + "'"); }
+        }
+      if (rule.above ? rule.clear > rule.threshold
+                     : rule.clear < rule.threshold)
+        {
+          return error("the clear value of '" + rule.text
+                       + "' is past its threshold");
+        }
+      rules.push_back(rule);
+    }
+  return true;
+}
+
+alert_output::alert_output()
+  : socket_(-1), dropped_(0)
+{ }
+
+alert_output::~alert_output()
+{
+  report_dropped();
+#ifndef _WIN32
+  if (socket_ >= 0) { ::close(socket_); }
+#endif
+}
+
+bool alert_output::open(const std::string& target)
+{
+  if (target.empty()) { return true; }
+  if (target.compare(0, 5, "unix:") == 0)
+    {
+      socket_path_ = target.substr(5);
+      return connect();
+    }
+  file_.open(target.c_str(), std::ios::app);
+  return static_cast<bool>(file_);
+}
+
+bool alert_output::connect()
+{
+#ifdef _WIN32
+  return false;
+#else
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  if (socket_path_.size() >= sizeof(address.sun_path)) { return false; }
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, socket_path_.c_str());
+  socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ < 0) { return false; }
+  if (::connect(socket_, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address)) != 0
+      || ::fcntl(socket_, F_SETFL, ::fcntl(socket_, F_GETFL) | O_NONBLOCK)
+         != 0)
+    {
+      ::close(socket_);
+      socket_ = -1;
+      return false;
+    }
+  pending_.clear();
+  return true;
+#endif
+}
+
+/**
+ *  Sends what the socket takes of pending_.
+ *
+ *  @return false if the connection failed, true if everything was sent or
+ *          if the socket is full.
+ */
+bool alert_output::send_pending()
+{
+#ifdef _WIN32
+  return false;
+#else
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL; // a closed peer must not kill the program
+#else
+  const int flags = 0;
+#endif
+  while (!pending_.empty())
+    {
+      ssize_t n = ::send(socket_, pending_.data(), pending_.size(), flags);
+      if (n > 0) { pending_.erase(0, static_cast<std::size_t>(n)); }
+      else if (n < 0 && errno == EINTR) { continue; }
+      else { return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK); }
+    }
+  return true;
+#endif
+}
+
+void alert_output::report_dropped()
+{
+  if (dropped_ == 0) { return; }
+  std::cerr << "Warning: could not send " << dropped_ << " alert"
+            << (dropped_ > 1 ? "s" : "") << " to " << socket_path_
+            << std::endl;
+  dropped_ = 0;
+}
+
+void alert_output::write(const std::string& line)
+{
+  if (socket_path_.empty())
+    {
+      std::ostream& out = file_.is_open() ? file_ : std::cerr;
+      out << line << std::flush;
+      return;
+    }
+#ifndef _WIN32
+  for (int attempt = 0; attempt < 2; ++attempt)
+    {
+      if (socket_ < 0 && !connect()) { break; }
+      // The rest of a line cut short goes first, so that lines stay whole.
+      bool connected = send_pending();
+      if (connected && !pending_.empty())
+        {
+          ++dropped_; // the peer is not reading
+          return;
+        }
+      if (connected)
+        {
+          pending_ = line;
+          connected = send_pending();
+        }
+      if (connected && pending_.size() == line.size())
+        {
+          pending_.clear();
+          ++dropped_;
+          return;
+        }
+      if (connected)
+        {
+          report_dropped();
+          return;
+        }
+      ::close(socket_);
+      socket_ = -1;
+    }
+  ++dropped_;
+  report_dropped();
+#endif
+}
+
+alert_engine::alert_engine(const std::vector<alert_rule>& rules,
+                           alert_output& output)
+  : rules_(rules), states_(rules.size(), rule_state{normal, 0}),
+    output_(output), snapshots_(0)
+{ }
+
+void alert_engine::add(const row_type& row)
+{
+  std::int64_t time = clock_(row);
+  ++snapshots_;
+  for (std::size_t i = 0; i < rules_.size(); ++i)
+    {
+      const alert_rule& rule = rules_[i];
+      rule_state& state = states_[i];
+      float value = row.columns[rule.column];
+      bool over = rule.above ? value > rule.threshold : value < rule.threshold;
+      std::int64_t now = rule.in_seconds ? time : snapshots_;
+      switch (state.phase)
+        {
+        case normal:
+          if (!over) { break; }
+          state.phase = pending;
+          state.since = rule.in_seconds ? now : now - 1;
+          // fall through
+        case pending:
+          if (!over) { state.phase = normal; }
+          else if (now - state.since >= rule.duration)
+            {
+              state.phase = firing;
+              emit(rule, "firing", time, value);
+            }
+          break;
+        case firing:
+          if (rule.above ? value <= rule.clear : value >= rule.clear)
+            {
+              state.phase = normal;
+              emit(rule, "resolved", time, value);
+            }
+          break;
+        }
+    }
+}
+
+void alert_engine::emit(const alert_rule& rule, const char* event,
+                        std::int64_t time, float value)
+{
+  std::ostringstream line;
+  std::int64_t seconds = time % 86400;
+  line << time / 86400 << "," << seconds / 3600 << "," << seconds / 60 % 60
+       << "," << seconds % 60 << "," << event << "," << rule.process << ",";
+  set_value_format(line, rule.top_column);
+  line << value << ",\"";
+  for (char c : rule.text)
+    {
+      if (c == '"') { line << '"'; }
+      line << c;
+    }
+  line << "\"\n";
+  output_.write(line.str());
+}
@@ -0,0 +1,121 @@
+#ifndef TOP2CSV_ALERTS_HPP
+#define TOP2CSV_ALERTS_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+/**
+ *  A threshold on the value of one process, written in a rules file as
+ *
+ *    <process> <VIRT|CPU> <'>'|'<'> <value> [for <duration>] [clear <value>]
+ *
+ *  for instance "dbserver VIRT > 3g for 5min clear 2.5g" or
+ *  "SigLoc CPU > 90 for 3 snapshots".  Values take the same k, m and g
+ *  suffixes as in top logs; durations are in s, min or h, or a number of
+ *  snapshots.  Without clear, the alert is resolved as soon as the value is
+ *  back on the other side of the threshold.
+ */
+struct alert_rule
+{
+  std::string text;      // as written in the rules file
+  std::string process;
+  int top_column;        // VIRT_COL or CPU_COL
+  int column;            // of the process in the rows
+  bool above;            // fires when the value is above the threshold
+  float threshold;
+  float clear;           // resolved once the value gets past it
+  bool in_seconds;       // duration in seconds rather than in snapshots
+  std::int64_t duration;
+};
+
+/**
+ *  Reads the rules of a rules file, one per line, with # comments.  Every
+ *  rule must be about the collected column and one of the processes.
+ *
+ *  @param file The name of the file, for error messages.
+ *  @return false, after printing an error, if a rule is invalid.
+ */
+bool parse_alert_rules(std::istream& in, const std::string& file,
+                       const std::vector<std::string>& processes,
+                       int top_column, std::vector<alert_rule>& rules);
+
+/**
+ *  Where alert events are written: standard error, a file they are appended
+ *  to, or, for a target named unix:<path>, a local stream socket.  A socket
+ *  whose peer went away is reconnected on the next event.
+ */
+class alert_output
+{
+public:
+  alert_output();
+  ~alert_output();
+
+  alert_output(const alert_output&) = delete;
+  alert_output& operator=(const alert_output&) = delete;
+
+  /**
+   *  @param target Empty for standard error.
+   *  @return false if the file or socket could not be opened.
+   */
+  bool open(const std::string& target);
+
+  /**
+   *  Writes one event line, at once.  The socket does not block: an event
+   *  that cannot be sent because the peer does not read is dropped and
+   *  counted, so that the parsing never waits for the peer.
+   */
+  void write(const std::string& line);
+
+private:
+  bool connect();
+  bool send_pending();
+  void report_dropped();
+
+  std::ofstream file_;
+  std::string socket_path_;
+  int socket_;
+  std::string pending_;   // the rest of a line the socket took part of
+  std::uint64_t dropped_; // events dropped since the last one sent
+};
+
+/**
+ *  Evaluates alert rules on each closed snapshot.
+ *
+ *  Each rule is a small state machine, normal, pending or firing, whose
+ *  process column was resolved when the rules were read, so that a snapshot
+ *  costs one comparison per rule whatever the number of processes.  An event
+ *  line is written when a rule starts firing and when it is resolved:
+ *
+ *    Day,Hour,Minute,Second,firing|resolved,Process,Value,"Rule"
+ */
+class alert_engine
+{
+public:
+  alert_engine(const std::vector<alert_rule>& rules, alert_output& output);
+
+  void add(const row_type& row);
+
+private:
+  enum phase_type { normal, pending, firing };
+
+  struct rule_state
+  {
+    phase_type phase;
+    std::int64_t since;    // time or snapshot the condition started to hold
+  };
+
+  void emit(const alert_rule& rule, const char* event, std::int64_t time,
+            float value);
+
+  std::vector<alert_rule> rules_;
+  std::vector<rule_state> states_;
+  alert_output& output_;
+  day_clock clock_;
+  std::int64_t snapshots_;
+};
+
+#endif // TOP2CSV_ALERTS_HPP
@@ -0,0 +1,337 @@
+#include "archive.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const std::size_t BLOCK = 512;
+  // Most data of an 'L' or 'x' entry read into memory.
+  const std::uint64_t MAX_HEADER_DATA = 1 << 20;
+  // Name and prefix fields of a ustar header.
+  const std::size_t NAME_SIZE = 100;
+  const std::size_t PREFIX_SIZE = 155;
+
+  bool ends_with(const std::string& text, const char* suffix)
+  {
+    std::size_t length = std::strlen(suffix);
+    return text.size() >= length
+      && text.compare(text.size() - length, length, suffix) == 0;
+  }
+
+  /**
+   *  @return The text of a header field, which ends with a NUL character
+   *          unless it fills the field.
+   */
+  std::string field(const char* data, std::size_t size)
+  {
+    return std::string(data, std::find(data, data + size, '\0'));
+  }
+
+  /**
+   *  Parses a numeric field: octal digits, possibly surrounded by spaces and
+   *  NUL characters, or big-endian base-256 for large values written by GNU
+   *  tar.
+   *
+   *  @return false if the field is not a number.
+   */
+  bool parse_number(const char* data, std::size_t size, std::uint64_t& value)
+  {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    value = 0;
+    if (p[0] == 0x80)
+      {
+        for (std::size_t i = 1; i < size; ++i)
+          {
+            if (value >> 56) { return false; }
+            value = value << 8 | p[i];
+          }
+        return true;
+      }
+    std::size_t i = 0;
+    while (i < size && p[i] == ' ') { ++i; }
+    for (; i < size && p[i] >= '0' && p[i] <= '7'; ++i)
+      { value = value * 8 + (p[i] - '0'); }
+    for (; i < size; ++i)
+      {
+        if (p[i] != ' ' && p[i] != '\0') { return false; }
+      }
+    return true;
+  }
+
+  /**
+   *  Writes a number to a header field: octal digits ending with a NUL
+   *  character when they fit, base-256 otherwise.
+   */
+  void put_number(char* data, std::size_t size, std::uint64_t value)
+  {
+    if (value >> (3 * (size - 1)))
+      {
+        data[0] = static_cast<char>(0x80);
+        for (std::size_t i = size - 1; i > 0; --i, value >>= 8)
+          { data[i] = static_cast<char>(value & 0xff); }
+        return;
+      }
+    std::snprintf(data, size, "%0*llo", static_cast<int>(size - 1),
+                  static_cast<unsigned long long>(value));
+  }
+
+  /**
+   *  @return true if the checksum of a header is right.  Some old versions of
+   *          tar summed signed characters, which is accepted as well.
+   */
+  bool valid_checksum(const char* header)
+  {
+    std::uint64_t stored;
+    if (!parse_number(header + 148, 8, stored)) { return false; }
+    std::uint64_t sum = 0;
+    std::int64_t signed_sum = 0;
+    for (std::size_t i = 0; i < BLOCK; ++i)
+      {
+        char c = i >= 148 && i < 156 ? ' ' : header[i];
+        sum += static_cast<unsigned char>(c);
+        signed_sum += static_cast<signed char>(c);
+      }
+    return stored == sum || static_cast<std::int64_t>(stored) == signed_sum;
+  }
+
+  /**
+   *  Reads the records of a pax extended header, 'length key=value\n', and
+   *  keeps those which matter here.
+   */
+  void parse_pax(const std::string& data, std::string& path,
+                 std::uint64_t& size, bool& has_size)
+  {
+    std::size_t pos = 0;
+    while (pos < data.size())
+      {
+        std::size_t space = data.find(' ', pos);
+        if (space == std::string::npos) { return; }
+        std::size_t length = 0;
+        for (std::size_t i = pos; i < space; ++i)
+          {
+            if (data[i] < '0' || data[i] > '9') { return; }
+            length = length * 10 + (data[i] - '0');
+          }
+        if (length <= space - pos + 1 || pos + length > data.size()) { return; }
+        std::string record = data.substr(space + 1, pos + length - space - 2);
+        std::size_t equal = record.find('=');
+        if (equal != std::string::npos)
+          {
+            std::string key = record.substr(0, equal);
+            std::string value = record.substr(equal + 1);
+            if (key == "path") { path = value; }
+            else if (key == "size")
+              {
+                size = std::strtoull(value.c_str(), nullptr, 10);
+                has_size = true;
+              }
+          }
+        pos += length;
+      }
+  }
+}
+
+bool is_tar_archive(const fs::path& path)
+{
+  std::string name = path.filename().string();
+  return ends_with(name, ".tar") || ends_with(name, ".tar.gz")
+    || ends_with(name, ".tgz");
+}
+
+bool is_gzip_file(const fs::path& path)
+{
+  std::string name = path.filename().string();
+  return ends_with(name, ".gz") || ends_with(name, ".tgz");
+}
+
+bool is_safe_entry_path(const fs::path& path)
+{
+  if (path.empty() || path.has_root_path()) { return false; }
+  for (auto&& part : path)
+    {
+      if (part == "..") { return false; }
+    }
+  return true;
+}
+
+tar_reader::tar_reader(std::streambuf& source)
+  : source_(source), remaining_(0), padding_(0), failed_(false),
+    buffer_(1 << 16)
+{ }
+
+bool tar_reader::read_exactly(char* data, std::size_t size)
+{
+  return source_.sgetn(data, size) == static_cast<std::streamsize>(size);
+}
+
+bool tar_reader::skip(std::uint64_t bytes)
+{
+  while (bytes > 0)
+    {
+      std::size_t chunk = static_cast<std::size_t>
+        (std::min<std::uint64_t>(bytes, buffer_.size()));
+      if (!read_exactly(buffer_.data(), chunk)) { return false; }
+      bytes -= chunk;
+    }
+  return true;
+}
+
+bool tar_reader::next(tar_entry& entry)
+{
+  setg(nullptr, nullptr, nullptr);
+  if (failed_ || !skip(remaining_ + padding_))
+    {
+      failed_ = true;
+      return false;
+    }
+  remaining_ = padding_ = 0;
+
+  // Set by the 'L' and 'x' entries for the entry that follows them.
+  std::string long_name, pax_path;
+  std::uint64_t pax_size = 0;
+  bool has_pax_size = false;
+  char header[BLOCK];
+  for (;;)
+    {
+      if (!read_exactly(header, BLOCK))
+        {
+          failed_ = true; // truncated before the end of the archive
+          return false;
+        }
+      if (std::all_of(header, header + BLOCK, [](char c) { return c == 0; }))
+        { return false; }
+      std::uint64_t size, mtime;
+      if (!valid_checksum(header) || !parse_number(header + 124, 12, size)
+          || !parse_number(header + 136, 12, mtime))
+        {
+          failed_ = true;
+          return false;
+        }
+      char type = header[156];
+      std::uint64_t padding = (BLOCK - size % BLOCK) % BLOCK;
+      if (type == 'L' || type == 'x')
+        {
+          std::string data(size <= MAX_HEADER_DATA ? size : 0, '\0');
+          if (size > MAX_HEADER_DATA || !read_exactly(&data[0], size)
+              || !skip(padding))
+            {
+              failed_ = true;
+              return false;
+            }
+          if (type == 'L') { long_name = field(data.data(), data.size()); }
+          else { parse_pax(data, pax_path, pax_size, has_pax_size); }
+          continue;
+        }
+      if (type == 'g' || type == 'K')
+        {
+          // Global pax headers and long link names do not matter here.
+          if (!skip(size + padding))
+            {
+              failed_ = true;
+              return false;
+            }
+          continue;
+        }
+
+      entry.path = field(header, NAME_SIZE);
+      std::string prefix = field(header + 345, PREFIX_SIZE);
+      if (std::memcmp(header + 257, "ustar", 6) == 0 && !prefix.empty())
+        { entry.path = prefix + "/" + entry.path; }
+      if (!long_name.empty()) { entry.path = long_name; }
+      if (!pax_path.empty()) { entry.path = pax_path; }
+      entry.size = has_pax_size ? pax_size : size;
+      entry.mtime = static_cast<std::time_t>(mtime);
+      entry.regular = type == '0' || type == '\0' || type == '7';
+      // Links and directories have no content, whatever their size says.
+      remaining_ = type == '1' || type == '2' || type == '5' ? 0 : entry.size;
+      padding_ = (BLOCK - remaining_ % BLOCK) % BLOCK;
+      return true;
+    }
+}
+
+tar_reader::int_type tar_reader::underflow()
+{
+  if (gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+  if (remaining_ == 0) { return traits_type::eof(); }
+  std::size_t chunk = static_cast<std::size_t>
+    (std::min<std::uint64_t>(remaining_, buffer_.size()));
+  std::streamsize len = source_.sgetn(buffer_.data(), chunk);
+  if (len <= 0)
+    {
+      failed_ = true;
+      remaining_ = padding_ = 0;
+      return traits_type::eof();
+    }
+  remaining_ -= len;
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + len);
+  return traits_type::to_int_type(*gptr());
+}
+
+tar_writer::tar_writer(std::ostream& out)
+  : out_(out)
+{ }
+
+void tar_writer::add(const std::string& path, const std::string& content,
+                     std::time_t mtime)
+{
+  std::string name = path, prefix;
+  if (path.size() > NAME_SIZE)
+    {
+      // Split at a '/' between the prefix and the name, if one fits both.
+      std::size_t slash = path.find('/', path.size() - NAME_SIZE - 1);
+      if (slash != std::string::npos && slash <= PREFIX_SIZE
+          && slash + 1 < path.size())
+        {
+          prefix = path.substr(0, slash);
+          name = path.substr(slash + 1);
+        }
+      else
+        {
+          write_header("././@LongLink", "", 'L', path.size() + 1, 0);
+          write_padded(path.c_str(), path.size() + 1);
+          name = path.substr(0, NAME_SIZE);
+        }
+    }
+  write_header(name, prefix, '0', content.size(), mtime);
+  write_padded(content.data(), content.size());
+}
+
+void tar_writer::finish()
+{
+  const char end[2 * BLOCK] = {};
+  out_.write(end, sizeof(end));
+}
+
+void tar_writer::write_header(const std::string& name,
+                              const std::string& prefix, char type,
+                              std::uint64_t size, std::time_t mtime)
+{
+  char header[BLOCK] = {};
+  std::memcpy(header, name.data(), std::min(name.size(), NAME_SIZE));
+  put_number(header + 100, 8, 0644);
+  put_number(header + 108, 8, 0);
+  put_number(header + 116, 8, 0);
+  put_number(header + 124, 12, size);
+  put_number(header + 136, 12, mtime > 0 ? mtime : 0);
+  header[156] = type;
+  std::memcpy(header + 257, "ustar", 6);
+  std::memcpy(header + 263, "00", 2);
+  std::memcpy(header + 345, prefix.data(),
+              std::min(prefix.size(), PREFIX_SIZE));
+  std::memset(header + 148, ' ', 8);
+  unsigned sum = 0;
+  for (char c : header) { sum += static_cast<unsigned char>(c); }
+  std::snprintf(header + 148, 7, "%06o", sum);
+  out_.write(header, BLOCK);
+}
+
+void tar_writer::write_padded(const char* data, std::uint64_t size)
+{
+  const char zeros[BLOCK] = {};
+  out_.write(data, size);
+  out_.write(zeros, (BLOCK - size % BLOCK) % BLOCK);
+}
@@ -0,0 +1,112 @@
+#ifndef TOP2CSV_ARCHIVE_HPP
+#define TOP2CSV_ARCHIVE_HPP
+
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+/**
+ *  @return true if the file name of path ends with .tar, .tar.gz or .tgz.
+ */
+bool is_tar_archive(const boost::filesystem::path& path);
+
+/**
+ *  @return true if the file name of path ends with .gz or .tgz.
+ */
+bool is_gzip_file(const boost::filesystem::path& path);
+
+/**
+ *  @return false if path is absolute or goes up with '..', so that it could
+ *          name a file outside of the directory it is written under.
+ */
+bool is_safe_entry_path(const boost::filesystem::path& path);
+
+/**
+ *  An entry of a tar archive.
+ */
+struct tar_entry
+{
+  std::string path;
+  std::uint64_t size;
+  std::time_t mtime;
+  bool regular; // a regular file, rather than a directory, a link, ...
+};
+
+/**
+ *  Reads a tar archive sequentially, from a stream buffer that does not need
+ *  to be seekable, such as a gzip_reader: the archive is never extracted.
+ *
+ *  The tar_reader is itself the stream buffer of the content of the current
+ *  entry, which ends with the entry.  ustar archives are read, with the long
+ *  names of GNU tar ('L' entries) and the path and size of pax extended
+ *  headers ('x' entries).
+ */
+class tar_reader : public std::streambuf
+{
+public:
+  explicit tar_reader(std::streambuf& source);
+
+  tar_reader(const tar_reader&) = delete;
+  tar_reader& operator=(const tar_reader&) = delete;
+
+  /**
+   *  Skips what is left of the current entry and reads the header of the
+   *  next one.
+   *
+   *  @return false at the end of the archive, or if it is not valid.
+   */
+  bool next(tar_entry& entry);
+
+  /**
+   *  @return true if the archive is not valid, or is truncated.
+   */
+  bool failed() const { return failed_; }
+
+protected:
+  int_type underflow() override;
+
+private:
+  bool read_exactly(char* data, std::size_t size);
+  bool skip(std::uint64_t bytes);
+
+  std::streambuf& source_;
+  std::uint64_t remaining_; // bytes of the current entry not read yet
+  std::uint64_t padding_;   // bytes after them, up to the next header
+  bool failed_;
+  std::vector<char> buffer_;
+};
+
+/**
+ *  Writes a tar archive sequentially to a stream, in the ustar format, with
+ *  GNU tar long names when a path does not fit in a ustar header.  Errors
+ *  are reported by the stream.
+ */
+class tar_writer
+{
+public:
+  explicit tar_writer(std::ostream& out);
+
+  /**
+   *  Writes a regular file, readable by everyone.
+   */
+  void add(const std::string& path, const std::string& content,
+           std::time_t mtime);
+
+  /**
+   *  Writes the end of the archive.
+   */
+  void finish();
+
+private:
+  void write_header(const std::string& name, const std::string& prefix,
+                    char type, std::uint64_t size, std::time_t mtime);
+  void write_padded(const char* data, std::uint64_t size);
+
+  std::ostream& out_;
+};
+
+#endif // TOP2CSV_ARCHIVE_HPP
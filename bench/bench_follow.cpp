@@ -0,0 +1,248 @@
+/**
+ *  Measures the end-to-end latency of the streaming modes of top2csv: the
+ *  snapshots of a top log are written at a fixed rate to a file followed by
+ *  top2csv --follow, or to its standard input with --pipe, and the time
+ *  each CSV row is read from its output is compared with the time the
+ *  snapshot was written.
+ *
+ *  Usage: bench_follow [--pipe] <top2csv> <top log> [rate] [snapshots]
+ *
+ *  The rate is in snapshots per second, 10 by default; 0 writes them as fast
+ *  as possible, which gives the sustained maximum rate.  The log is repeated
+ *  if it has fewer snapshots than asked for, 1000 by default.
+ *
+ *  A snapshot is only known to be complete once the header of the next one
+ *  is read, so the latency of a row is counted from the write of the next
+ *  snapshot.  The distribution of the latencies is reported, with the rates
+ *  the snapshots were written and the rows emitted at.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "replay.hpp"
+
+namespace
+{
+  typedef std::chrono::steady_clock clock_type;
+
+  bool write_all(int fd, const std::string& text)
+  {
+    const char* p = text.data();
+    std::size_t left = text.size();
+    while (left > 0)
+      {
+        ssize_t len = ::write(fd, p, left);
+        if (len <= 0) { return false; }
+        p += len;
+        left -= len;
+      }
+    return true;
+  }
+
+  /**
+   *  Reads the output of top2csv until it is closed, and records when each
+   *  row arrives.  The first line is the CSV header.
+   */
+  void read_rows(int fd, std::vector<clock_type::time_point>& received,
+                 std::atomic<bool>& header, std::atomic<std::size_t>& rows)
+  {
+    char buffer[1 << 16];
+    std::size_t lines = 0;
+    ssize_t len;
+    while ((len = ::read(fd, buffer, sizeof(buffer))) > 0)
+      {
+        auto now = clock_type::now();
+        for (ssize_t i = 0; i < len; ++i)
+          {
+            if (buffer[i] != '\n') { continue; }
+            if (lines == 0) { header = true; }
+            else if (lines - 1 < received.size())
+              {
+                received[lines - 1] = now;
+                rows = lines;
+              }
+            ++lines;
+          }
+      }
+  }
+
+  double milliseconds(clock_type::duration d)
+  { return std::chrono::duration<double, std::milli>(d).count(); }
+}
+
+int main(int argc, char** argv)
+{
+  bool pipe_mode = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      if (arg == "--pipe") { pipe_mode = true; }
+      else { args.push_back(arg); }
+    }
+  if (args.size() < 2)
+    {
+      std::cerr << "Usage: bench_follow [--pipe] <top2csv> <top log> [rate] "
+                << "[snapshots]" << std::endl;
+      return 1;
+    }
+  const std::string top2csv = args[0];
+  double rate = args.size() > 2 ? std::stod(args[2]) : 10;
+  std::size_t count = args.size() > 3 ? std::stoul(args[3]) : 1000;
+
+  std::ifstream log(args[1]);
+  std::vector<std::string> snapshots;
+  snapshot_source source(log);
+  std::string text;
+  std::int64_t time;
+  while (source.next(text, time)) { snapshots.push_back(text); }
+  if (snapshots.empty() || count == 0)
+    {
+      std::cerr << "Error: no snapshot to write from " << args[1] << std::endl;
+      return 1;
+    }
+
+  char path[] = "/tmp/bench_follow-XXXXXX";
+  int out_pipe[2], in_pipe[2] = {-1, -1};
+  int fd = -1;
+  if (pipe_mode ? ::pipe(in_pipe) != 0 : (fd = ::mkstemp(path)) < 0)
+    {
+      std::cerr << "Error: cannot create the input of top2csv" << std::endl;
+      return 1;
+    }
+  if (pipe_mode) { fd = in_pipe[1]; }
+  if (::pipe(out_pipe) != 0)
+    {
+      std::cerr << "Error: cannot create the output of top2csv" << std::endl;
+      return 1;
+    }
+  std::signal(SIGPIPE, SIG_IGN);
+  pid_t child = ::fork();
+  if (child == 0)
+    {
+      ::dup2(out_pipe[1], 1);
+      ::close(out_pipe[0]);
+      ::close(out_pipe[1]);
+      if (pipe_mode)
+        {
+          ::dup2(in_pipe[0], 0);
+          ::close(in_pipe[0]);
+          ::close(in_pipe[1]);
+          ::execl(top2csv.c_str(), "top2csv", "--follow", "--mem", "dbserver",
+                  static_cast<char*>(nullptr));
+        }
+      else
+        {
+          ::execl(top2csv.c_str(), "top2csv", "--follow", "--mem", "-i", path,
+                  "dbserver", static_cast<char*>(nullptr));
+        }
+      std::perror(top2csv.c_str());
+      ::_exit(127);
+    }
+  ::close(out_pipe[1]);
+  if (pipe_mode) { ::close(in_pipe[0]); }
+  if (child < 0)
+    {
+      std::cerr << "Error: cannot run " << top2csv << std::endl;
+      return 1;
+    }
+
+  // Row i is emitted once snapshot i + 1 is written.
+  std::vector<clock_type::time_point> written(count + 1), received(count);
+  std::atomic<bool> header(false);
+  std::atomic<std::size_t> rows(0);
+  std::thread reader(read_rows, out_pipe[0], std::ref(received),
+                     std::ref(header), std::ref(rows));
+  auto deadline = clock_type::now() + std::chrono::seconds(10);
+  while (!header && clock_type::now() < deadline)
+    { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+
+  bool ok = header;
+  replay_schedule schedule(0, rate);
+  for (std::size_t i = 0; ok && i <= count; ++i)
+    {
+      std::this_thread::sleep_until(schedule.due(-1));
+      ok = write_all(fd, snapshots[i % snapshots.size()]);
+      written[i] = clock_type::now();
+    }
+  if (pipe_mode) { ::close(fd); }
+  deadline = clock_type::now() + std::chrono::seconds(30);
+  while (ok && rows < count && clock_type::now() < deadline)
+    { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+  ::kill(child, SIGTERM);
+  ::waitpid(child, nullptr, 0);
+  reader.join();
+  ::close(out_pipe[0]);
+  if (!pipe_mode)
+    {
+      ::close(fd);
+      ::unlink(path);
+    }
+  if (!ok)
+    {
+      std::cerr << "Error: top2csv did not start or stopped reading"
+                << std::endl;
+      return 1;
+    }
+
+  std::size_t emitted = rows;
+  std::vector<double> latencies;
+  for (std::size_t i = 0; i < emitted; ++i)
+    { latencies.push_back(milliseconds(received[i] - written[i + 1])); }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p)
+    {
+      if (latencies.empty()) { return 0.; }
+      return latencies[std::min(latencies.size() - 1,
+                                static_cast<std::size_t>
+                                (p * latencies.size()))];
+    };
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "mode: " << (pipe_mode ? "pipe" : "follow") << ", "
+            << emitted << " of " << count << " rows emitted\n";
+  std::cout << "latency (ms): p50 " << percentile(0.5) << ", p90 "
+            << percentile(0.9) << ", p99 " << percentile(0.99) << ", p99.9 "
+            << percentile(0.999) << ", max " << percentile(1) << "\n";
+  // Power of two buckets, from 1 ms down and up.
+  std::vector<std::size_t> buckets;
+  for (double latency : latencies)
+    {
+      std::size_t b = 0;
+      for (double limit = 1. / 64; latency > limit && b < 20; limit *= 2)
+        { ++b; }
+      if (buckets.size() <= b) { buckets.resize(b + 1); }
+      ++buckets[b];
+    }
+  std::cout << std::setprecision(4);
+  for (std::size_t b = 0; b < buckets.size(); ++b)
+    {
+      if (buckets[b] == 0) { continue; }
+      std::cout << "  <= " << std::setw(11) << (1. / 64) * (1 << b) << " ms: "
+                << std::setw(8) << buckets[b] << "\n";
+    }
+  std::cout << std::setprecision(1);
+  if (count > 0 && written[count] > written[0])
+    {
+      std::cout << "written: " << count / (milliseconds(written[count]
+                                                        - written[0]) / 1000)
+                << " snapshots/s\n";
+    }
+  if (emitted > 1 && received[emitted - 1] > written[0])
+    {
+      std::cout << "emitted: " << emitted / (milliseconds(received[emitted - 1]
+                                                          - written[0]) / 1000)
+                << " rows/s\n";
+    }
+  return emitted == count ? 0 : 1;
+}
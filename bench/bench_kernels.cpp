@@ -0,0 +1,128 @@
+/**
+ *  Compares the aggregation kernels of each instruction set supported by the
+ *  processor with plain loops, on a column of generated values.
+ *
+ *  Usage: bench_kernels [values] [runs]
+ *
+ *  For sum, min/max and variance, the best throughput of the runs is
+ *  reported in millions of values per second, with the result so that
+ *  differences between instruction sets can be seen.
+ */
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "kernels.hpp"
+
+namespace
+{
+  double plain_sum(const std::vector<float>& values)
+  {
+    double sum = 0.;
+    for (float v : values) { sum += v; }
+    return sum;
+  }
+
+  double plain_min_max(const std::vector<float>& values)
+  {
+    float min = values.front(), max = values.front();
+    for (float v : values)
+      {
+        min = std::min(min, v);
+        max = std::max(max, v);
+      }
+    return max - min;
+  }
+
+  double plain_variance(const std::vector<float>& values)
+  {
+    double sum = 0.;
+    for (float v : values) { sum += v; }
+    double mean = sum / values.size(), m2 = 0.;
+    for (float v : values) { m2 += (v - mean) * (v - mean); }
+    return m2 / (values.size() - 1);
+  }
+
+  /**
+   *  @return The best throughput, in millions of values per second.
+   */
+  double measure(const std::function<double ()>& kernel, std::size_t values,
+                 int runs, double& result)
+  {
+    double best = 0;
+    for (int r = 0; r < runs; ++r)
+      {
+        auto start = std::chrono::steady_clock::now();
+        result = kernel();
+        std::chrono::duration<double> elapsed
+          = std::chrono::steady_clock::now() - start;
+        best = std::max(best, values / elapsed.count() / 1e6);
+      }
+    return best;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::size_t count = argc > 1 ? std::stoul(argv[1]) : 1 << 22;
+  int runs = argc > 2 ? std::stoi(argv[2]) : 10;
+  if (count < 2)
+    {
+      std::cerr << "Usage: bench_kernels [values] [runs]" << std::endl;
+      return 1;
+    }
+  // Memory sizes in KiB, as in the VIRT column.
+  std::mt19937 generator(20240501);
+  std::uniform_int_distribution<int> kib(1, 4 << 20);
+  std::vector<float> values(count);
+  for (auto&& v : values) { v = static_cast<float>(kib(generator)); }
+
+  struct kernel
+  {
+    const char* name;
+    std::function<double ()> plain;
+    std::function<double ()> column;
+  };
+  const kernel kernels[] = {
+    {"sum", [&] { return plain_sum(values); },
+            [&] { return column_sum(values.data(), count); }},
+    {"min/max", [&] { return plain_min_max(values); },
+                [&]
+                {
+                  float min, max;
+                  column_min_max(values.data(), count, min, max);
+                  return static_cast<double>(max - min);
+                }},
+    {"variance", [&] { return plain_variance(values); },
+                 [&] { return column_variance(values.data(), count); }},
+  };
+  std::vector<kernel_isa> isas{kernel_isa::scalar};
+  if (supported_kernel_isa() != kernel_isa::scalar)
+    { isas.push_back(kernel_isa::avx2); }
+  if (supported_kernel_isa() == kernel_isa::avx512)
+    { isas.push_back(kernel_isa::avx512); }
+
+  std::cout << count << " values, best of " << runs << " runs\n"
+            << std::setprecision(15);
+  for (auto&& k : kernels)
+    {
+      double result = 0;
+      double speed = measure(k.plain, count, runs, result);
+      std::cout << std::setw(9) << k.name << std::setw(8) << "plain" << ": "
+                << std::setw(8) << static_cast<int>(speed) << " M/s, "
+                << result << "\n";
+      for (auto isa : isas)
+        {
+          use_kernel_isa(isa);
+          speed = measure(k.column, count, runs, result);
+          std::cout << std::setw(9) << "" << std::setw(8)
+                    << kernel_isa_name(isa) << ": " << std::setw(8)
+                    << static_cast<int>(speed) << " M/s, " << result << "\n";
+        }
+    }
+  return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ *  Compares the ways top2csv can read a top log: std::ifstream, file_reader
+ *  (buffered and direct I/O) and mmap.
+ *
+ *  Usage: bench_read [--warm] [--parse] <top log> [runs]
+ *
+ *  Unless --warm is given, the file is evicted from the page cache before each
+ *  run, which is the situation of a scan over a cold archive.  With --parse,
+ *  the content is also parsed, otherwise only lines are counted.  For each
+ *  method, the throughput and the share of the file left in the page cache
+ *  afterwards are reported.
+ */
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "parser.hpp"
+#include "reader.hpp"
+
+namespace
+{
+  struct memory_buffer : std::streambuf
+  {
+    memory_buffer(char* begin, char* end) { setg(begin, begin, end); }
+  };
+
+  const std::vector<std::string> processes{"dbserver", "historyserver",
+                                           "SigLoc", "ascmanager"};
+
+  std::size_t consume(std::istream& in, bool parse)
+  {
+    if (parse)
+      {
+        std::vector<row_type> rows;
+        parse_log(in, processes, VIRT_COL, rows);
+        return rows.size();
+      }
+    std::size_t lines = 0;
+    std::string line;
+    while (std::getline(in, line)) { ++lines; }
+    return lines;
+  }
+
+  void evict(const std::string& path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return; }
+    ::fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+
+  /**
+   *  @return The share of the pages of the file in the page cache.
+   */
+  double resident(const std::string& path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0 || st.st_size == 0) { return 0; }
+    void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) { return 0; }
+    long page = ::sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((st.st_size + page - 1) / page);
+    std::size_t in_cache = 0;
+    if (::mincore(map, st.st_size, pages.data()) == 0)
+      { for (auto p : pages) { in_cache += p & 1; } }
+    ::munmap(map, st.st_size);
+    return static_cast<double>(in_cache) / pages.size();
+  }
+
+  std::size_t read_ifstream(const std::string& path, bool parse)
+  {
+    std::ifstream in(path);
+    return consume(in, parse);
+  }
+
+  std::size_t read_file_reader(const std::string& path, bool parse,
+                               bool direct)
+  {
+    file_reader reader(direct ? read_options{4 << 20, true}
+                       : read_options{1 << 20, false});
+    if (!reader.open(path)) { return 0; }
+    std::istream in(&reader);
+    return consume(in, parse);
+  }
+
+  std::size_t read_mmap(const std::string& path, bool parse)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0 || st.st_size == 0) { return 0; }
+    void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) { return 0; }
+    ::madvise(map, st.st_size, MADV_SEQUENTIAL);
+    char* begin = static_cast<char*>(map);
+    std::size_t count = 0;
+    if (parse)
+      {
+        memory_buffer buffer(begin, begin + st.st_size);
+        std::istream in(&buffer);
+        count = consume(in, true);
+      }
+    else
+      {
+        for (char* p = begin; p < begin + st.st_size; ++count)
+          {
+            char* eol = static_cast<char*>
+              (std::memchr(p, '\n', begin + st.st_size - p));
+            p = eol ? eol + 1 : begin + st.st_size;
+          }
+      }
+    ::munmap(map, st.st_size);
+    return count;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  bool warm = false, parse = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i)
+    {
+      std::string arg = argv[i];
+      if (arg == "--warm") { warm = true; }
+      else if (arg == "--parse") { parse = true; }
+      else { args.push_back(arg); }
+    }
+  if (args.empty())
+    {
+      std::cerr << "Usage: bench_read [--warm] [--parse] <top log> [runs]"
+                << std::endl;
+      return 1;
+    }
+  const std::string path = args[0];
+  int runs = args.size() > 1 ? std::stoi(args[1]) : 3;
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    {
+      std::cerr << "Error accessing path: " << path << std::endl;
+      return 1;
+    }
+  double mb = st.st_size / 1048576.;
+
+  struct method
+  {
+    const char* name;
+    std::size_t (*run)(const std::string&, bool);
+  };
+  const method methods[] = {
+    {"ifstream", read_ifstream},
+    {"buffered", [](const std::string& p, bool parse)
+                 { return read_file_reader(p, parse, false); }},
+    {"mmap", read_mmap},
+    {"direct", [](const std::string& p, bool parse)
+               { return read_file_reader(p, parse, true); }},
+  };
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "file: " << path << " (" << mb << " MB), "
+            << (warm ? "warm" : "cold") << " cache, "
+            << (parse ? "parsing" : "counting lines") << "\n";
+  for (auto&& m : methods)
+    {
+      double best = 0;
+      std::size_t count = 0;
+      for (int r = 0; r < runs; ++r)
+        {
+          if (!warm) { evict(path); }
+          else { m.run(path, parse); }
+          auto start = std::chrono::steady_clock::now();
+          count = m.run(path, parse);
+          std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+          best = std::max(best, mb / elapsed.count());
+        }
+      std::cout << std::setw(10) << m.name << ": " << std::setw(8) << best
+                << " MB/s, " << count << (parse ? " rows" : " lines")
+                << ", " << resident(path) * 100 << "% left in page cache\n";
+    }
+  return 0;
+}
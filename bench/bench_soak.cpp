@@ -0,0 +1,231 @@
+/**
+ *  Soak test of the streaming path of top2csv: an endless top log is
+ *  generated, with processes dying and new ones, under new PIDs and names,
+ *  starting in every snapshot, and is parsed as --follow does, the rows
+ *  being printed and checked against alert rules.  The resident set size,
+ *  the heap in use and the number of interned names are sampled as it goes.
+ *
+ *  Usage: bench_soak [lines] [bound in MiB] [lines between samples]
+ *
+ *  By default 2 billion lines are parsed, with a sample every 10 million.
+ *  The first sample is the baseline; the run fails as soon as the resident
+ *  set or the heap has grown by more than the bound, 8 MiB by default, or
+ *  the names of the churned processes end up interned.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "alerts.hpp"
+#include "parser.hpp"
+#include "symbols.hpp"
+
+namespace
+{
+  const std::vector<std::string> processes{"dbserver", "historyserver",
+                                           "SigLoc", "ascmanager"};
+
+  // Processes of a snapshot, and how many of them are replaced each time.
+  const unsigned SLOTS = 48;
+  const unsigned CHURN = 4;
+
+  /**
+   *  An endless top log, produced one snapshot at a time, up to a number of
+   *  lines.
+   */
+  class top_generator : public std::streambuf
+  {
+  public:
+    explicit top_generator(std::uint64_t lines)
+      : left_(lines), snapshot_(0), next_pid_(1000), next_job_(0),
+        slots_(SLOTS)
+    {
+      for (auto&& slot : slots_) { replace(slot); }
+    }
+
+  protected:
+    int_type underflow()
+    {
+      if (gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+      if (left_ == 0) { return traits_type::eof(); }
+      generate();
+      setg(&text_[0], &text_[0], &text_[0] + text_.size());
+      return traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    struct slot_type
+    {
+      unsigned pid;
+      std::string name;
+    };
+
+    void replace(slot_type& slot)
+    {
+      slot.pid = next_pid_++;
+      // A watched process now and then, so that rows and alerts change.
+      slot.name = next_job_ % 5 == 0 ? processes[next_job_ / 5 % 4]
+        : "job" + std::to_string(next_job_);
+      ++next_job_;
+    }
+
+    void add(const char* line)
+    {
+      if (left_ == 0) { return; }
+      text_ += line;
+      --left_;
+    }
+
+    void generate()
+    {
+      text_.clear();
+      char line[160];
+      unsigned seconds = snapshot_ * 5 % 86400;
+      std::snprintf(line, sizeof(line), "top - %02u:%02u:%02u up 10 days,  "
+                    "3:02,  2 users,  load average: 0.10, 0.20, 0.30\n",
+                    seconds / 3600, seconds / 60 % 60, seconds % 60);
+      add(line);
+      add("Tasks: 180 total,   1 running, 179 sleeping,   0 stopped,   "
+          "0 zombie\n");
+      add("Mem:   8000000k total,  7000000k used,  1000000k free,   "
+          "100000k buffers\n");
+      add("\n");
+      add("  PID USER      PR  NI  VIRT  RES  SHR S %CPU %MEM    TIME+  "
+          "COMMAND\n");
+      for (unsigned i = 0; i < CHURN; ++i)
+        { replace(slots_[(snapshot_ * CHURN + i) % SLOTS]); }
+      for (unsigned i = 0; i < SLOTS; ++i)
+        {
+          unsigned n = snapshot_ * 31 + i * 7;
+          std::snprintf(line, sizeof(line), "%5u root      20   0 %4um  10m  "
+                        "5m S %2u.%u  0.1   0:00.01 %s\n", slots_[i].pid,
+                        n % 4000, n % 100, n % 10, slots_[i].name.c_str());
+          add(line);
+        }
+      ++snapshot_;
+    }
+
+    std::uint64_t left_;
+    std::uint64_t snapshot_;
+    unsigned next_pid_;
+    std::uint64_t next_job_;
+    std::vector<slot_type> slots_;
+    std::string text_;
+  };
+
+  struct memory_sample
+  {
+    double rss;  // MiB
+    double heap; // MiB in use, or 0 if unknown
+  };
+
+  memory_sample sample_memory()
+  {
+    memory_sample sample{0, 0};
+    long pages = 0, resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm)
+      {
+        if (std::fscanf(statm, "%ld %ld", &pages, &resident) == 2)
+          { sample.rss = resident * ::sysconf(_SC_PAGESIZE) / 1048576.; }
+        std::fclose(statm);
+      }
+#if defined(__GLIBC__) \
+  && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    sample.heap = (info.uordblks + info.hblkhd) / 1048576.;
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+    sample.heap = (static_cast<unsigned>(info.uordblks)
+                   + static_cast<unsigned>(info.hblkhd)) / 1048576.;
+#endif
+    return sample;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::uint64_t lines = argc > 1 ? std::stoull(argv[1]) : 2000000000ull;
+  double bound = argc > 2 ? std::stod(argv[2]) : 8;
+  std::uint64_t every = argc > 3 ? std::stoull(argv[3]) : 10000000ull;
+  if (every == 0)
+    {
+      std::cerr << "Usage: bench_soak [lines] [bound in MiB] "
+                << "[lines between samples]" << std::endl;
+      return 1;
+    }
+
+  std::vector<alert_rule> rules;
+  std::istringstream rules_text("dbserver VIRT > 3g for 5 snapshots\n"
+                                "SigLoc VIRT < 100m for 1min clear 200m\n");
+  alert_output output;
+  if (!parse_alert_rules(rules_text, "soak", processes, VIRT_COL, rules)
+      || !output.open("/dev/null"))
+    {
+      std::cerr << "Error: cannot set up the alerts" << std::endl;
+      return 1;
+    }
+  alert_engine alerts(rules, output);
+  std::ostringstream text;
+  set_value_format(text, VIRT_COL);
+  std::uint64_t rows = 0;
+  snapshot_parser parser(processes, VIRT_COL,
+                         [&](const row_type& row)
+                         {
+                           text.str("");
+                           print_row(text, row);
+                           alerts.add(row);
+                           ++rows;
+                         });
+
+  top_generator generator(lines);
+  std::istream in(&generator);
+  std::string line;
+  std::uint64_t count = 0;
+  memory_sample baseline{0, 0};
+  std::size_t symbols = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::cout << std::fixed << std::setprecision(1);
+  int ret_val = 0;
+  while (ret_val == 0 && std::getline(in, line))
+    {
+      if (!parser.feed(line)) { return 1; }
+      if (++count % every != 0) { continue; }
+      memory_sample sample = sample_memory();
+      std::size_t interned = symbol_table::global().size();
+      if (count == every)
+        {
+          baseline = sample;
+          symbols = interned;
+        }
+      std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+      std::cout << count << " lines, " << rows << " rows: rss "
+                << sample.rss << " MiB, heap " << sample.heap << " MiB, "
+                << interned << " names, " << count / elapsed.count()
+                << " lines/s" << std::endl;
+      if (sample.rss - baseline.rss > bound
+          || sample.heap - baseline.heap > bound)
+        {
+          std::cerr << "Error: memory grew by more than " << bound
+                    << " MiB since the first sample" << std::endl;
+          ret_val = 1;
+        }
+      if (interned != symbols)
+        {
+          std::cerr << "Error: names of the churned processes were interned"
+                    << std::endl;
+          ret_val = 1;
+        }
+    }
+  parser.finish();
+  return ret_val;
+}
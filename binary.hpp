@@ -0,0 +1,64 @@
+#ifndef TOP2CSV_BINARY_HPP
+#define TOP2CSV_BINARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/*
+ *  Helpers for the binary files of the program, such as the preset cache and
+ *  the gzip index.  Values are stored in native byte order, and strings are
+ *  stored as a 32-bit size followed by their bytes.
+ */
+
+template <typename T>
+void put_binary(std::ostream& out, T value)
+{ out.write(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+inline void put_binary(std::ostream& out, const std::string& text)
+{
+  put_binary(out, static_cast<std::uint32_t>(text.size()));
+  out.write(text.data(), text.size());
+}
+
+/**
+ *  @return false if the value could not be read.
+ */
+template <typename T>
+bool get_binary(std::istream& in, T& value)
+{ return static_cast<bool>(in.read(reinterpret_cast<char*>(&value),
+                                   sizeof(value))); }
+
+/**
+ *  @param max_size Size above which the string is taken for corrupt data.
+ *  @return false if the string could not be read or is too long.
+ */
+inline bool get_binary(std::istream& in, std::string& text,
+                       std::size_t max_size = 1 << 20)
+{
+  std::uint32_t size;
+  if (!get_binary(in, size) || size > max_size) { return false; }
+  text.resize(size);
+  return static_cast<bool>(in.read(&text[0], size));
+}
+
+/**
+ *  @return The 64-bit FNV-1a hash of size bytes.
+ */
+inline std::uint64_t fnv1a(const char* data, std::size_t size)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  for (std::size_t i = 0; i < size; ++i)
+    {
+      hash ^= static_cast<unsigned char>(data[i]);
+      hash *= 1099511628211ull;
+    }
+  return hash;
+}
+
+inline std::uint64_t fnv1a(const std::string& text)
+{ return fnv1a(text.data(), text.size()); }
+
+#endif // TOP2CSV_BINARY_HPP
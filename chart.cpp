@@ -0,0 +1,190 @@
+#include "chart.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+std::vector<chart_point> lttb(const std::vector<chart_point>& points,
+                              std::size_t target)
+{
+  std::size_t n = points.size();
+  if (target >= n || target < 3) { return points; }
+  std::vector<chart_point> sampled;
+  sampled.reserve(target);
+  sampled.push_back(points[0]);
+  // Buckets exclude the first and last points, which are always kept.
+  double every = static_cast<double>(n - 2) / (target - 2);
+  std::size_t a = 0;
+  for (std::size_t i = 0; i < target - 2; ++i)
+    {
+      std::size_t next_begin = static_cast<std::size_t>((i + 1) * every) + 1;
+      std::size_t next_end = std::min(static_cast<std::size_t>
+                                      ((i + 2) * every) + 1, n);
+      double avg_x = 0, avg_y = 0;
+      for (std::size_t j = next_begin; j < next_end; ++j)
+        {
+          avg_x += points[j].x;
+          avg_y += points[j].y;
+        }
+      std::size_t next_count = std::max<std::size_t>(next_end - next_begin, 1);
+      avg_x /= next_count;
+      avg_y /= next_count;
+
+      std::size_t begin = static_cast<std::size_t>(i * every) + 1;
+      std::size_t end = static_cast<std::size_t>((i + 1) * every) + 1;
+      double best = -1;
+      std::size_t chosen = begin;
+      for (std::size_t j = begin; j < end; ++j)
+        {
+          // Twice the area of the triangle (a, j, average of next bucket).
+          double area = std::fabs((points[a].x - avg_x)
+                                  * (points[j].y - points[a].y)
+                                  - (points[a].x - points[j].x)
+                                  * (avg_y - points[a].y));
+          if (area > best)
+            {
+              best = area;
+              chosen = j;
+            }
+        }
+      sampled.push_back(points[chosen]);
+      a = chosen;
+    }
+  sampled.push_back(points[n - 1]);
+  return sampled;
+}
+
+lttb_sampler::lttb_sampler(std::size_t target)
+  : target_(std::max<std::size_t>(target, 3))
+{
+  points_.reserve(4 * target_);
+}
+
+void lttb_sampler::add(double x, double y)
+{
+  points_.push_back(chart_point{x, y});
+  if (points_.size() >= 4 * target_) { points_ = lttb(points_, 2 * target_); }
+}
+
+std::vector<chart_point> lttb_sampler::points() const
+{
+  return lttb(points_, target_);
+}
+
+process_chart::process_chart(const std::vector<std::string>& processes,
+                             const std::string& unit, std::size_t width)
+  : processes_(processes), unit_(unit), width_(std::max<std::size_t>(width, 3)),
+    first_(-1), last_(-1), series_(processes.size(), lttb_sampler(width_)),
+    min_(processes.size(), std::numeric_limits<float>::infinity()),
+    max_(processes.size(), -std::numeric_limits<float>::infinity())
+{ }
+
+void process_chart::add(const row_type& row)
+{
+  std::int64_t time = clock_(row);
+  if (first_ < 0) { first_ = time; }
+  last_ = time;
+  for (std::size_t i = 0; i < series_.size(); ++i)
+    {
+      series_[i].add(static_cast<double>(time), row.columns[i]);
+      min_[i] = std::min(min_[i], row.columns[i]);
+      max_[i] = std::max(max_[i], row.columns[i]);
+    }
+}
+
+namespace
+{
+  const int LEFT = 90;
+  const int RIGHT = 20;
+  const int TOP = 10;
+  const int TITLE = 16;
+  const int PLOT = 60;
+  const int GAP = 14;
+  const int BOTTOM = 24;
+
+  std::string time_label(std::int64_t time)
+  {
+    std::ostringstream out;
+    if (time >= 86400) { out << "+" << time / 86400 << "d "; }
+    std::int64_t seconds = time % 86400;
+    out << std::setfill('0') << std::setw(2) << seconds / 3600 << ":"
+        << std::setw(2) << seconds / 60 % 60 << ":"
+        << std::setw(2) << seconds % 60;
+    return out.str();
+  }
+}
+
+std::string svg_escape(const std::string& text)
+{
+  std::string escaped;
+  for (char c : text)
+    {
+      switch (c)
+        {
+        case '<': escaped += "&lt;"; break;
+        case '>': escaped += "&gt;"; break;
+        case '&': escaped += "&amp;"; break;
+        case '"': escaped += "&quot;"; break;
+        default: escaped += c;
+        }
+    }
+  return escaped;
+}
+
+bool process_chart::write_svg(const fs::path& path) const
+{
+  std::ofstream out(path.string());
+  if (!out) { return false; }
+  int height = TOP + static_cast<int>(series_.size()) * (TITLE + PLOT + GAP)
+    + BOTTOM;
+  int width = LEFT + static_cast<int>(width_) + RIGHT;
+  int precision = unit_ == "%" ? 1 : 0;
+  double span = std::max<double>(static_cast<double>(last_ - first_), 1.);
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width
+      << "\" height=\"" << height << "\" font-family=\"sans-serif\" "
+      << "font-size=\"11\">\n"
+      << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+  out << std::fixed;
+  for (std::size_t i = 0; i < series_.size(); ++i)
+    {
+      int y = TOP + static_cast<int>(i) * (TITLE + PLOT + GAP);
+      double low = std::isfinite(min_[i]) ? min_[i] : 0.;
+      double high = std::isfinite(max_[i]) ? max_[i] : 0.;
+      if (high <= low) { high = low + 1.; }
+      out << "<g transform=\"translate(" << LEFT << "," << y << ")\">\n"
+          << "<text x=\"0\" y=\"12\" font-weight=\"bold\">"
+          << svg_escape(processes_[i]) << "</text>\n"
+          << "<g transform=\"translate(0," << TITLE << ")\">\n"
+          << "<rect width=\"" << width_ << "\" height=\"" << PLOT
+          << "\" fill=\"none\" stroke=\"#ccc\"/>\n"
+          << std::setprecision(precision)
+          << "<text x=\"-4\" y=\"9\" text-anchor=\"end\">" << high << " "
+          << unit_ << "</text>\n"
+          << "<text x=\"-4\" y=\"" << PLOT << "\" text-anchor=\"end\">" << low
+          << " " << unit_ << "</text>\n"
+          << std::setprecision(1)
+          << "<polyline fill=\"none\" stroke=\"#1f77b4\" points=\"";
+      for (auto&& p : series_[i].points())
+        {
+          out << (p.x - first_) / span * (width_ - 1) << ","
+              << PLOT - (p.y - low) / (high - low) * PLOT << " ";
+        }
+      out << "\"/>\n</g>\n</g>\n";
+    }
+  if (first_ >= 0)
+    {
+      int y = height - BOTTOM + 14;
+      out << "<text x=\"" << LEFT << "\" y=\"" << y << "\">"
+          << time_label(first_) << "</text>\n"
+          << "<text x=\"" << LEFT + width_ << "\" y=\"" << y
+          << "\" text-anchor=\"end\">" << time_label(last_) << "</text>\n";
+    }
+  out << "</svg>\n";
+  out.close();
+  return static_cast<bool>(out);
+}
@@ -0,0 +1,92 @@
+#ifndef TOP2CSV_CHART_HPP
+#define TOP2CSV_CHART_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "parser.hpp"
+
+struct chart_point
+{
+  double x;
+  double y;
+};
+
+/**
+ *  Downsamples a series to a given number of points with the
+ *  Largest-Triangle-Three-Buckets algorithm, while the points are added.
+ *
+ *  Points are buffered until there are four times the target, then the buffer
+ *  is downsampled to twice the target, so that memory stays proportional to
+ *  the target and each point is only looked at a few times, whatever the
+ *  length of the series.
+ */
+class lttb_sampler
+{
+public:
+  explicit lttb_sampler(std::size_t target);
+
+  void add(double x, double y);
+
+  /**
+   *  @return The series downsampled to at most the target number of points.
+   */
+  std::vector<chart_point> points() const;
+
+private:
+  std::size_t target_;
+  std::vector<chart_point> points_;
+};
+
+/**
+ *  Downsamples points to at most target points with
+ *  Largest-Triangle-Three-Buckets.  The first and last points are kept.
+ */
+std::vector<chart_point> lttb(const std::vector<chart_point>& points,
+                              std::size_t target);
+
+/**
+ *  @return text with the characters that are special in SVG replaced by
+ *          entities.
+ */
+std::string svg_escape(const std::string& text);
+
+/**
+ *  A chart of the values of each process over time, drawn as small multiples:
+ *  one plot per process, all sharing the same time axis.  Rows are added as
+ *  they are parsed and each series is downsampled to the width of the plots,
+ *  so that drawing takes the same time whatever the length of the log.
+ */
+class process_chart
+{
+public:
+  /**
+   *  @param processes The processes, one plot each.
+   *  @param unit The unit of the values, shown next to the axis labels.
+   *  @param width The width of the plots, in pixels.
+   */
+  process_chart(const std::vector<std::string>& processes,
+                const std::string& unit, std::size_t width);
+
+  void add(const row_type& row);
+
+  /**
+   *  @return false if the SVG file could not be written.
+   */
+  bool write_svg(const boost::filesystem::path& path) const;
+
+private:
+  std::vector<std::string> processes_;
+  std::string unit_;
+  std::size_t width_;
+  day_clock clock_;
+  std::int64_t first_;
+  std::int64_t last_;
+  std::vector<lttb_sampler> series_;
+  std::vector<float> min_;
+  std::vector<float> max_;
+};
+
+#endif // TOP2CSV_CHART_HPP
@@ -0,0 +1,126 @@
+#include "correlate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include "chart.hpp"
+
+namespace fs = boost::filesystem;
+
+correlation::correlation(std::size_t columns)
+  : columns_(columns), count_(0), mean_(columns, 0.), delta_(columns, 0.),
+    co_(columns * columns, 0.)
+{ }
+
+void correlation::add(const std::vector<float>& values)
+{
+  ++count_;
+  double n = static_cast<double>(count_);
+  double* __restrict mean = mean_.data();
+  double* __restrict delta = delta_.data();
+  const float* __restrict x = values.data();
+  for (std::size_t i = 0; i < columns_; ++i)
+    {
+      delta[i] = x[i] - mean[i];
+      mean[i] += delta[i] / n;
+    }
+  // The difference to the new mean is delta * (n - 1) / n, so each co-moment
+  // grows by delta_i * delta_j * (n - 1) / n.
+  double scale = (n - 1.) / n;
+  for (std::size_t i = 0; i < columns_; ++i)
+    {
+      double* __restrict row = co_.data() + i * columns_;
+      double d = delta[i] * scale;
+      for (std::size_t j = i; j < columns_; ++j) { row[j] += d * delta[j]; }
+    }
+}
+
+double correlation::coefficient(std::size_t i, std::size_t j) const
+{
+  if (i > j) { std::swap(i, j); }
+  double vi = co_[i * columns_ + i], vj = co_[j * columns_ + j];
+  if (vi <= 0. || vj <= 0.)
+    { return std::numeric_limits<double>::quiet_NaN(); }
+  double r = co_[i * columns_ + j] / std::sqrt(vi * vj);
+  return std::max(-1., std::min(1., r));
+}
+
+void correlation::write_csv(std::ostream& out,
+                            const std::vector<std::string>& names) const
+{
+  out << "Process";
+  for (auto&& name : names) { out << "," << name; }
+  out << "\n" << std::fixed << std::setprecision(4);
+  for (std::size_t i = 0; i < columns_; ++i)
+    {
+      out << names[i];
+      for (std::size_t j = 0; j < columns_; ++j)
+        {
+          out << ",";
+          double r = coefficient(i, j);
+          if (!std::isnan(r)) { out << r; }
+        }
+      out << "\n";
+    }
+}
+
+void correlation::write_svg(std::ostream& out,
+                            const std::vector<std::string>& names) const
+{
+  const int cell = 24, left = 140, top = 140;
+  int size = static_cast<int>(columns_) * cell;
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\""
+      << left + size + 10 << "\" height=\"" << top + size + 10
+      << "\" font-family=\"sans-serif\" font-size=\"11\">\n"
+      << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+  for (std::size_t i = 0; i < columns_; ++i)
+    {
+      int at = static_cast<int>(i) * cell + cell / 2 + 4;
+      out << "<text x=\"" << left - 4 << "\" y=\"" << top + at
+          << "\" text-anchor=\"end\">" << svg_escape(names[i]) << "</text>\n"
+          << "<text transform=\"translate(" << left + at - 8 << ","
+          << top - 4 << ") rotate(-90)\">" << svg_escape(names[i])
+          << "</text>\n";
+    }
+  out << std::fixed << std::setprecision(2);
+  for (std::size_t i = 0; i < columns_; ++i)
+    {
+      for (std::size_t j = 0; j < columns_; ++j)
+        {
+          double r = coefficient(i, j);
+          std::string fill = "#ccc";
+          if (!std::isnan(r))
+            {
+              // white at 0, towards red for 1 and blue for -1
+              int fade = static_cast<int>(255 * (1. - std::fabs(r)) + 0.5);
+              std::ostringstream color;
+              color << "rgb(" << (r > 0 ? 255 : fade) << "," << fade << ","
+                    << (r < 0 ? 255 : fade) << ")";
+              fill = color.str();
+            }
+          out << "<rect x=\"" << left + static_cast<int>(j) * cell
+              << "\" y=\"" << top + static_cast<int>(i) * cell
+              << "\" width=\"" << cell << "\" height=\"" << cell
+              << "\" fill=\"" << fill << "\"><title>" << svg_escape(names[i])
+              << " / " << svg_escape(names[j]) << ": ";
+          if (std::isnan(r)) { out << "undefined"; }
+          else { out << r; }
+          out << "</title></rect>\n";
+        }
+    }
+  out << "</svg>\n";
+}
+
+bool correlation::write(const fs::path& path,
+                        const std::vector<std::string>& names) const
+{
+  std::ofstream out(path.string());
+  if (!out) { return false; }
+  if (path.extension() == ".svg") { write_svg(out, names); }
+  else { write_csv(out, names); }
+  out.close();
+  return static_cast<bool>(out);
+}
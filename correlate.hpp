@@ -0,0 +1,65 @@
+#ifndef TOP2CSV_CORRELATE_HPP
+#define TOP2CSV_CORRELATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+/**
+ *  The Pearson correlation between every pair of columns of a series of rows,
+ *  computed in a single pass without keeping the rows.
+ *
+ *  The means and the co-moments (sums of products of differences to the
+ *  means) are updated for each row, as Welford does for the variance.  The
+ *  update of a row of the co-moment matrix is a single loop over contiguous
+ *  columns, which the compiler turns into vector instructions.
+ */
+class correlation
+{
+public:
+  explicit correlation(std::size_t columns);
+
+  void add(const std::vector<float>& values);
+
+  std::uint64_t count() const { return count_; }
+
+  /**
+   *  @return The correlation between columns i and j, or NaN when either
+   *          column never changed.
+   */
+  double coefficient(std::size_t i, std::size_t j) const;
+
+  /**
+   *  Writes the matrix as CSV, with the names of the columns as the first row
+   *  and column.  Undefined coefficients are left empty.
+   */
+  void write_csv(std::ostream& out, const std::vector<std::string>& names)
+    const;
+
+  /**
+   *  Draws the matrix as a heatmap, from blue for -1 to red for 1.
+   */
+  void write_svg(std::ostream& out, const std::vector<std::string>& names)
+    const;
+
+  /**
+   *  Writes the matrix to a file, as a heatmap if the file name ends with
+   *  .svg and as CSV otherwise.
+   *
+   *  @return false if the file could not be written.
+   */
+  bool write(const boost::filesystem::path& path,
+             const std::vector<std::string>& names) const;
+
+private:
+  std::size_t columns_;
+  std::uint64_t count_;
+  std::vector<double> mean_;
+  std::vector<double> delta_; // to the mean before the last row
+  std::vector<double> co_; // upper triangle of a columns x columns matrix
+};
+
+#endif // TOP2CSV_CORRELATE_HPP
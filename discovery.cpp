@@ -0,0 +1,35 @@
+#include "discovery.hpp"
+
+#include <regex>
+#include "binary.hpp"
+
+bool is_top_log(const boost::filesystem::path& path)
+{
+  static const std::regex pattern{"top\\.log(\\.[0-9])?"};
+  return std::regex_match(path.filename().string(), pattern);
+}
+
+bool parse_shard(const std::string& spec, shard_spec& shard)
+{
+  static const std::regex pattern{"([0-9]+)/([0-9]+)"};
+  std::smatch subs;
+  if (!std::regex_match(spec, subs, pattern)) { return false; }
+  try
+    {
+      shard.index = static_cast<unsigned>(std::stoul(subs[1]));
+      shard.count = static_cast<unsigned>(std::stoul(subs[2]));
+    }
+  catch (const std::out_of_range&) { return false; }
+  return shard.index >= 1 && shard.index <= shard.count;
+}
+
+bool in_shard(const boost::filesystem::path& relative, const shard_spec& shard)
+{
+  if (shard.count == 0) { return true; }
+  // FNV-1a, with a final mix so that the low bits are usable as a modulo.
+  std::uint64_t hash = fnv1a(relative.generic_string());
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash % shard.count + 1 == shard.index;
+}
@@ -0,0 +1,38 @@
+#ifndef TOP2CSV_DISCOVERY_HPP
+#define TOP2CSV_DISCOVERY_HPP
+
+#include <cstdint>
+#include <string>
+#include <boost/filesystem.hpp>
+
+/**
+ *  @return true if the file name of path is one of top.log or top.log.[0-9].
+ */
+bool is_top_log(const boost::filesystem::path& path);
+
+/**
+ *  One of count disjoint parts of a set of files, numbered from 1 to count.
+ *  A count of 0 means that the set is not split.
+ */
+struct shard_spec
+{
+  unsigned index;
+  unsigned count;
+};
+
+/**
+ *  Parses a shard specification of the form 'i/N', with 1 <= i <= N.
+ *
+ *  @return false if spec is not a valid shard specification.
+ */
+bool parse_shard(const std::string& spec, shard_spec& shard);
+
+/**
+ *  Decides which shard a file belongs to, from a hash of its path relative to
+ *  the root of the search.  The decision only depends on that relative path,
+ *  so that processes running on different hosts, where the root is mounted at
+ *  different places, split the files the same way.
+ */
+bool in_shard(const boost::filesystem::path& relative, const shard_spec& shard);
+
+#endif // TOP2CSV_DISCOVERY_HPP
@@ -0,0 +1,206 @@
+#include "format.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "throttle.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  // Below this, a range is not worth a thread.
+  const std::size_t MIN_RANGE_ROWS = 256;
+  // Above this, with limits, the pauses of the threads would be too far
+  // apart to keep them under the limits.
+  const std::size_t LIMITED_RANGE_ROWS = 4096;
+
+  /**
+   *  Runs work(i) for i from 0 to count - 1 on up to threads threads, which
+   *  report to the limits, if any, after each of them.
+   */
+  template <typename Work>
+  void for_each_range(std::size_t count, unsigned threads,
+                      resource_limits* limits, const Work& work)
+  {
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]
+      {
+        for (std::size_t i = next++; i < count; i = next++)
+          {
+            work(i);
+            if (limits) { limits->consumed(0); }
+          }
+      };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<std::size_t>(threads, count); ++t)
+      { pool.emplace_back(worker); }
+    worker();
+    for (auto&& thread : pool) { thread.join(); }
+  }
+
+  /**
+   *  Appends the value with 0 or 1 decimal, as %.0f and %.1f print it.
+   *
+   *  A float times 10 is exact in a double, so rounding it to an integer in
+   *  the default, to nearest even, mode gives the same digits as printf,
+   *  which rounds the exact value in that mode too.  Values too large for
+   *  that, infinities and NaNs go through snprintf.
+   */
+  void append_fixed(std::string& text, float value, int decimals)
+  {
+    double scaled = decimals ? static_cast<double>(value) * 10.
+                             : static_cast<double>(value);
+    if (!(std::fabs(scaled) < 9007199254740992.)) // 2^53, false for NaN
+      {
+        char buffer[512];
+        int n = std::snprintf(buffer, sizeof(buffer),
+                              decimals ? "%.1f" : "%.0f",
+                              static_cast<double>(value));
+        text.append(buffer, std::min<std::size_t>(n, sizeof(buffer) - 1));
+        return;
+      }
+    std::uint64_t digits
+      = static_cast<std::uint64_t>(std::nearbyint(std::fabs(scaled)));
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* begin = end;
+    if (decimals)
+      {
+        *--begin = static_cast<char>('0' + digits % 10);
+        *--begin = '.';
+        digits /= 10;
+      }
+    do
+      {
+        *--begin = static_cast<char>('0' + digits % 10);
+        digits /= 10;
+      }
+    while (digits);
+    if (std::signbit(value)) { *--begin = '-'; }
+    text.append(begin, end);
+  }
+}
+
+void format_rows(std::string& text, int top_column, const row_type* first,
+                 const row_type* last)
+{
+  const int decimals = top_column == VIRT_COL ? 0 : 1;
+  char buffer[32];
+  for (const row_type* row = first; row != last; ++row)
+    {
+      int n = std::snprintf(buffer, sizeof(buffer), "%d,%d,%d", row->hour,
+                            row->min, row->sec);
+      text.append(buffer, n);
+      for (float col : row->columns)
+        {
+          text += ',';
+          append_fixed(text, col, decimals);
+        }
+      text += '\n';
+    }
+}
+
+std::vector<std::string> format_rows(const std::vector<row_type>& rows,
+                                     int top_column, unsigned threads,
+                                     resource_limits* limits)
+{
+  threads = std::max(threads, 1u);
+  std::size_t per_range = std::max(MIN_RANGE_ROWS,
+                                   (rows.size() + 4 * threads - 1)
+                                   / (4 * threads));
+  if (limits) { per_range = std::min(per_range, LIMITED_RANGE_ROWS); }
+  std::vector<std::string> ranges((rows.size() + per_range - 1) / per_range);
+  for_each_range(ranges.size(), threads, limits, [&](std::size_t i)
+    {
+      const row_type* first = rows.data() + i * per_range;
+      const row_type* last = rows.data()
+        + std::min(rows.size(), (i + 1) * per_range);
+      if (first != last)
+        { ranges[i].reserve(ranges[i].size() + (last - first) * 16); }
+      format_rows(ranges[i], top_column, first, last);
+    });
+  return ranges;
+}
+
+bool write_ranges(const fs::path& path, const std::string& header,
+                  const std::vector<std::string>& ranges, unsigned threads,
+                  resource_limits* limits)
+{
+#ifdef _WIN32
+  (void)threads;
+  (void)limits;
+  std::ofstream out(path.string(), std::ios::binary);
+  out << header;
+  for (auto&& range : ranges) { out.write(range.data(), range.size()); }
+  out.close();
+  return static_cast<bool>(out);
+#else
+  int fd = ::open(path.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) { return false; }
+  std::vector<off_t> offsets(ranges.size());
+  off_t offset = static_cast<off_t>(header.size());
+  for (std::size_t i = 0; i < ranges.size(); ++i)
+    {
+      offsets[i] = offset;
+      offset += static_cast<off_t>(ranges[i].size());
+    }
+  std::atomic<bool> failed(false);
+  auto write_at = [fd, &failed](const std::string& text, off_t at)
+    {
+      std::size_t written = 0;
+      while (written < text.size())
+        {
+          ssize_t n = ::pwrite(fd, text.data() + written,
+                               text.size() - written, at + written);
+          if (n <= 0)
+            {
+              failed = true;
+              return;
+            }
+          written += static_cast<std::size_t>(n);
+        }
+    };
+  // Sizing the file first spares the threads from extending it in turn.
+  if (::ftruncate(fd, offset) != 0) { failed = true; }
+  write_at(header, 0);
+  for_each_range(ranges.size(), threads, limits, [&](std::size_t i)
+    { write_at(ranges[i], offsets[i]); });
+  if (::close(fd) != 0) { failed = true; }
+  return !failed;
+#endif
+}
+
+int parse_and_print_parallel(std::istream& in, std::ostream& out,
+                             const fs::path& output,
+                             const std::vector<std::string>& processes,
+                             int top_column, unsigned threads,
+                             resource_limits* limits)
+{
+  std::vector<row_type> rows;
+  if (parse_log(in, processes, top_column, rows) != 0) { return 1; }
+  std::ostringstream header;
+  print_header(header, processes);
+  std::vector<std::string> ranges = format_rows(rows, top_column, threads,
+                                                limits);
+  if (!output.empty())
+    {
+      if (write_ranges(output, header.str(), ranges, threads, limits))
+        { return 0; }
+      std::cerr << "Error writing file: " << output.string() << std::endl;
+      return 1;
+    }
+  out << header.str();
+  for (auto&& range : ranges) { out.write(range.data(), range.size()); }
+  return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef TOP2CSV_FORMAT_HPP
+#define TOP2CSV_FORMAT_HPP
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "parser.hpp"
+
+class resource_limits;
+
+/**
+ *  Appends to text the CSV lines of the rows from first to last, the same
+ *  bytes as print_row() after set_value_format(), but formatted by hand
+ *  into a single buffer instead of through a stream.
+ */
+void format_rows(std::string& text, int top_column, const row_type* first,
+                 const row_type* last);
+
+/**
+ *  Formats the rows on several threads.
+ *
+ *  The rows are cut into ranges of consecutive rows, a few per thread, that
+ *  threads take in turn and format into buffers of their own.
+ *
+ *  @param limits When not null, told about every range formatted, and may
+ *                pause the threads; the ranges are then kept small.
+ *  @return The CSV lines of the rows, range by range, in order.
+ */
+std::vector<std::string> format_rows(const std::vector<row_type>& rows,
+                                     int top_column, unsigned threads,
+                                     resource_limits* limits = nullptr);
+
+/**
+ *  Writes the header then the formatted ranges to a file.
+ *
+ *  The offset of each range is the sum of the sizes of the text before it,
+ *  so the ranges are written by several threads at once, each at its own
+ *  offset with pwrite, without waiting for the ones before.
+ *
+ *  @param limits When not null, told about every range written, and may
+ *                pause the threads.
+ *  @return false if the file could not be written.
+ */
+bool write_ranges(const boost::filesystem::path& path,
+                  const std::string& header,
+                  const std::vector<std::string>& ranges, unsigned threads,
+                  resource_limits* limits = nullptr);
+
+/**
+ *  Like parse_and_print(), but formats the rows on several threads and,
+ *  when output is not empty, writes them to that file in parallel instead of
+ *  to out.  The output is the same, byte for byte.
+ *
+ *  @param limits When not null, the limits the formatting and writing
+ *                threads are charged to.
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int parse_and_print_parallel(std::istream& in, std::ostream& out,
+                             const boost::filesystem::path& output,
+                             const std::vector<std::string>& processes,
+                             int top_column, unsigned threads,
+                             resource_limits* limits = nullptr);
+
+#endif // TOP2CSV_FORMAT_HPP
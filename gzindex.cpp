@@ -0,0 +1,360 @@
+#include "gzindex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#ifdef TOP2CSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "binary.hpp"
+#include "output.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const char INDEX_MAGIC[8] = {'T', '2', 'C', 'G', 'Z', 'I', 'X', '1'};
+  // Back-references of deflate reach at most this far.
+  const std::size_t WINDOW = 32768;
+  const std::size_t CHUNK = 1 << 16;
+  // "top - HH:MM:SS", the start of the header of a snapshot.
+  const std::size_t HEADER_SIZE = 14;
+
+  /**
+   *  Finds the headers of the snapshots in data given in pieces, and times
+   *  them as a day_clock times the rows of the snapshots.
+   */
+  class header_scanner
+  {
+  public:
+    header_scanner()
+      : offset_(0), line_(0), line_start_(true), day_(0), last_(-1)
+    { }
+
+    /**
+     *  @param found Called with the offset and the time of each header.
+     */
+    template <typename F>
+    void scan(const char* data, std::size_t size, F found)
+    {
+      const char* end = data + size;
+      while (data < end)
+        {
+          if (line_start_)
+            {
+              line_ = offset_;
+              head_.clear();
+              line_start_ = false;
+            }
+          const char* newline = static_cast<const char*>
+            (std::memchr(data, '\n', end - data));
+          const char* stop = newline ? newline : end;
+          if (head_.size() < HEADER_SIZE)
+            {
+              std::size_t n = std::min<std::size_t>(HEADER_SIZE - head_.size(),
+                                                    stop - data);
+              head_.append(data, n);
+              std::int64_t time;
+              if (head_.size() == HEADER_SIZE && is_header(time))
+                { found(line_, time); }
+            }
+          const char* next = newline ? newline + 1 : end;
+          offset_ += next - data;
+          data = next;
+          if (newline) { line_start_ = true; }
+        }
+    }
+
+  private:
+    bool digit(std::size_t i, char max) const
+    { return head_[i] >= '0' && head_[i] <= max; }
+
+    bool is_header(std::int64_t& time)
+    {
+      // As the header pattern of snapshot_parser.
+      if (head_.compare(0, 6, "top - ") != 0 || !digit(6, '2')
+          || !digit(7, '9') || head_[8] != ':' || !digit(9, '5')
+          || !digit(10, '9') || head_[11] != ':' || !digit(12, '5')
+          || !digit(13, '9'))
+        { return false; }
+      auto number = [this](std::size_t i)
+        { return (head_[i] - '0') * 10 + head_[i + 1] - '0'; };
+      int seconds = (number(6) * 60 + number(9)) * 60 + number(12);
+      if (seconds < last_) { ++day_; }
+      last_ = seconds;
+      time = day_ * 86400 + seconds;
+      return true;
+    }
+
+    std::uint64_t offset_;
+    std::uint64_t line_; // offset of the current line
+    bool line_start_;
+    std::string head_;
+    std::int64_t day_;
+    int last_;
+  };
+}
+
+gz_index::gz_index()
+  : gz_size_(0), gz_time_(0), origin_(-1)
+{ }
+
+fs::path gz_index::default_path(const fs::path& gz)
+{
+  fs::path path = gz;
+  path += ".idx";
+  return path;
+}
+
+bool gz_index::build(const fs::path& gz, std::uint64_t span,
+                     const read_options& reading)
+{
+  points_.clear();
+  origin_ = -1;
+#ifdef TOP2CSV_HAVE_ZLIB
+  boost::system::error_code ec;
+  gz_size_ = fs::file_size(gz, ec);
+  if (!ec) { gz_time_ = fs::last_write_time(gz, ec); }
+  file_reader file(reading);
+  if (ec || !file.open(gz)) { return false; }
+  z_stream stream{};
+  if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) { return false; }
+
+  // The decompressed data goes round the window, so that the last 32 KiB
+  // are always there to be saved.
+  std::vector<char> input(CHUNK), window(WINDOW);
+  std::uint64_t total_in = 0, total_out = 0, last = 0;
+  header_scanner scanner;
+  bool pending = false; // no snapshot found after the last checkpoint yet
+  bool ok = false;
+  int status = Z_OK;
+  for (;;)
+    {
+      if (stream.avail_in == 0)
+        {
+          std::streamsize len = file.sgetn(input.data(), input.size());
+          if (len == 0)
+            {
+              ok = status == Z_STREAM_END && !file.failed(); // or truncated
+              break;
+            }
+          stream.next_in = reinterpret_cast<Bytef*>(input.data());
+          stream.avail_in = static_cast<uInt>(len);
+        }
+      if (status == Z_STREAM_END) { inflateReset(&stream); } // next member
+      if (stream.avail_out == 0)
+        {
+          stream.next_out = reinterpret_cast<Bytef*>(window.data());
+          stream.avail_out = static_cast<uInt>(window.size());
+        }
+      char* produced = reinterpret_cast<char*>(stream.next_out);
+      total_in += stream.avail_in;
+      total_out += stream.avail_out;
+      status = inflate(&stream, Z_BLOCK);
+      total_in -= stream.avail_in;
+      total_out -= stream.avail_out;
+      scanner.scan(produced, reinterpret_cast<char*>(stream.next_out)
+                   - produced,
+                   [&](std::uint64_t offset, std::int64_t time)
+                   {
+                     if (origin_ < 0) { origin_ = time; }
+                     if (pending && offset >= points_.back().out)
+                       {
+                         points_.back().header = offset;
+                         points_.back().time = time;
+                         pending = false;
+                       }
+                   });
+      if (status != Z_OK && status != Z_STREAM_END) { break; }
+
+      // At the end of a block, not of the last one of a member.
+      if (status == Z_OK && (stream.data_type & 128)
+          && !(stream.data_type & 64)
+          && (points_.empty() || total_out - last > span))
+        {
+          // Without a snapshot since, the new checkpoint is just closer to
+          // the next one.
+          if (pending) { points_.pop_back(); }
+          gz_checkpoint point{total_in, stream.data_type & 7, total_out, 0, 0,
+                              std::string()};
+          std::size_t left = stream.avail_out;
+          std::string recent(window.data() + WINDOW - left, left);
+          recent.append(window.data(), WINDOW - left);
+          recent.erase(0, WINDOW - std::min<std::uint64_t>(total_out, WINDOW));
+          uLongf size = compressBound(static_cast<uLong>(recent.size()));
+          point.window.resize(size);
+          compress(reinterpret_cast<Bytef*>(&point.window[0]), &size,
+                   reinterpret_cast<const Bytef*>(recent.data()),
+                   static_cast<uLong>(recent.size()));
+          point.window.resize(size);
+          points_.push_back(std::move(point));
+          pending = true;
+          last = total_out;
+        }
+    }
+  inflateEnd(&stream);
+  if (pending) { points_.pop_back(); }
+  return ok;
+#else
+  (void) gz;
+  (void) span;
+  (void) reading;
+  return false;
+#endif
+}
+
+bool gz_index::extract(const fs::path& gz, std::size_t checkpoint,
+                       std::uint64_t end, const sink_type& sink,
+                       const read_options& reading) const
+{
+#ifdef TOP2CSV_HAVE_ZLIB
+  const gz_checkpoint& point = points_.at(checkpoint);
+  read_options buffered = reading;
+  buffered.direct = false;
+  file_reader file(buffered);
+  if (!file.open(gz) || !file.seek(point.in - (point.bits ? 1 : 0)))
+    { return false; }
+  z_stream stream{};
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) { return false; }
+  bool ok = true;
+  if (point.bits)
+    {
+      int byte = file.sbumpc();
+      ok = byte != std::char_traits<char>::eof()
+        && inflatePrime(&stream, point.bits, byte >> (8 - point.bits)) == Z_OK;
+    }
+  if (ok && !point.window.empty())
+    {
+      std::string window(WINDOW, '\0');
+      uLongf size = WINDOW;
+      ok = uncompress(reinterpret_cast<Bytef*>(&window[0]), &size,
+                      reinterpret_cast<const Bytef*>(point.window.data()),
+                      static_cast<uLong>(point.window.size())) == Z_OK
+        && (size == 0
+            || inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>
+                                    (window.data()),
+                                    static_cast<uInt>(size)) == Z_OK);
+    }
+
+  std::vector<char> input(CHUNK), output(4 * CHUNK);
+  std::uint64_t out = point.out;
+  bool raw = true; // the member of the checkpoint has no header to read
+  auto refill = [&]
+    {
+      if (stream.avail_in > 0) { return true; }
+      stream.next_in = reinterpret_cast<Bytef*>(input.data());
+      stream.avail_in = static_cast<uInt>(file.sgetn(input.data(),
+                                                     input.size()));
+      return stream.avail_in > 0;
+    };
+  while (ok && out < end)
+    {
+      if (!refill())
+        {
+          ok = false; // truncated
+          break;
+        }
+      stream.next_out = reinterpret_cast<Bytef*>(output.data());
+      stream.avail_out = static_cast<uInt>(output.size());
+      int status = inflate(&stream, Z_NO_FLUSH);
+      if (status != Z_OK && status != Z_STREAM_END)
+        {
+          ok = false;
+          break;
+        }
+      std::uint64_t size = output.size() - stream.avail_out;
+      std::uint64_t begin = std::max(out, point.header);
+      std::uint64_t stop = std::min(out + size, end);
+      if (begin < stop) { sink(output.data() + (begin - out), stop - begin); }
+      out += size;
+      if (status == Z_STREAM_END)
+        {
+          if (raw)
+            {
+              // Skips the trailer of the member, which zlib only reads
+              // itself when it has read the header.
+              for (int skip = 8; skip > 0 && refill(); )
+                {
+                  uInt n = std::min<uInt>(skip, stream.avail_in);
+                  stream.next_in += n;
+                  stream.avail_in -= n;
+                  skip -= n;
+                }
+            }
+          if (!refill()) { break; }
+          inflateReset2(&stream, 16 + MAX_WBITS);
+          raw = false;
+        }
+    }
+  inflateEnd(&stream);
+  return ok && !file.failed();
+#else
+  (void) gz;
+  (void) checkpoint;
+  (void) end;
+  (void) sink;
+  (void) reading;
+  return false;
+#endif
+}
+
+/*
+ *  The index holds, in native byte order: the magic, the size and the time
+ *  of the gzip file, the time of the first snapshot, then the checkpoints.
+ */
+bool gz_index::load(const fs::path& path, const fs::path& gz)
+{
+  points_.clear();
+  boost::system::error_code ec;
+  std::uintmax_t size = fs::file_size(gz, ec);
+  if (ec) { return false; }
+  std::time_t time = fs::last_write_time(gz, ec);
+  std::ifstream in(path.string(), std::ios::binary);
+  char magic[sizeof(INDEX_MAGIC)];
+  std::uint64_t count;
+  if (ec || !in.read(magic, sizeof(magic))
+      || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0
+      || !get_binary(in, gz_size_) || gz_size_ != size
+      || !get_binary(in, gz_time_) || gz_time_ != time
+      || !get_binary(in, origin_) || !get_binary(in, count))
+    { return false; }
+  for (std::uint64_t i = 0; i < count; ++i)
+    {
+      gz_checkpoint point;
+      std::int32_t bits;
+      if (!get_binary(in, point.in) || !get_binary(in, bits)
+          || !get_binary(in, point.out) || !get_binary(in, point.header)
+          || !get_binary(in, point.time)
+          || !get_binary(in, point.window, 2 * WINDOW)
+          || bits < 0 || bits > 7)
+        {
+          points_.clear();
+          return false;
+        }
+      point.bits = bits;
+      points_.push_back(std::move(point));
+    }
+  return true;
+}
+
+bool gz_index::save(const fs::path& path) const
+{
+  auto write = [this](std::ostream& out)
+    {
+      out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+      put_binary(out, gz_size_);
+      put_binary(out, gz_time_);
+      put_binary(out, origin_);
+      put_binary(out, static_cast<std::uint64_t>(points_.size()));
+      for (auto&& point : points_)
+        {
+          put_binary(out, point.in);
+          put_binary(out, static_cast<std::int32_t>(point.bits));
+          put_binary(out, point.out);
+          put_binary(out, point.header);
+          put_binary(out, point.time);
+          put_binary(out, point.window);
+        }
+    };
+  return write_atomically(path, write, true);
+}
@@ -0,0 +1,105 @@
+#ifndef TOP2CSV_GZINDEX_HPP
+#define TOP2CSV_GZINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "reader.hpp"
+
+/**
+ *  A point of a gzip file where decompression can start without
+ *  decompressing what is before it: the start of a deflate block, with the
+ *  32 KiB of data decompressed before it that the block can refer to.
+ */
+struct gz_checkpoint
+{
+  std::uint64_t in;   // offset of the first whole byte of the block
+  int bits;           // bits of the byte before it that belong to the block
+  std::uint64_t out;  // offset of the block in the decompressed data
+  std::uint64_t header; // offset of the first snapshot after the block
+  std::int64_t time;  // time of that snapshot, as with a day_clock
+  std::string window; // compressed
+};
+
+/**
+ *  A checkpoint index of a gzip compressed top log, after zran: every span
+ *  of decompressed data, the state needed to decompress from there is
+ *  recorded, with the time of the first snapshot after it.  A part of the
+ *  log can then be decompressed without decompressing it from the start,
+ *  and several parts at once.
+ *
+ *  The index is saved to a file of its own, with the size and the time of
+ *  the gzip file it was built from so that it is not used once stale.
+ */
+class gz_index
+{
+public:
+  typedef std::function<void (const char*, std::size_t)> sink_type;
+
+  gz_index();
+
+  /**
+   *  Decompresses the whole gzip file once to build its index.
+   *
+   *  @param span Decompressed bytes between two checkpoints, at least.
+   *  @param reading How the gzip file is read, including the limits of
+   *                 --max-cpu and --max-io.
+   *  @return false if the file could not be read or decompressed.
+   */
+  bool build(const boost::filesystem::path& gz,
+             std::uint64_t span = 1 << 20,
+             const read_options& reading = read_options{1 << 20, false});
+
+  /**
+   *  @return false if the index could not be read or is not the index of the
+   *          gzip file as it is now.
+   */
+  bool load(const boost::filesystem::path& path,
+            const boost::filesystem::path& gz);
+
+  /**
+   *  @return false if the index could not be written.
+   */
+  bool save(const boost::filesystem::path& path) const;
+
+  /**
+   *  @return The time of the first snapshot of the log, or -1 if there is
+   *          none.
+   */
+  std::int64_t origin() const { return origin_; }
+
+  const std::vector<gz_checkpoint>& checkpoints() const { return points_; }
+
+  /**
+   *  Decompresses the data from the first snapshot after a checkpoint up to
+   *  the offset end, or to the end of the data, and hands it to the sink in
+   *  pieces.  Can be called from several threads at once.
+   *
+   *  @param reading How the gzip file is read, as for build().  It is
+   *                 always read buffered.
+   *  @return false if the gzip file could not be read or decompressed.
+   */
+  bool extract(const boost::filesystem::path& gz, std::size_t checkpoint,
+               std::uint64_t end, const sink_type& sink,
+               const read_options& reading = read_options{1 << 20, false})
+    const;
+
+  /**
+   *  @return Where the index of a gzip file is saved by default: next to it,
+   *          with .idx appended.
+   */
+  static boost::filesystem::path
+  default_path(const boost::filesystem::path& gz);
+
+private:
+  std::uintmax_t gz_size_;
+  std::time_t gz_time_;
+  std::int64_t origin_;
+  std::vector<gz_checkpoint> points_;
+};
+
+#endif // TOP2CSV_GZINDEX_HPP
@@ -0,0 +1,174 @@
+#include "heatmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <regex>
+#include <sstream>
+#include "chart.hpp"
+
+namespace fs = boost::filesystem;
+
+bool parse_bucket_scale(const std::string& spec, unsigned buckets,
+                        bucket_scale& scale)
+{
+  if (spec == "log")
+    {
+      scale = bucket_scale{true, 0, 0};
+      return true;
+    }
+  static const std::regex pattern{"linear:([0-9]+(\\.[0-9]*)?)"};
+  std::smatch subs;
+  if (!std::regex_match(spec, subs, pattern) || buckets == 0) { return false; }
+  scale = bucket_scale{false, std::stod(subs[1]), buckets};
+  return scale.max > 0;
+}
+
+value_heatmap::value_heatmap(const std::vector<std::string>& processes,
+                             std::int64_t window, const bucket_scale& scale)
+  : processes_(processes), window_(std::max<std::int64_t>(window, 1)),
+    scale_(scale), buckets_(scale.log ? LOG_BUCKETS : scale.count)
+{ }
+
+unsigned value_heatmap::bucket(float value) const
+{
+  if (scale_.log)
+    {
+      if (!(value >= 1.f)) { return 0; }
+      int exponent;
+      std::frexp(value, &exponent); // value = m * 2^exponent, 0.5 <= m < 1
+      return std::min<unsigned>(exponent, LOG_BUCKETS - 1);
+    }
+  if (!(value > 0.f)) { return 0; }
+  double b = value / scale_.max * buckets_;
+  return b >= buckets_ ? buckets_ - 1 : static_cast<unsigned>(b);
+}
+
+void value_heatmap::add(const row_type& row)
+{
+  std::int64_t start = clock_(row) / window_ * window_;
+  if (windows_.empty() || windows_.back().start != start)
+    {
+      windows_.push_back(window_counts{start, std::vector<std::uint32_t>
+                                       (processes_.size() * buckets_, 0)});
+    }
+  std::uint32_t* counts = windows_.back().counts.data();
+  for (std::size_t i = 0; i < row.columns.size(); ++i)
+    { ++counts[i * buckets_ + bucket(row.columns[i])]; }
+}
+
+void value_heatmap::used_buckets(unsigned& first, unsigned& last) const
+{
+  if (!scale_.log)
+    {
+      first = 0;
+      last = buckets_ - 1;
+      return;
+    }
+  first = buckets_;
+  last = 0;
+  for (auto&& w : windows_)
+    {
+      for (std::size_t i = 0; i < w.counts.size(); ++i)
+        {
+          if (!w.counts[i]) { continue; }
+          unsigned b = static_cast<unsigned>(i % buckets_);
+          first = std::min(first, b);
+          last = std::max(last, b);
+        }
+    }
+  if (first > last) { first = last = 0; }
+}
+
+std::string value_heatmap::bucket_label(unsigned b) const
+{
+  std::ostringstream label;
+  label << std::setprecision(15);
+  if (scale_.log)
+    { label << (b == 0 ? 0. : std::ldexp(1., static_cast<int>(b) - 1)); }
+  else
+    { label << scale_.max * b / buckets_; }
+  return label.str();
+}
+
+void value_heatmap::write_csv(std::ostream& out) const
+{
+  unsigned first, last;
+  used_buckets(first, last);
+  out << "Process,Day,Hour,Minute,Second";
+  for (unsigned b = first; b <= last; ++b) { out << "," << bucket_label(b); }
+  out << "\n";
+  for (std::size_t p = 0; p < processes_.size(); ++p)
+    {
+      for (auto&& w : windows_)
+        {
+          std::int64_t seconds = w.start % 86400;
+          out << processes_[p] << "," << w.start / 86400 << ","
+              << seconds / 3600 << "," << seconds / 60 % 60 << ","
+              << seconds % 60;
+          for (unsigned b = first; b <= last; ++b)
+            { out << "," << w.counts[p * buckets_ + b]; }
+          out << "\n";
+        }
+    }
+}
+
+void value_heatmap::write_svg(std::ostream& out) const
+{
+  const int left = 90, top = 10, title = 16, gap = 14, cell_height = 4;
+  unsigned first, last;
+  used_buckets(first, last);
+  int rows = static_cast<int>(last - first + 1);
+  int cell = windows_.empty() ? 1
+    : std::max(2, std::min(20, 800 / static_cast<int>(windows_.size())));
+  int width = cell * static_cast<int>(windows_.size());
+  int block = title + rows * cell_height + gap;
+  out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\""
+      << left + width + 20 << "\" height=\""
+      << top + block * static_cast<int>(processes_.size()) << "\" "
+      << "font-family=\"sans-serif\" font-size=\"11\">\n"
+      << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+  for (std::size_t p = 0; p < processes_.size(); ++p)
+    {
+      std::uint32_t highest = 1;
+      for (auto&& w : windows_)
+        {
+          for (unsigned b = first; b <= last; ++b)
+            { highest = std::max(highest, w.counts[p * buckets_ + b]); }
+        }
+      int y = top + static_cast<int>(p) * block;
+      out << "<g transform=\"translate(" << left << "," << y << ")\">\n"
+          << "<text x=\"0\" y=\"12\" font-weight=\"bold\">"
+          << svg_escape(processes_[p]) << "</text>\n"
+          << "<text x=\"-4\" y=\"" << title + 8 << "\" text-anchor=\"end\">"
+          << bucket_label(last) << "</text>\n"
+          << "<text x=\"-4\" y=\"" << title + rows * cell_height
+          << "\" text-anchor=\"end\">" << bucket_label(first) << "</text>\n";
+      for (std::size_t w = 0; w < windows_.size(); ++w)
+        {
+          for (unsigned b = first; b <= last; ++b)
+            {
+              std::uint32_t count = windows_[w].counts[p * buckets_ + b];
+              if (!count) { continue; }
+              int shade = 255 - static_cast<int>(235. * count / highest);
+              out << "<rect x=\"" << static_cast<int>(w) * cell << "\" y=\""
+                  << title + static_cast<int>(last - b) * cell_height
+                  << "\" width=\"" << cell << "\" height=\"" << cell_height
+                  << "\" fill=\"rgb(" << shade << "," << shade << ",255)\"/>\n";
+            }
+        }
+      out << "</g>\n";
+    }
+  out << "</svg>\n";
+}
+
+bool value_heatmap::write(const fs::path& path) const
+{
+  std::ofstream out(path.string());
+  if (!out) { return false; }
+  if (path.extension() == ".svg") { write_svg(out); }
+  else { write_csv(out); }
+  out.close();
+  return static_cast<bool>(out);
+}
@@ -0,0 +1,91 @@
+#ifndef TOP2CSV_HEATMAP_HPP
+#define TOP2CSV_HEATMAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "parser.hpp"
+
+/**
+ *  How values are binned: either in power of 2 buckets, [0, 1), [1, 2),
+ *  [2, 4) and so on, or in count buckets of the same width from 0 to max,
+ *  the last one also taking the values above max.
+ */
+struct bucket_scale
+{
+  bool log;
+  double max;
+  unsigned count;
+};
+
+/**
+ *  Parses a scale given as 'log' or as 'linear:<max>'.
+ *
+ *  @return false if spec is not a valid scale.
+ */
+bool parse_bucket_scale(const std::string& spec, unsigned buckets,
+                        bucket_scale& scale);
+
+/**
+ *  The distribution of the values of each process over time: for each time
+ *  window and each process, the number of snapshots whose value falls in
+ *  each bucket.
+ *
+ *  Rows are added as they are parsed and only increment counts, so the
+ *  memory used only depends on the number of windows, processes and buckets.
+ */
+class value_heatmap
+{
+public:
+  value_heatmap(const std::vector<std::string>& processes,
+                std::int64_t window, const bucket_scale& scale);
+
+  void add(const row_type& row);
+
+  /**
+   *  Writes one CSV line per process and window, with the start of the
+   *  window and the count of each bucket; buckets are named after their
+   *  lower bound.  With a log scale, only the buckets from the lowest to the
+   *  highest one used are written.
+   */
+  void write_csv(std::ostream& out) const;
+
+  /**
+   *  Draws one heatmap per process, time going right and values up, the
+   *  darker the more snapshots.
+   */
+  void write_svg(std::ostream& out) const;
+
+  /**
+   *  Writes the heatmap as SVG if the file name ends with .svg, as CSV
+   *  otherwise.
+   *
+   *  @return false if the file could not be written.
+   */
+  bool write(const boost::filesystem::path& path) const;
+
+private:
+  static const unsigned LOG_BUCKETS = 64;
+
+  struct window_counts
+  {
+    std::int64_t start;
+    std::vector<std::uint32_t> counts; // process by process
+  };
+
+  unsigned bucket(float value) const;
+  void used_buckets(unsigned& first, unsigned& last) const;
+  std::string bucket_label(unsigned b) const;
+
+  std::vector<std::string> processes_;
+  std::int64_t window_;
+  bucket_scale scale_;
+  unsigned buckets_;
+  day_clock clock_;
+  std::vector<window_counts> windows_;
+};
+
+#endif // TOP2CSV_HEATMAP_HPP
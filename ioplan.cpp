@@ -0,0 +1,123 @@
+#include "ioplan.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#include "reader.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  /**
+   *  @return false if the file system cannot tell where the file starts on the
+   *          device.
+   */
+  bool physical_offset(const fs::path& path, std::uint64_t& offset)
+  {
+#ifdef __linux__
+    int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return false; }
+    alignas(fiemap) char buffer[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+    auto map = reinterpret_cast<fiemap*>(buffer);
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    bool ok = ::ioctl(fd, FS_IOC_FIEMAP, map) == 0;
+    ::close(fd);
+    if (!ok) { return false; }
+    offset = map->fm_mapped_extents ? map->fm_extents[0].fe_physical : 0;
+    return true;
+#else
+    (void) path;
+    (void) offset;
+    return false;
+#endif
+  }
+}
+
+std::vector<device_plan> plan_reads(const std::vector<fs::path>& files)
+{
+  std::vector<device_plan> plan;
+#ifdef _WIN32
+  plan.push_back(device_plan{0, {}});
+  for (auto&& f : files)
+    {
+      boost::system::error_code ec;
+      auto size = fs::file_size(f, ec);
+      plan[0].files.push_back(planned_file{f, ec ? 0 : size,
+                                           plan[0].files.size()});
+    }
+#else
+  std::map<std::uint64_t, std::size_t> devices;
+  for (auto&& f : files)
+    {
+      struct stat st;
+      if (::stat(f.string().c_str(), &st) != 0) { continue; }
+      auto found = devices.find(st.st_dev);
+      if (found == devices.end())
+        {
+          found = devices.insert(std::make_pair(st.st_dev, plan.size())).first;
+          plan.push_back(device_plan{static_cast<std::uint64_t>(st.st_dev),
+                                     {}});
+        }
+      plan[found->second].files.push_back
+        (planned_file{f, static_cast<std::uintmax_t>(st.st_size),
+                      static_cast<std::uint64_t>(st.st_ino)});
+    }
+  for (auto&& device : plan)
+    {
+      // Inode numbers and offsets cannot be compared with each other, so
+      // offsets are only used if all files of the device have one.
+      std::vector<std::uint64_t> offsets(device.files.size());
+      bool all = true;
+      for (std::size_t i = 0; all && i < device.files.size(); ++i)
+        { all = physical_offset(device.files[i].path, offsets[i]); }
+      if (all)
+        {
+          for (std::size_t i = 0; i < device.files.size(); ++i)
+            { device.files[i].position = offsets[i]; }
+        }
+      std::stable_sort(device.files.begin(), device.files.end(),
+                       [](const planned_file& a, const planned_file& b)
+                       { return a.position < b.position; });
+    }
+#endif
+  return plan;
+}
+
+void run_plan(const std::vector<device_plan>& plan, unsigned readers_per_device,
+              const std::function<void (const planned_file&)>& read)
+{
+  std::vector<std::atomic<std::size_t> > next(plan.size());
+  std::vector<std::thread> threads;
+  for (std::size_t d = 0; d < plan.size(); ++d)
+    {
+      next[d] = 0;
+      for (unsigned r = 0; r < std::max(readers_per_device, 1u); ++r)
+        {
+          threads.emplace_back([&, d]
+            {
+              const auto& files = plan[d].files;
+              for (std::size_t i = next[d]++; i < files.size(); i = next[d]++)
+                {
+                  if (i + 1 < files.size())
+                    { prefetch_file(files[i + 1].path); }
+                  read(files[i]);
+                }
+            });
+        }
+    }
+  for (auto&& t : threads) { t.join(); }
+}
@@ -0,0 +1,46 @@
+#ifndef TOP2CSV_IOPLAN_HPP
+#define TOP2CSV_IOPLAN_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+struct planned_file
+{
+  boost::filesystem::path path;
+  std::uintmax_t size;
+  std::uint64_t position; // physical offset, or inode number, on the device
+};
+
+/**
+ *  The files to read on one device, in the order they should be read.
+ */
+struct device_plan
+{
+  std::uint64_t device;
+  std::vector<planned_file> files;
+};
+
+/**
+ *  Plans the reads of a set of files to minimize seeks on rotating disks.
+ *
+ *  Files are grouped per device and, on each device, ordered by the physical
+ *  offset of their first extent when the file system reports it (FIEMAP on
+ *  Linux), or by inode number otherwise, which most file systems allocate
+ *  close to the data.  On systems without devices and inodes, all files are
+ *  on a single device and keep their original order.
+ */
+std::vector<device_plan>
+plan_reads(const std::vector<boost::filesystem::path>& files);
+
+/**
+ *  Runs read on every file of the plan, with readers_per_device threads for
+ *  each device, each device being read independently of the others.  Files of
+ *  a device are started in the planned order, and the next file is prefetched
+ *  while the current one is read.
+ */
+void run_plan(const std::vector<device_plan>& plan, unsigned readers_per_device,
+              const std::function<void (const planned_file&)>& read);
+
+#endif // TOP2CSV_IOPLAN_HPP
@@ -0,0 +1,209 @@
+#include "join.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "parser.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  struct timed_row
+  {
+    std::int64_t time;
+    std::vector<float> columns;
+  };
+
+  typedef std::vector<timed_row> row_batch;
+
+  const std::size_t BATCH_ROWS = 256;
+  const std::size_t CHANNEL_BATCHES = 4;
+
+  /**
+   *  A bounded queue of batches of rows from a parser thread to the merge.
+   */
+  class row_channel
+  {
+  public:
+    row_channel() : closed_(false) { }
+
+    void push(row_batch&& batch)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_full_.wait(lock, [this]
+                     { return batches_.size() < CHANNEL_BATCHES; });
+      batches_.push_back(std::move(batch));
+      not_empty_.notify_one();
+    }
+
+    void close()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+      not_empty_.notify_one();
+    }
+
+    /**
+     *  @return false once the channel is closed and empty.
+     */
+    bool pop(row_batch& batch)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_.wait(lock, [this] { return closed_ || !batches_.empty(); });
+      if (batches_.empty()) { return false; }
+      batch = std::move(batches_.front());
+      batches_.pop_front();
+      not_full_.notify_one();
+      return true;
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<row_batch> batches_;
+    bool closed_;
+  };
+
+  struct host_stream
+  {
+    row_channel channel;
+    row_batch batch;
+    std::size_t next = 0;
+
+    /**
+     *  @return The next row of the host, or null at the end of its log.
+     */
+    const timed_row* head()
+    {
+      while (next == batch.size())
+        {
+          batch.clear();
+          next = 0;
+          if (!channel.pop(batch)) { return nullptr; }
+        }
+      return &batch[next];
+    }
+  };
+
+  std::mutex console_mutex;
+
+  void parse_host(const fs::path& log,
+                  const std::vector<std::string>& processes, int top_column,
+                  const read_options& reading, row_channel& channel,
+                  std::atomic<bool>& failed)
+  {
+    file_reader reader(reading);
+    if (!reader.open(log))
+      {
+        std::lock_guard<std::mutex> lock(console_mutex);
+        std::cerr << "Error opening file: " << log.string() << std::endl;
+        failed = true;
+        channel.close();
+        return;
+      }
+    std::istream in(&reader);
+    day_clock clock;
+    row_batch batch;
+    snapshot_parser parser(processes, top_column,
+                           [&](const row_type& row)
+                           {
+                             batch.push_back(timed_row{clock(row),
+                                                       row.columns});
+                             if (batch.size() == BATCH_ROWS)
+                               {
+                                 channel.push(std::move(batch));
+                                 batch = row_batch();
+                               }
+                           });
+    if (!parser.feed_stream(in)) { failed = true; }
+    parser.finish();
+    if (!batch.empty()) { channel.push(std::move(batch)); }
+    if (reader.failed())
+      {
+        std::lock_guard<std::mutex> lock(console_mutex);
+        std::cerr << "Error reading file: " << log.string() << std::endl;
+        failed = true;
+      }
+    channel.close();
+  }
+}
+
+std::vector<std::string> host_labels(const std::vector<fs::path>& logs)
+{
+  std::vector<std::string> labels;
+  std::map<std::string, unsigned> uses;
+  for (auto&& log : logs)
+    {
+      fs::path directory = log.parent_path().filename();
+      labels.push_back(directory.empty() || directory == "."
+                       ? log.generic_string() : directory.string());
+      ++uses[labels.back()];
+    }
+  for (std::size_t i = 0; i < logs.size(); ++i)
+    {
+      if (uses[labels[i]] > 1) { labels[i] = logs[i].generic_string(); }
+    }
+  return labels;
+}
+
+int join_and_print(const std::vector<fs::path>& logs, std::ostream& out,
+                   const std::vector<std::string>& processes, int top_column,
+                   unsigned tolerance, const read_options& reading)
+{
+  std::vector<std::string> labels = host_labels(logs);
+  std::vector<std::unique_ptr<host_stream> > hosts;
+  std::vector<std::thread> parsers;
+  std::atomic<bool> failed(false);
+  for (auto&& log : logs)
+    {
+      hosts.emplace_back(new host_stream);
+      parsers.emplace_back(parse_host, log, std::cref(processes), top_column,
+                           std::cref(reading),
+                           std::ref(hosts.back()->channel), std::ref(failed));
+    }
+
+  out << "Hour,Minute,Second";
+  for (auto&& label : labels)
+    {
+      for (auto&& p : processes) { out << "," << label << ":" << p; }
+    }
+  out << "\n";
+  set_value_format(out, top_column);
+  std::string missing(processes.size(), ',');
+  while (true)
+    {
+      std::int64_t time = std::numeric_limits<std::int64_t>::max();
+      for (auto&& host : hosts)
+        {
+          const timed_row* row = host->head();
+          if (row && row->time < time) { time = row->time; }
+        }
+      if (time == std::numeric_limits<std::int64_t>::max()) { break; }
+      std::int64_t seconds = time % 86400;
+      out << seconds / 3600 << "," << seconds / 60 % 60 << "," << seconds % 60;
+      for (auto&& host : hosts)
+        {
+          const timed_row* row = host->head();
+          if (!row || row->time > time + tolerance)
+            {
+              out << missing;
+              continue;
+            }
+          for (auto&& value : row->columns) { out << "," << value; }
+          ++host->next;
+        }
+      out << "\n";
+    }
+  out.flush();
+  for (auto&& parser : parsers) { parser.join(); }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#ifndef TOP2CSV_JOIN_HPP
+#define TOP2CSV_JOIN_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "reader.hpp"
+
+/**
+ *  @return A label for the host of each top log: the name of the directory
+ *          of the log, or the path of the log when two logs are in
+ *          directories with the same name.
+ */
+std::vector<std::string>
+host_labels(const std::vector<boost::filesystem::path>& logs);
+
+/**
+ *  Parses the top logs of several hosts and writes them side by side: one
+ *  row per time, with the value of each process on each host in columns
+ *  named host:process.
+ *
+ *  Each log is parsed on its own thread while the rows are merged in time
+ *  order, so that only a few rows of each log are in memory at once.  The
+ *  snapshots of different hosts are rarely taken at the same second: a row
+ *  starts at the earliest pending snapshot and takes the next snapshot of
+ *  every host that is at most tolerance seconds later.  Hosts without such a
+ *  snapshot have empty values.  Times are counted from the midnight that
+ *  starts each log.
+ *
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int join_and_print(const std::vector<boost::filesystem::path>& logs,
+                   std::ostream& out,
+                   const std::vector<std::string>& processes, int top_column,
+                   unsigned tolerance, const read_options& reading);
+
+#endif // TOP2CSV_JOIN_HPP
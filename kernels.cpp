@@ -0,0 +1,279 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define TOP2CSV_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  struct kernel_table
+  {
+    kernel_isa isa;
+    double (*sum)(const float*, std::size_t);
+    void (*min_max)(const float*, std::size_t, float&, float&);
+    double (*m2)(const float*, std::size_t, double);
+  };
+
+  double sum_scalar(const float* values, std::size_t count)
+  {
+    double sum = 0.;
+    for (std::size_t i = 0; i < count; ++i) { sum += values[i]; }
+    return sum;
+  }
+
+  void min_max_scalar(const float* values, std::size_t count, float& min,
+                      float& max)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+      {
+        min = std::min(min, values[i]);
+        max = std::max(max, values[i]);
+      }
+  }
+
+  double m2_scalar(const float* values, std::size_t count, double mean)
+  {
+    double m2 = 0.;
+    for (std::size_t i = 0; i < count; ++i)
+      {
+        double delta = values[i] - mean;
+        m2 += delta * delta;
+      }
+    return m2;
+  }
+
+  const kernel_table scalar_kernels{kernel_isa::scalar, sum_scalar,
+                                    min_max_scalar, m2_scalar};
+
+#ifdef TOP2CSV_X86_KERNELS
+  /*
+   *  The AVX2 and AVX-512 kernels are compiled for their instruction set
+   *  with target attributes, whatever the flags of the rest of the program,
+   *  and only called once the processor is known to support it.  Floats are
+   *  widened to doubles, several accumulators hide the latency of the
+   *  additions, and the last values are left to the scalar loops.
+   */
+
+  __attribute__((target("avx2")))
+  double sum_avx2(const float* values, std::size_t count)
+  {
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    __m256d a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+      {
+        __m256 x = _mm256_loadu_ps(values + i);
+        __m256 y = _mm256_loadu_ps(values + i + 8);
+        a0 = _mm256_add_pd(a0, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+        a1 = _mm256_add_pd(a1, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+        a2 = _mm256_add_pd(a2, _mm256_cvtps_pd(_mm256_castps256_ps128(y)));
+        a3 = _mm256_add_pd(a3, _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)));
+      }
+    a0 = _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3));
+    double lanes[4];
+    _mm256_storeu_pd(lanes, a0);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+      + sum_scalar(values + i, count - i);
+  }
+
+  __attribute__((target("avx2")))
+  void min_max_avx2(const float* values, std::size_t count, float& min,
+                    float& max)
+  {
+    __m256 low = _mm256_set1_ps(min), high = _mm256_set1_ps(max);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+      {
+        __m256 x = _mm256_loadu_ps(values + i);
+        low = _mm256_min_ps(low, x);
+        high = _mm256_max_ps(high, x);
+      }
+    float lanes[8];
+    _mm256_storeu_ps(lanes, low);
+    min = *std::min_element(lanes, lanes + 8);
+    _mm256_storeu_ps(lanes, high);
+    max = *std::max_element(lanes, lanes + 8);
+    min_max_scalar(values + i, count - i, min, max);
+  }
+
+  __attribute__((target("avx2")))
+  double m2_avx2(const float* values, std::size_t count, double mean)
+  {
+    __m256d center = _mm256_set1_pd(mean);
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+      {
+        __m256 x = _mm256_loadu_ps(values + i);
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)),
+                                   center);
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)),
+                                   center);
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(d0, d0));
+        a1 = _mm256_add_pd(a1, _mm256_mul_pd(d1, d1));
+      }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(a0, a1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+      + m2_scalar(values + i, count - i, mean);
+  }
+
+  const kernel_table avx2_kernels{kernel_isa::avx2, sum_avx2, min_max_avx2,
+                                  m2_avx2};
+
+  __attribute__((target("avx512f")))
+  __m512d high_half(__m512 x)
+  {
+    return _mm512_cvtps_pd(_mm256_castpd_ps
+                           (_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1)));
+  }
+
+  __attribute__((target("avx512f")))
+  double sum_avx512(const float* values, std::size_t count)
+  {
+    __m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+    __m512d a2 = _mm512_setzero_pd(), a3 = _mm512_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+      {
+        __m512 x = _mm512_loadu_ps(values + i);
+        __m512 y = _mm512_loadu_ps(values + i + 16);
+        a0 = _mm512_add_pd(a0, _mm512_cvtps_pd(_mm512_castps512_ps256(x)));
+        a1 = _mm512_add_pd(a1, high_half(x));
+        a2 = _mm512_add_pd(a2, _mm512_cvtps_pd(_mm512_castps512_ps256(y)));
+        a3 = _mm512_add_pd(a3, high_half(y));
+      }
+    a0 = _mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3));
+    return _mm512_reduce_add_pd(a0) + sum_scalar(values + i, count - i);
+  }
+
+  __attribute__((target("avx512f")))
+  void min_max_avx512(const float* values, std::size_t count, float& min,
+                      float& max)
+  {
+    __m512 low = _mm512_set1_ps(min), high = _mm512_set1_ps(max);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+      {
+        __m512 x = _mm512_loadu_ps(values + i);
+        low = _mm512_min_ps(low, x);
+        high = _mm512_max_ps(high, x);
+      }
+    min = _mm512_reduce_min_ps(low);
+    max = _mm512_reduce_max_ps(high);
+    min_max_scalar(values + i, count - i, min, max);
+  }
+
+  __attribute__((target("avx512f")))
+  double m2_avx512(const float* values, std::size_t count, double mean)
+  {
+    __m512d center = _mm512_set1_pd(mean);
+    __m512d a0 = _mm512_setzero_pd(), a1 = _mm512_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+      {
+        __m512 x = _mm512_loadu_ps(values + i);
+        __m512d d0 = _mm512_sub_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(x)),
+                                   center);
+        __m512d d1 = _mm512_sub_pd(high_half(x), center);
+        a0 = _mm512_add_pd(a0, _mm512_mul_pd(d0, d0));
+        a1 = _mm512_add_pd(a1, _mm512_mul_pd(d1, d1));
+      }
+    return _mm512_reduce_add_pd(_mm512_add_pd(a0, a1))
+      + m2_scalar(values + i, count - i, mean);
+  }
+
+  const kernel_table avx512_kernels{kernel_isa::avx512, sum_avx512,
+                                    min_max_avx512, m2_avx512};
+#endif
+
+  const kernel_table& kernels_for(kernel_isa isa)
+  {
+#ifdef TOP2CSV_X86_KERNELS
+    if (isa == kernel_isa::avx512) { return avx512_kernels; }
+    if (isa == kernel_isa::avx2) { return avx2_kernels; }
+#endif
+    (void)isa;
+    return scalar_kernels;
+  }
+
+  std::atomic<const kernel_table*> active_kernels(nullptr);
+
+  const kernel_table& kernels()
+  {
+    const kernel_table* table = active_kernels.load(std::memory_order_acquire);
+    if (!table)
+      {
+        // Racing threads all find the same table.
+        table = &kernels_for(supported_kernel_isa());
+        active_kernels.store(table, std::memory_order_release);
+      }
+    return *table;
+  }
+}
+
+kernel_isa supported_kernel_isa()
+{
+  static const kernel_isa supported = []
+    {
+#ifdef TOP2CSV_X86_KERNELS
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx512f")) { return kernel_isa::avx512; }
+      if (__builtin_cpu_supports("avx2")) { return kernel_isa::avx2; }
+#endif
+      return kernel_isa::scalar;
+    }();
+  return supported;
+}
+
+kernel_isa use_kernel_isa(kernel_isa isa)
+{
+  if (static_cast<int>(isa) > static_cast<int>(supported_kernel_isa()))
+    { isa = supported_kernel_isa(); }
+  active_kernels.store(&kernels_for(isa), std::memory_order_release);
+  return isa;
+}
+
+const char* kernel_isa_name(kernel_isa isa)
+{
+  switch (isa)
+    {
+    case kernel_isa::avx512: return "avx512";
+    case kernel_isa::avx2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+double column_sum(const float* values, std::size_t count)
+{
+  return kernels().sum(values, count);
+}
+
+void column_min_max(const float* values, std::size_t count, float& min,
+                    float& max)
+{
+  min = std::numeric_limits<float>::infinity();
+  max = -std::numeric_limits<float>::infinity();
+  kernels().min_max(values, count, min, max);
+}
+
+double column_mean(const float* values, std::size_t count)
+{
+  return count ? column_sum(values, count) / count : 0.;
+}
+
+double column_m2(const float* values, std::size_t count, double mean)
+{
+  return kernels().m2(values, count, mean);
+}
+
+double column_variance(const float* values, std::size_t count)
+{
+  if (count < 2) { return 0.; }
+  return column_m2(values, count, column_mean(values, count)) / (count - 1);
+}
@@ -0,0 +1,59 @@
+#ifndef TOP2CSV_KERNELS_HPP
+#define TOP2CSV_KERNELS_HPP
+
+#include <cstddef>
+
+/**
+ *  The instruction sets the aggregation kernels are written for.
+ */
+enum class kernel_isa { scalar, avx2, avx512 };
+
+/**
+ *  @return The best instruction set the processor supports, found once at
+ *          run time.  Always scalar on other processors than x86.
+ */
+kernel_isa supported_kernel_isa();
+
+/**
+ *  Makes the kernels use an instruction set, for tests and benchmarks.  The
+ *  kernels use the best supported one until this is called.
+ *
+ *  @return The instruction set used, which is the supported one if isa is
+ *          not supported.
+ */
+kernel_isa use_kernel_isa(kernel_isa isa);
+
+const char* kernel_isa_name(kernel_isa isa);
+
+/*
+ *  Reductions over a column of values, contiguous in memory.  Sums are taken
+ *  in double precision, like the loops they replace; the values of a column
+ *  are whole KiB or tenths of a percent, so their sums are exact whatever the
+ *  order of the additions and every instruction set gives the same result.
+ */
+
+double column_sum(const float* values, std::size_t count);
+
+/**
+ *  Sets min and max to the extremes of the values, or to +infinity and
+ *  -infinity when count is 0.
+ */
+void column_min_max(const float* values, std::size_t count, float& min,
+                    float& max);
+
+/**
+ *  @return The mean of the values, 0 when count is 0.
+ */
+double column_mean(const float* values, std::size_t count);
+
+/**
+ *  @return The sum of the squared differences between the values and mean.
+ */
+double column_m2(const float* values, std::size_t count, double mean);
+
+/**
+ *  @return The sample variance of the values, 0 when count is below 2.
+ */
+double column_variance(const float* values, std::size_t count);
+
+#endif // TOP2CSV_KERNELS_HPP
@@ -0,0 +1,370 @@
+#include "output.hpp"
+
+#include <iostream>
+#include <set>
+#ifdef TOP2CSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  /**
+   *  Flushes the content of an already closed file to the disk.  On Windows,
+   *  directories cannot be opened this way and are silently skipped.
+   *
+   *  @return false if the file could not be synced.
+   */
+  bool sync_path(const fs::path& path, bool directory)
+  {
+#ifdef _WIN32
+    if (directory) { return true; }
+    int fd = _open(path.string().c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) { return false; }
+    bool ok = _commit(fd) == 0;
+    _close(fd);
+    return ok;
+#else
+    int fd = ::open(path.string().c_str(),
+                    O_RDONLY | (directory ? O_DIRECTORY : 0));
+    if (fd < 0) { return false; }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+  }
+}
+
+output_batch::output_batch(std::size_t batch_size)
+  : batch_size_(batch_size)
+{ }
+
+output_batch::~output_batch()
+{
+  boost::system::error_code ec;
+  for (auto&& p : pending_) { fs::remove(p.temporary, ec); }
+}
+
+fs::path output_batch::temporary_path(const fs::path& final_path)
+{
+  fs::path tmp = final_path;
+  tmp += fs::unique_path(".%%%%%%%%.tmp");
+  return tmp;
+}
+
+bool output_batch::add(const fs::path& final_path, const fs::path& temporary)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto&& p : pending_)
+    {
+      if (p.final_path != final_path) { continue; }
+      boost::system::error_code ec;
+      fs::remove(p.temporary, ec);
+      p.temporary = temporary;
+      return true;
+    }
+  pending_.push_back(pending_output{final_path, temporary});
+  if (batch_size_ == 0 || pending_.size() < batch_size_) { return true; }
+  return publish(lock);
+}
+
+bool output_batch::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  return pending_.empty() || publish(lock);
+}
+
+bool output_batch::publish(std::unique_lock<std::mutex>& lock)
+{
+  std::vector<pending_output> outputs;
+  outputs.swap(pending_);
+  std::lock_guard<std::mutex> publishing(publish_mutex_);
+  lock.unlock();
+  bool ok = true;
+  boost::system::error_code ec;
+  std::set<fs::path> directories;
+  // All data reaches the disk before any rename is made visible, so that a
+  // crash in the middle of the batch leaves only complete files behind.
+  for (auto&& p : outputs)
+    {
+      if (!sync_path(p.temporary, false))
+        {
+          std::cerr << "Error syncing file: " << p.temporary.string()
+                    << std::endl;
+          fs::remove(p.temporary, ec);
+          ok = false;
+          continue;
+        }
+      fs::rename(p.temporary, p.final_path, ec);
+      if (ec)
+        {
+          std::cerr << "Error renaming " << p.temporary.string() << " to "
+                    << p.final_path.string() << ": " << ec.message()
+                    << std::endl;
+          fs::remove(p.temporary, ec);
+          ok = false;
+          continue;
+        }
+      fs::path dir = p.final_path.parent_path();
+      directories.insert(dir.empty() ? fs::path(".") : dir);
+    }
+  for (auto&& d : directories)
+    {
+      if (!sync_path(d, true))
+        {
+          std::cerr << "Error syncing directory: " << d.string() << std::endl;
+          ok = false;
+        }
+    }
+  return ok;
+}
+
+bool write_atomically(const fs::path& path,
+                      const std::function<void (std::ostream&)>& write,
+                      bool binary)
+{
+  fs::path tmp = output_batch::temporary_path(path);
+  std::ofstream out(tmp.string(), binary ? std::ios::out | std::ios::binary
+                    : std::ios::out);
+  if (!out) { return false; }
+  write(out);
+  out.close();
+  boost::system::error_code ec;
+  if (out) { fs::rename(tmp, path, ec); }
+  if (!out || ec)
+    {
+      fs::remove(tmp, ec);
+      return false;
+    }
+  return true;
+}
+
+bool parse_rotation(const std::string& spec, rotation_policy& policy)
+{
+  policy.max_bytes = 0;
+  if (spec == "hourly") { policy.kind = rotation_policy::hourly; return true; }
+  if (spec == "daily") { policy.kind = rotation_policy::daily; return true; }
+  std::size_t end = 0;
+  unsigned long long value = 0;
+  try { value = std::stoull(spec, &end); }
+  catch (const std::exception&) { return false; }
+  std::string suffix = spec.substr(end);
+  if (suffix == "K" || suffix == "k") { value <<= 10; }
+  else if (suffix == "M" || suffix == "m") { value <<= 20; }
+  else if (suffix == "G" || suffix == "g") { value <<= 30; }
+  else if (!suffix.empty()) { return false; }
+  if (value == 0) { return false; }
+  policy.kind = rotation_policy::size;
+  policy.max_bytes = value;
+  return true;
+}
+
+namespace
+{
+  /**
+   *  Compresses src into src.gz and removes src once the compressed file is
+   *  complete.
+   *
+   *  @return false if the compressed file could not be written.
+   */
+  bool gzip_file(const fs::path& src)
+  {
+#ifdef TOP2CSV_HAVE_ZLIB
+    fs::path dst = src;
+    dst += ".gz";
+    fs::path tmp = output_batch::temporary_path(dst);
+    std::ifstream in(src.string(), std::ios::binary);
+    gzFile gz = gzopen(tmp.string().c_str(), "wb");
+    if (!in || gz == nullptr)
+      {
+        if (gz != nullptr) { gzclose(gz); }
+        return false;
+      }
+    bool ok = true;
+    std::vector<char> buffer(1 << 16);
+    while (ok && (in.read(buffer.data(), buffer.size()) || in.gcount() > 0))
+      {
+        ok = gzwrite(gz, buffer.data(),
+                     static_cast<unsigned>(in.gcount())) > 0;
+      }
+    ok = gzclose(gz) == Z_OK && ok;
+    boost::system::error_code ec;
+    if (ok) { fs::rename(tmp, dst, ec); }
+    if (!ok || ec)
+      {
+        fs::remove(tmp, ec);
+        return false;
+      }
+    in.close();
+    fs::remove(src, ec);
+    return true;
+#else
+    (void) src;
+    return false;
+#endif
+  }
+}
+
+rotating_output::rotating_output(const fs::path& path, std::string header,
+                                 rotation_policy policy, bool compress)
+  : path_(path), header_(std::move(header)), policy_(policy),
+    compress_(compress), out_(path.string(), std::ios::trunc),
+    written_(0), last_hour_(-1), sequence_(1), failed_(false),
+    closing_(false), written_all_(false)
+{
+  if (!out_) { return; }
+  out_ << header_;
+  written_ = header_.size();
+  writer_ = std::thread(&rotating_output::write_loop, this);
+  compressor_ = std::thread(&rotating_output::compress_loop, this);
+}
+
+rotating_output::~rotating_output()
+{
+  close();
+}
+
+bool rotating_output::good() const
+{
+  return writer_.joinable();
+}
+
+void rotating_output::write(int hour, std::string text)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunks_.push_back(chunk_type{hour, std::move(text)});
+  }
+  wake_.notify_all();
+}
+
+bool rotating_output::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+  }
+  wake_.notify_all();
+  if (writer_.joinable()) { writer_.join(); }
+  if (compressor_.joinable()) { compressor_.join(); }
+  if (out_.is_open())
+    {
+      out_.close();
+      if (!out_) { failed_ = true; }
+    }
+  return !failed_;
+}
+
+void rotating_output::write_loop()
+{
+  std::deque<chunk_type> batch;
+  for (;;)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return closing_ || !chunks_.empty(); });
+        if (chunks_.empty()) // closing_ and nothing left to write
+          {
+            written_all_ = true;
+            break;
+          }
+        batch.swap(chunks_);
+      }
+      for (auto&& chunk : batch)
+        {
+          if (should_rotate(chunk)) { rotate(); }
+          out_ << chunk.text;
+          written_ += chunk.text.size();
+          last_hour_ = chunk.hour;
+        }
+      batch.clear();
+      out_.flush();
+      if (!out_) { failed_ = true; }
+    }
+  wake_.notify_all();
+}
+
+void rotating_output::compress_loop()
+{
+  for (;;)
+    {
+      fs::path closed;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return written_all_ || !closed_.empty(); });
+        if (closed_.empty()) { break; }
+        closed = closed_.front();
+        closed_.pop_front();
+      }
+      if (!gzip_file(closed))
+        {
+          std::cerr << "Error compressing file: " << closed.string()
+                    << std::endl;
+          failed_ = true;
+        }
+    }
+}
+
+bool rotating_output::should_rotate(const chunk_type& chunk) const
+{
+  if (written_ <= header_.size()) { return false; } // nothing to archive yet
+  switch (policy_.kind)
+    {
+    case rotation_policy::hourly:
+      return chunk.hour != last_hour_;
+    case rotation_policy::daily:
+      return chunk.hour < last_hour_;
+    case rotation_policy::size:
+      return written_ + chunk.text.size() > policy_.max_bytes;
+    default:
+      return false;
+    }
+}
+
+void rotating_output::rotate()
+{
+  out_.close();
+  if (!out_) { failed_ = true; }
+  boost::system::error_code ec;
+  fs::path archive;
+  for (;; ++sequence_)
+    {
+      archive = path_;
+      archive += "." + std::to_string(sequence_);
+      fs::path compressed = archive;
+      compressed += ".gz";
+      if (!fs::exists(archive, ec) && !fs::exists(compressed, ec)) { break; }
+    }
+  fs::rename(path_, archive, ec);
+  if (ec)
+    {
+      std::cerr << "Error renaming " << path_.string() << " to "
+                << archive.string() << ": " << ec.message() << std::endl;
+      failed_ = true;
+    }
+  else if (compress_)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_.push_back(archive);
+      }
+      wake_.notify_all();
+    }
+  out_.clear();
+  out_.open(path_.string(), std::ios::trunc);
+  if (!out_)
+    {
+      std::cerr << "Error opening file: " << path_.string() << std::endl;
+      failed_ = true;
+    }
+  out_ << header_;
+  written_ = header_.size();
+}
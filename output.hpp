@@ -0,0 +1,199 @@
+#ifndef TOP2CSV_OUTPUT_HPP
+#define TOP2CSV_OUTPUT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+/**
+ *  Publishes output files atomically, in batches.
+ *
+ *  Each output is first written to a temporary file next to its final
+ *  location.  Once a batch of outputs is complete, all temporary files are
+ *  synced to disk together, renamed over their final names and their parent
+ *  directories are synced.  A crash therefore never leaves a partially written
+ *  output under its final name, and the cost of syncing is paid once per
+ *  batch rather than once per file.
+ *
+ *  Outputs can be added and flushed from several threads.
+ */
+class output_batch
+{
+public:
+  /**
+   *  @param batch_size Number of outputs to accumulate before they are
+   *                    synced and published.  0 means a single batch that is
+   *                    only published by flush().
+   */
+  explicit output_batch(std::size_t batch_size);
+
+  /**
+   *  Removes the temporary files of outputs that were never published.
+   */
+  ~output_batch();
+
+  /**
+   *  @return A new temporary path to write the output for final_path into,
+   *          next to it and unique, so that two conversions of the same
+   *          output never write into the same temporary file.
+   */
+  static boost::filesystem::path
+  temporary_path(const boost::filesystem::path& final_path);
+
+  /**
+   *  Queues a completely written temporary file for publication as
+   *  final_path.  An output still queued for the same final path is
+   *  superseded and its temporary file removed.  Publishes the whole batch
+   *  once it is full.
+   *
+   *  @return false if publishing the batch failed, true otherwise.
+   */
+  bool add(const boost::filesystem::path& final_path,
+           const boost::filesystem::path& temporary);
+
+  /**
+   *  Syncs and publishes all queued outputs.
+   *
+   *  @return false if any output could not be synced or renamed.
+   */
+  bool flush();
+
+private:
+  struct pending_output
+  {
+    boost::filesystem::path final_path;
+    boost::filesystem::path temporary;
+  };
+
+  bool publish(std::unique_lock<std::mutex>& lock);
+
+  std::size_t batch_size_;
+  std::mutex mutex_;
+  // Held while a batch is published, so that batches are published in the
+  // order they were filled and a newer output is never overwritten by an
+  // older one.
+  std::mutex publish_mutex_;
+  std::vector<pending_output> pending_;
+};
+
+/**
+ *  Writes a file atomically: the content is written to a unique temporary
+ *  file next to it, which is then renamed over path.  A concurrent reader
+ *  never sees a partial file, and concurrent writers never share a
+ *  temporary file.
+ *
+ *  @param write Writes the content.  The file is only renamed into place if
+ *               the stream is still good afterwards.
+ *  @param binary Whether the file is opened in binary mode.
+ *  @return false if the file could not be written or renamed.
+ */
+bool write_atomically(const boost::filesystem::path& path,
+                      const std::function<void (std::ostream&)>& write,
+                      bool binary = false);
+
+/**
+ *  Describes when a rotating_output starts a new file.
+ */
+struct rotation_policy
+{
+  enum kind_type { none, hourly, daily, size };
+  kind_type kind;
+  std::uintmax_t max_bytes;
+};
+
+/**
+ *  Parses a rotation specification: 'daily', 'hourly' or a size in bytes,
+ *  optionally followed by one of the K, M or G suffixes.
+ *
+ *  @return false if spec is not a valid rotation specification.
+ */
+bool parse_rotation(const std::string& spec, rotation_policy& policy);
+
+/**
+ *  An output file that is closed and replaced by a new one, at snapshot
+ *  boundaries, according to a rotation policy.
+ *
+ *  Closed files are renamed <path>.1, <path>.2, etc. in the order they were
+ *  closed and can be compressed to <path>.N.gz.  All file operations happen on
+ *  a dedicated writer thread and compression on yet another thread:
+ *  write() only queues the text, so the calling thread never waits on disk
+ *  I/O, rotation or compression.
+ */
+class rotating_output
+{
+public:
+  /**
+   *  Opens path, truncating it, and writes the header in it.  Every file
+   *  started by a rotation begins with the header as well.
+   */
+  rotating_output(const boost::filesystem::path& path, std::string header,
+                  rotation_policy policy, bool compress);
+
+  /**
+   *  Calls close().
+   */
+  ~rotating_output();
+
+  /**
+   *  @return false if the output could not be opened.
+   */
+  bool good() const;
+
+  /**
+   *  Queues the text of one snapshot for writing.
+   *
+   *  @param hour The hour of the snapshot, used by time based rotations.
+   *  @param text The text for the snapshot; it is never split across files.
+   */
+  void write(int hour, std::string text);
+
+  /**
+   *  Writes all queued text, waits for pending compressions and closes the
+   *  output.
+   *
+   *  @return false if any write, rotation or compression failed.
+   */
+  bool close();
+
+private:
+  struct chunk_type
+  {
+    int hour;
+    std::string text;
+  };
+
+  void write_loop();
+  void compress_loop();
+  bool should_rotate(const chunk_type& chunk) const;
+  void rotate();
+
+  boost::filesystem::path path_;
+  std::string header_;
+  rotation_policy policy_;
+  bool compress_;
+  std::ofstream out_;
+  std::uintmax_t written_;
+  int last_hour_;
+  unsigned sequence_;
+  std::atomic<bool> failed_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<chunk_type> chunks_;
+  std::deque<boost::filesystem::path> closed_;
+  bool closing_;
+  bool written_all_;
+  std::thread writer_;
+  std::thread compressor_;
+};
+
+#endif // TOP2CSV_OUTPUT_HPP
@@ -0,0 +1,268 @@
+#include "parser.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include "symbols.hpp"
+
+namespace
+{
+  // Bytes read at once by feed_stream.
+  const std::size_t READ_CHUNK = 1 << 20;
+  // Most bytes tokenized at once, for the offsets to fit in 32 bits.
+  const std::ptrdiff_t MAX_SEGMENT = 1 << 30;
+  // The field of the process name.
+  const int NAME_FIELD = 11;
+
+  bool digit(char c, char max) { return c >= '0' && c <= max; }
+
+  int two_digits(const char* p) { return (p[0] - '0') * 10 + p[1] - '0'; }
+
+  bool malformed()
+  {
+    std::cerr << "Malformed top log; logs must start by \"top - \".\n";
+    return false;
+  }
+
+  /**
+   *  @return The value of a field, with its m or g suffix applied.  Values
+   *          which are not numbers throw as std::stof does.
+   */
+  float parse_value(const char* text, std::size_t size)
+  {
+    char number[32];
+    float val;
+    if (size < sizeof(number))
+      {
+        std::memcpy(number, text, size);
+        number[size] = '\0';
+        char* stop;
+        errno = 0;
+        val = std::strtof(number, &stop);
+        if (stop == number || errno == ERANGE)
+          { val = std::stof(std::string(text, size)); }
+      }
+    else
+      { val = std::stof(std::string(text, size)); }
+    char suffix = text[size - 1];
+    if (suffix == 'm') { val *= 1024.0; }
+    else if (suffix == 'g') { val *= 1048576.0; }
+    return val;
+  }
+}
+
+bool parse_snapshot_header(const char* line, std::size_t size, row_type& row)
+{
+  if (size < 14 || std::memcmp(line, "top - ", 6) != 0
+      || !digit(line[6], '2') || !digit(line[7], '9') || line[8] != ':'
+      || !digit(line[9], '5') || !digit(line[10], '9') || line[11] != ':'
+      || !digit(line[12], '5') || !digit(line[13], '9'))
+    { return false; }
+  row.hour = two_digits(line + 6);
+  row.min = two_digits(line + 9);
+  row.sec = two_digits(line + 12);
+  return true;
+}
+
+std::int64_t day_clock::operator()(const row_type& row)
+{
+  int seconds = (row.hour * 60 + row.min) * 60 + row.sec;
+  if (seconds < last_) { ++day_; }
+  last_ = seconds;
+  return day_ * 86400 + seconds;
+}
+
+process_index::process_index(const std::vector<std::string>& processes)
+{
+  symbol_table& symbols = symbol_table::global();
+  for (std::size_t i = 0; i < processes.size(); ++i)
+    {
+      std::uint32_t id = symbols.intern(processes[i]);
+      if (id >= columns_.size()) { columns_.resize(id + 1, -1); }
+      if (columns_[id] < 0) { columns_[id] = static_cast<int>(i); }
+    }
+}
+
+int process_index::find(const char* name, std::size_t length) const
+{
+  std::uint32_t id = symbol_table::global().find(name, length);
+  return id == symbol_table::none ? -1 : column(id);
+}
+
+snapshot_parser::snapshot_parser(const std::vector<std::string>& processes,
+                                 int top_column, sink_type sink)
+  : processes_(processes), index_(processes), top_column_(top_column),
+    sink_(std::move(sink)),
+    open_(false), row_{0, 0, 0, {}}
+{ }
+
+bool snapshot_parser::feed(const std::string& line)
+{
+  // An empty line is not a block of lines, but is a line before the header.
+  if (line.empty() && !open_) { return malformed(); }
+  return feed_block(line.data(), line.size());
+}
+
+bool snapshot_parser::feed_block(const char* data, std::size_t size)
+{
+  const char* end = data + size;
+  const char* p = data;
+  row_type header;
+  while (p < end)
+    {
+      const char* eol = static_cast<const char*>
+        (std::memchr(p, '\n', end - p));
+      if (parse_snapshot_header(p, (eol ? eol : end) - p, header))
+        {
+          finish();
+          row_.hour = header.hour;
+          row_.min = header.min;
+          row_.sec = header.sec;
+          row_.columns.assign(processes_.size(), 0.f);
+          open_ = true;
+          p = eol ? eol + 1 : end;
+          continue;
+        }
+      if (!open_) { return malformed(); }
+      const char* base = p;
+      p = tokenize(p, end);
+      add_lines(base);
+    }
+  return true;
+}
+
+/**
+ *  Finds the fields of the lines from begin up to the next header.
+ *
+ *  @return Where the lines tokenized end.
+ */
+const char* snapshot_parser::tokenize(const char* begin, const char* end)
+{
+  fields_.clear();
+  lines_.clear();
+  row_type header;
+  const char* p = begin;
+  while (p < end && p - begin < MAX_SEGMENT)
+    {
+      if (*p == 't' && !lines_.empty()
+          && parse_snapshot_header(p, end - p, header))
+        { break; }
+      lines_.push_back(static_cast<std::uint32_t>(fields_.size()));
+      for (;;)
+        {
+          while (p < end && (*p == ' ' || *p == '\t')) { ++p; }
+          if (p == end || *p == '\n') { break; }
+          fields_.push_back(static_cast<std::uint32_t>(p - begin));
+          while (p < end && *p != ' ' && *p != '\t' && *p != '\n') { ++p; }
+          fields_.push_back(static_cast<std::uint32_t>(p - begin));
+        }
+      if (p < end) { ++p; } // the end of line
+    }
+  lines_.push_back(static_cast<std::uint32_t>(fields_.size()));
+  return p;
+}
+
+/**
+ *  Adds the value of each line of a watched process to the row, the lines
+ *  having been tokenized from base.
+ */
+void snapshot_parser::add_lines(const char* base)
+{
+  for (std::size_t l = 0; l + 1 < lines_.size(); ++l)
+    {
+      std::uint32_t first = lines_[l];
+      if (lines_[l + 1] - first <= 2 * NAME_FIELD) { continue; }
+      const std::uint32_t* name = &fields_[first + 2 * NAME_FIELD];
+      int found = index_.find(base + name[0], name[1] - name[0]);
+      if (found < 0) { continue; }
+      const std::uint32_t* value = &fields_[first + 2 * top_column_];
+      row_.columns[found] += parse_value(base + value[0], value[1] - value[0]);
+    }
+}
+
+bool snapshot_parser::feed_stream(std::istream& in)
+{
+  std::size_t kept = 0; // the start of a line, read with the last chunk
+  for (;;)
+    {
+      if (buffer_.size() < kept + READ_CHUNK)
+        { buffer_.resize(kept + READ_CHUNK); }
+      in.read(buffer_.data() + kept, READ_CHUNK);
+      std::size_t size = kept + static_cast<std::size_t>(in.gcount());
+      if (size == kept) { break; }
+      std::size_t lines = size;
+      while (lines > kept && buffer_[lines - 1] != '\n') { --lines; }
+      if (lines == kept)
+        {
+          kept = size; // a line longer than a chunk
+          continue;
+        }
+      if (!feed_block(buffer_.data(), lines)) { return false; }
+      std::memmove(buffer_.data(), buffer_.data() + lines, size - lines);
+      kept = size - lines;
+    }
+  return kept == 0 || feed_block(buffer_.data(), kept);
+}
+
+void snapshot_parser::finish()
+{
+  if (open_)
+    {
+      open_ = false;
+      sink_(row_);
+    }
+}
+
+void print_header(std::ostream& out, const std::vector<std::string>& processes)
+{
+  out << "Hour,Minute,Second";
+  for (auto&& p : processes) { out << "," << p; }
+  out << "\n";
+}
+
+void set_value_format(std::ostream& out, int top_column)
+{
+  out << std::fixed;
+  if (top_column == VIRT_COL)
+    { out << std::setprecision(0); }
+  else
+    { out << std::setprecision(1); }
+}
+
+void print_row(std::ostream& out, const row_type& row)
+{
+  out << row.hour << "," << row.min << "," << row.sec;
+  for (auto&& col : row.columns) { out << "," << col; }
+  out << "\n";
+}
+
+int parse_log(std::istream& in, const std::vector<std::string>& processes,
+              int top_column, std::vector<row_type>& rows)
+{
+  snapshot_parser parser(processes, top_column,
+                         [&rows](const row_type& row) { rows.push_back(row); });
+  if (!parser.feed_stream(in)) { return 1; }
+  parser.finish();
+  return 0;
+}
+
+void print_rows(std::ostream& out, const std::vector<std::string>& processes,
+                int top_column, const std::vector<row_type>& rows)
+{
+  print_header(out, processes);
+  set_value_format(out, top_column);
+  for (auto&& row : rows) { print_row(out, row); }
+  out.flush();
+}
+
+int parse_and_print(std::istream& in, std::ostream& out,
+                    const std::vector<std::string>& processes, int top_column)
+{
+  std::vector<row_type> rows;
+  if (parse_log(in, processes, top_column, rows) != 0) { return 1; }
+  print_rows(out, processes, top_column, rows);
+  return 0;
+}
@@ -0,0 +1,191 @@
+#ifndef TOP2CSV_PARSER_HPP
+#define TOP2CSV_PARSER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct row_type
+{
+  int hour;
+  int min;
+  int sec;
+  std::vector<float> columns;
+};
+
+const int VIRT_COL = 4;
+const int CPU_COL = 8;
+
+/**
+ *  @return true if the line starts as the header of a snapshot does,
+ *          'top - HH:MM:SS', in which case its time is set in row.
+ */
+bool parse_snapshot_header(const char* line, std::size_t size, row_type& row);
+
+/**
+ *  Turns the time of day of successive snapshots into seconds since the
+ *  midnight that starts the log.  Top logs only have the time of day, so a
+ *  time going backwards is taken as the start of the next day.
+ */
+class day_clock
+{
+public:
+  day_clock() : day_(0), last_(-1) { }
+
+  std::int64_t operator()(const row_type& row);
+
+private:
+  std::int64_t day_;
+  int last_;
+};
+
+/**
+ *  The column of each process, found from a process name in constant time.
+ *
+ *  The names are interned in the global symbol_table and the column of each
+ *  id is kept in an array, so that looking up the name of every line of a
+ *  snapshot is a lock-free hash lookup and an array access, whatever the
+ *  number of processes.
+ */
+class process_index
+{
+public:
+  explicit process_index(const std::vector<std::string>& processes);
+
+  /**
+   *  @return The column of the process, or -1 if it is not one of the
+   *          processes.  When a name is given several times, the first
+   *          column is returned.
+   */
+  int find(const char* name, std::size_t length) const;
+  int find(const std::string& name) const
+  { return find(name.data(), name.size()); }
+
+  /**
+   *  @return The column of the process with that symbol id, or -1.
+   */
+  int column(std::uint32_t id) const
+  { return id < columns_.size() ? columns_[id] : -1; }
+
+private:
+  std::vector<int> columns_; // indexed by symbol id
+};
+
+/**
+ *  Incremental parser of a top log.
+ *
+ *  Lines are fed one at a time or in blocks, and every snapshot is handed to
+ *  the sink as soon as it is closed, that is when the header of the next
+ *  snapshot is seen or when finish() is called.  Nothing is retained between
+ *  snapshots, so that arbitrarily long logs can be processed in constant
+ *  memory.
+ *
+ *  A block is parsed a snapshot at a time: the boundaries of every field of
+ *  its lines are found in one pass into offset arrays which are reused from
+ *  one snapshot to the next, and the name and the value of each process are
+ *  then read at known indexes, without copying the lines.
+ */
+class snapshot_parser
+{
+public:
+  typedef std::function<void (const row_type&)> sink_type;
+
+  /**
+   *  @param processes A list of process names to be analysed.
+   *  @param top_column The column from the top log to be collected.  Only 4
+   *                    (VIRT) and 8 (%CPU) are supported.
+   *  @param sink Called with each closed snapshot.
+   */
+  snapshot_parser(const std::vector<std::string>& processes, int top_column,
+                  sink_type sink);
+
+  /**
+   *  @param line A line of the log, without its end of line.
+   *  @return false if the log is malformed, true otherwise.
+   */
+  bool feed(const std::string& line);
+
+  /**
+   *  @param data Whole lines of the log, typically one or more snapshots,
+   *              each ending with '\n' but possibly the last.
+   *  @return false if the log is malformed, true otherwise.
+   */
+  bool feed_block(const char* data, std::size_t size);
+
+  /**
+   *  Feeds the lines read from the stream up to its end, in large blocks.
+   *
+   *  @return false if the log is malformed, true otherwise.
+   */
+  bool feed_stream(std::istream& in);
+
+  /**
+   *  Closes the snapshot in progress, if any, and hands it to the sink.
+   */
+  void finish();
+
+private:
+  const char* tokenize(const char* begin, const char* end);
+  void add_lines(const char* base);
+
+  std::vector<std::string> processes_;
+  process_index index_;
+  int top_column_;
+  sink_type sink_;
+  bool open_;
+  row_type row_;
+  // Begin and end of each field of the lines being parsed, from their start.
+  std::vector<std::uint32_t> fields_;
+  // Index in fields_ of the first field of each line, and of the end.
+  std::vector<std::uint32_t> lines_;
+  std::vector<char> buffer_; // of feed_stream
+};
+
+/**
+ *  Prints the CSV header line for the processes.
+ */
+void print_header(std::ostream& out, const std::vector<std::string>& processes);
+
+/**
+ *  Sets up the floating point format used for the values of top_column.
+ */
+void set_value_format(std::ostream& out, int top_column);
+
+/**
+ *  Prints one CSV line for the row.  The format must have been set up with
+ *  set_value_format() beforehand.
+ */
+void print_row(std::ostream& out, const row_type& row);
+
+/**
+ *  Parse a whole top log into rows, one per snapshot.
+ *
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int parse_log(std::istream& in, const std::vector<std::string>& processes,
+              int top_column, std::vector<row_type>& rows);
+
+/**
+ *  Prints the CSV output, header included, for the rows of a top log.
+ */
+void print_rows(std::ostream& out, const std::vector<std::string>& processes,
+                int top_column, const std::vector<row_type>& rows);
+
+/**
+ *  Parse a top log and produces the CSV output.
+ *
+ *  @param in The stream to read the top log from.
+ *  @param out The stream to write the CSV output to.
+ *  @param processes A list of process names to be analysed.
+ *  @param top_column The column from the top log to be collected. Only 4 (VIRT)
+ *                    and 8 (%CPU) are supported.
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int parse_and_print(std::istream& in, std::ostream& out,
+                    const std::vector<std::string>& processes, int top_column);
+
+#endif // TOP2CSV_PARSER_HPP
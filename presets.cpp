@@ -0,0 +1,264 @@
+#include "presets.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "binary.hpp"
+#include "output.hpp"
+#include "symbols.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const char CACHE_MAGIC[8] = {'T', '2', 'C', 'P', 'R', 'E', 'S', '1'};
+
+  std::string trim(const std::string& text)
+  {
+    auto begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) { return std::string(); }
+    auto end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+  }
+}
+
+preset_registry::preset_registry()
+{
+  add("all", {"ascmanager", "BmfCol", "BmfExcReceiver", "BmfExcSender",
+              "CctCtl", "ctlkcmdpro", "daccompms", "daccomrss",
+              "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
+              "dpckvarmgr", "EcsSmc", "EcsSys", "ftsserver", "HdvServer",
+              "historyserver", "inputmgr", "LoginServer", "opmserver",
+              "PasCtl", "PisCtl", "RadCom", "RadCtl", "RadPgr",
+              "ReaPrgServer", "scsalarmserver", "scsctlgrcserver",
+              "SigCtlServer", "SigDpc", "SigLdt", "SigLoc",
+              "taonameserv", "TelSvr", "tmcpex", "tmcsup" });
+  add("ats", {"ascmanager", "BmfCol", "ctlkcmdpro",
+              "daccompms", "daccomrss", "daccontrol", "dbpoller",
+              "dbserver", "dpckeqpmgr", "dpckvarmgr", "ftsserver",
+              "HdvServer", "inputmgr", "ReaPrgServer", "scsalarmserver",
+              "SigCtlServer", "SigDpc", "SigLdt", "SigLoc",
+              "taonameserv", "tmcpex", "tmcsup" });
+  add("cms", {"ascmanager", "BmfCol", "BmfExcReceiver", "BmfExcSender",
+              "CctCtl", "ctlkcmdpro", "daccompms", "daccontrol",
+              "dbpoller", "dbserver", "dpckeqpmgr", "dpckvarmgr",
+              "ftsserver", "HdvServer", "historyserver", "inputmgr",
+              "LoginServer", "opmserver", "PasCtl", "PisCtl", "RadCom",
+              "RadCtl", "ReaPrgServer", "scsalarmserver",
+              "scsctlgrcserver", "taonameserv", "TelSvr"});
+  add("sms", {"ascmanager", "BmfCol",
+              "CctCtl", "ctlkcmdpro", "daccompms", "daccomrss",
+              "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
+              "dpckvarmgr", "EcsSmc", "EcsSys", "ftsserver", "HdvServer",
+              "historyserver", "inputmgr", "LoginServer", "PasCtl",
+              "PisCtl", "RadCom", "RadCtl", "RadPgr", "ReaPrgServer",
+              "scsalarmserver", "scsctlgrcserver", "SigCtlServer",
+              "SigDpc", "SigLdt", "SigLoc", "taonameserv", "TelSvr"});
+  add("dcs", {"ascmanager", "BmfCol",
+              "CctCtl", "ctlkcmdpro", "daccompms", "daccomrss",
+              "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
+              "dpckvarmgr", "EcsSmc", "EcsSys", "ftsserver", "HdvServer",
+              "historyserver", "inputmgr", "LoginServer", "PasCtl",
+              "PisCtl", "RadCom", "RadCtl", "RadPgr", "ReaPrgServer",
+              "scsalarmserver", "scsctlgrcserver", "SigCtlServer",
+              "SigDpc", "SigLdt", "SigLoc", "taonameserv", "TelSvr",
+              "tmcsup"});
+  add("ecs", {"ascmanager", "BmfCol", "daccompms", "daccomrss",
+              "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
+              "dpckvarmgr", "EcsSmc", "EcsSys", "HdvServer", "inputmgr",
+              "ReaPrgServer", "scsalarmserver", "scsctlgrcserver",
+              "taonameserv" });
+}
+
+void preset_registry::add(const std::string& preset,
+                          const std::vector<std::string>& processes)
+{
+  std::vector<std::uint32_t>& ids = presets_[preset];
+  ids.clear();
+  symbol_table& symbols = symbol_table::global();
+  for (auto&& process : processes)
+    {
+      std::uint32_t id = symbols.intern(process);
+      if (std::find(ids.begin(), ids.end(), id) == ids.end())
+        { ids.push_back(id); }
+    }
+}
+
+bool preset_registry::load(const fs::path& file, const fs::path& cache)
+{
+  std::ifstream in(file.string(), std::ios::binary);
+  if (!in)
+    {
+      std::cerr << "Error opening file: " << file.string() << std::endl;
+      return false;
+    }
+  std::string content((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+  std::uint64_t hash = fnv1a(content);
+  compiled_file compiled;
+  if (cache.empty() || !read_cache(cache, hash, compiled))
+    {
+      if (!parse(content, file.string(), compiled)) { return false; }
+      if (!cache.empty() && !write_cache(cache, hash, compiled))
+        {
+          // The cache only saves time; carry on without it.
+          std::cerr << "Warning: could not write " << cache.string()
+                    << std::endl;
+        }
+    }
+  std::vector<std::string> processes;
+  for (auto&& preset : compiled.presets)
+    {
+      processes.clear();
+      for (auto id : preset.second)
+        { processes.push_back(compiled.names[id]); }
+      add(preset.first, processes);
+    }
+  return true;
+}
+
+bool preset_registry::parse(const std::string& content,
+                            const std::string& file, compiled_file& compiled)
+{
+  std::map<std::string, std::uint32_t> ids;
+  std::istringstream in(content);
+  std::string line;
+  std::vector<std::uint32_t>* preset = nullptr;
+  std::string preset_name;
+  auto check_preset = [&]
+    {
+      if (preset && preset->empty())
+        {
+          std::cerr << "Error: " << file << ": preset '" << preset_name
+                    << "' has no processes" << std::endl;
+          return false;
+        }
+      return true;
+    };
+  for (unsigned number = 1; std::getline(in, line); ++number)
+    {
+      line = trim(line);
+      if (line.empty() || line[0] == '#' || line[0] == ';') { continue; }
+      if (line[0] == '[')
+        {
+          if (!check_preset()) { return false; }
+          preset_name = line.back() == ']'
+            ? trim(line.substr(1, line.size() - 2)) : std::string();
+          if (preset_name.empty())
+            {
+              std::cerr << "Error: " << file << ":" << number
+                        << ": invalid section '" << line << "'" << std::endl;
+              return false;
+            }
+          preset = &compiled.presets[preset_name];
+          preset->clear();
+          continue;
+        }
+      if (!preset)
+        {
+          std::cerr << "Error: " << file << ":" << number
+                    << ": processes outside of a [preset] section"
+                    << std::endl;
+          return false;
+        }
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream names(line);
+      std::string name;
+      while (names >> name)
+        {
+          auto found = ids.find(name);
+          if (found == ids.end())
+            {
+              found = ids.emplace(name, static_cast<std::uint32_t>
+                                  (compiled.names.size())).first;
+              compiled.names.push_back(name);
+            }
+          if (std::find(preset->begin(), preset->end(), found->second)
+              == preset->end())
+            { preset->push_back(found->second); }
+        }
+    }
+  return check_preset();
+}
+
+/*
+ *  The cache holds, in native byte order: the magic, the hash of the preset
+ *  file, the process names, then each preset with the numbers of its
+ *  processes.
+ */
+bool preset_registry::read_cache(const fs::path& cache, std::uint64_t hash,
+                                 compiled_file& compiled)
+{
+  std::ifstream in(cache.string(), std::ios::binary);
+  char magic[sizeof(CACHE_MAGIC)];
+  std::uint64_t cached_hash;
+  std::uint32_t count;
+  if (!in.read(magic, sizeof(magic))
+      || std::memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0
+      || !get_binary(in, cached_hash) || cached_hash != hash
+      || !get_binary(in, count))
+    { return false; }
+  compiled.names.resize(count);
+  for (auto&& name : compiled.names)
+    {
+      if (!get_binary(in, name)) { return false; }
+    }
+  if (!get_binary(in, count)) { return false; }
+  for (std::uint32_t i = 0; i < count; ++i)
+    {
+      std::string name;
+      std::uint32_t size;
+      if (!get_binary(in, name) || !get_binary(in, size)
+          || size > compiled.names.size())
+        { return false; }
+      std::vector<std::uint32_t>& ids = compiled.presets[name];
+      ids.resize(size);
+      for (auto&& id : ids)
+        {
+          if (!get_binary(in, id) || id >= compiled.names.size())
+            { return false; }
+        }
+    }
+  return true;
+}
+
+bool preset_registry::write_cache(const fs::path& cache, std::uint64_t hash,
+                                  const compiled_file& compiled)
+{
+  auto write = [&](std::ostream& out)
+    {
+      out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+      put_binary(out, hash);
+      put_binary(out, static_cast<std::uint32_t>(compiled.names.size()));
+      for (auto&& name : compiled.names) { put_binary(out, name); }
+      put_binary(out, static_cast<std::uint32_t>(compiled.presets.size()));
+      for (auto&& preset : compiled.presets)
+        {
+          put_binary(out, preset.first);
+          put_binary(out, static_cast<std::uint32_t>(preset.second.size()));
+          for (auto id : preset.second) { put_binary(out, id); }
+        }
+    };
+  return write_atomically(cache, write, true);
+}
+
+bool preset_registry::find(const std::string& name,
+                           std::vector<std::string>& processes) const
+{
+  auto found = presets_.find(name);
+  if (found == presets_.end()) { return false; }
+  processes.clear();
+  symbol_table& symbols = symbol_table::global();
+  for (auto id : found->second) { processes.push_back(symbols.name(id)); }
+  return true;
+}
+
+std::vector<std::string> preset_registry::names() const
+{
+  std::vector<std::string> names;
+  for (auto&& preset : presets_) { names.push_back(preset.first); }
+  return names;
+}
@@ -0,0 +1,84 @@
+#ifndef TOP2CSV_PRESETS_HPP
+#define TOP2CSV_PRESETS_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+/**
+ *  The named lists of processes that can be given with --preset.
+ *
+ *  The built-in presets can be extended, or replaced one by one, by a preset
+ *  file in INI format: each [section] is a preset and lists its processes,
+ *  separated by spaces or commas, over as many lines as needed.  Lines
+ *  starting with '#' or ';' are comments.  For instance:
+ *
+ *      # Presets of the line 2 servers
+ *      [l2-ats]
+ *      ascmanager, dbserver, SigLoc
+ *      SigLdt
+ *
+ *  Presets refer to their processes by their id in the global symbol_table,
+ *  so every distinct process name is stored once.  The result of reading a
+ *  preset file can be saved to a binary cache, which is used instead of
+ *  parsing the file again as long as the content of the file does not
+ *  change.
+ */
+class preset_registry
+{
+public:
+  /**
+   *  Creates a registry with the built-in presets.
+   */
+  preset_registry();
+
+  /**
+   *  Adds the presets of a preset file, replacing the presets with the same
+   *  names.  Errors are printed on std::cerr.
+   *
+   *  @param cache When not empty, the binary cache of the preset file, read
+   *               if it matches the content of the file, written otherwise.
+   *  @return false if the file could not be read or is malformed.
+   */
+  bool load(const boost::filesystem::path& file,
+            const boost::filesystem::path& cache);
+
+  /**
+   *  @return false if there is no preset with that name.
+   */
+  bool find(const std::string& name, std::vector<std::string>& processes)
+    const;
+
+  /**
+   *  @return The names of the presets, in alphabetical order.
+   */
+  std::vector<std::string> names() const;
+
+private:
+  typedef std::map<std::string, std::vector<std::uint32_t> > preset_map;
+
+  /**
+   *  The presets of a preset file, as read from the file or its cache.
+   */
+  struct compiled_file
+  {
+    std::vector<std::string> names;
+    preset_map presets;
+  };
+
+  static bool parse(const std::string& content, const std::string& file,
+                    compiled_file& compiled);
+  static bool read_cache(const boost::filesystem::path& cache,
+                         std::uint64_t hash, compiled_file& compiled);
+  static bool write_cache(const boost::filesystem::path& cache,
+                          std::uint64_t hash, const compiled_file& compiled);
+
+  void add(const std::string& preset,
+           const std::vector<std::string>& processes);
+
+  preset_map presets_; // of symbol ids
+};
+
+#endif // TOP2CSV_PRESETS_HPP
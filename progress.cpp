@@ -0,0 +1,134 @@
+#include "progress.hpp"
+
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+  bool stderr_is_terminal()
+  {
+#ifdef _WIN32
+    return _isatty(_fileno(stderr)) != 0;
+#else
+    return ::isatty(STDERR_FILENO) != 0;
+#endif
+  }
+
+  std::string format_bytes(double bytes)
+  {
+    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4)
+      {
+        bytes /= 1024;
+        ++unit;
+      }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(unit ? 1 : 0) << bytes << " "
+        << units[unit];
+    return out.str();
+  }
+
+  std::string format_duration(double seconds)
+  {
+    long total = static_cast<long>(seconds + 0.5);
+    std::ostringstream out;
+    out << total / 3600 << ":" << std::setfill('0') << std::setw(2)
+        << total / 60 % 60 << ":" << std::setw(2) << total % 60;
+    return out.str();
+  }
+}
+
+progress_reporter::progress_reporter(std::uint64_t total_bytes,
+                                     std::uint64_t total_files,
+                                     std::ostream& out,
+                                     std::chrono::milliseconds interval)
+  : total_bytes_(total_bytes), total_files_(total_files), out_(out),
+    interval_(interval), terminal_(&out == &std::cerr && stderr_is_terminal()),
+    bytes_(0), files_(0), start_(std::chrono::steady_clock::now()),
+    last_time_(start_), last_bytes_(0), rate_(0), stopping_(false)
+{
+  thread_ = std::thread(&progress_reporter::run, this);
+}
+
+progress_reporter::~progress_reporter()
+{
+  stop();
+}
+
+void progress_reporter::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) { return; }
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  thread_.join();
+  report(true);
+}
+
+void progress_reporter::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!wake_.wait_for(lock, interval_, [this] { return stopping_; }))
+    {
+      lock.unlock();
+      report(false);
+      lock.lock();
+    }
+}
+
+void progress_reporter::report(bool last)
+{
+  auto now = std::chrono::steady_clock::now();
+  std::uint64_t bytes = bytes_.load(std::memory_order_relaxed);
+  std::uint64_t files = files_.load(std::memory_order_relaxed);
+  std::chrono::duration<double> since_last = now - last_time_;
+  std::chrono::duration<double> elapsed = now - start_;
+  if (since_last.count() > 0)
+    {
+      double rate = (bytes - last_bytes_) / since_last.count();
+      // Smoothed, so that the ETA does not jump with every file.
+      rate_ = rate_ == 0 ? rate : 0.7 * rate_ + 0.3 * rate;
+    }
+  last_time_ = now;
+  last_bytes_ = bytes;
+
+  std::ostringstream line;
+  line << "Progress: " << format_bytes(bytes) << " of "
+       << format_bytes(total_bytes_);
+  if (total_bytes_ > 0)
+    {
+      line << " (" << std::fixed << std::setprecision(1)
+           << 100. * bytes / total_bytes_ << "%)";
+    }
+  line << ", " << files;
+  if (total_files_ > 0) { line << " of " << total_files_; }
+  line << " files, ";
+  if (last)
+    {
+      line << format_bytes(elapsed.count() > 0 ? bytes / elapsed.count() : 0)
+           << "/s, done in " << format_duration(elapsed.count());
+    }
+  else
+    {
+      line << format_bytes(rate_) << "/s, ETA ";
+      if (rate_ > 0 && total_bytes_ >= bytes)
+        { line << format_duration((total_bytes_ - bytes) / rate_); }
+      else
+        { line << "unknown"; }
+    }
+  if (terminal_)
+    { out_ << "\r" << line.str() << "\033[K" << (last ? "\n" : ""); }
+  else
+    { out_ << line.str() << "\n"; }
+  out_.flush();
+}
@@ -0,0 +1,76 @@
+#ifndef TOP2CSV_PROGRESS_HPP
+#define TOP2CSV_PROGRESS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+/**
+ *  Reports the progress of a long run on a stream, from a thread of its own.
+ *
+ *  Workers only update two counters, with relaxed atomic additions: they
+ *  never wait for the reporter nor write anything.  Every interval, the
+ *  reporter reads the counters and prints the bytes and files processed so
+ *  far out of the totals, the current throughput and the estimated time
+ *  left.  On a terminal the report is rewritten in place.
+ */
+class progress_reporter
+{
+public:
+  /**
+   *  @param total_files 0 when the number of files is not known beforehand.
+   */
+  progress_reporter(std::uint64_t total_bytes, std::uint64_t total_files,
+                    std::ostream& out,
+                    std::chrono::milliseconds interval
+                    = std::chrono::milliseconds(1000));
+
+  /**
+   *  Stops the reporter if it is still running.
+   */
+  ~progress_reporter();
+
+  progress_reporter(const progress_reporter&) = delete;
+  progress_reporter& operator=(const progress_reporter&) = delete;
+
+  /**
+   *  The counter of bytes processed, for the workers to add to.
+   */
+  std::atomic<std::uint64_t>& bytes() { return bytes_; }
+
+  void file_done() { files_.fetch_add(1, std::memory_order_relaxed); }
+
+  /**
+   *  Stops the reporter and prints the final report.
+   */
+  void stop();
+
+private:
+  void run();
+  void report(bool last);
+
+  std::uint64_t total_bytes_;
+  std::uint64_t total_files_;
+  std::ostream& out_;
+  std::chrono::milliseconds interval_;
+  bool terminal_;
+  std::atomic<std::uint64_t> bytes_;
+  std::atomic<std::uint64_t> files_;
+
+  // Only used by the reporter thread.
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point last_time_;
+  std::uint64_t last_bytes_;
+  double rate_; // bytes per second, smoothed
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_;
+  std::thread thread_;
+};
+
+#endif // TOP2CSV_PROGRESS_HPP
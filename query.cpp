@@ -0,0 +1,245 @@
+#include "query.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <regex>
+#include <thread>
+#include "gzindex.hpp"
+#include "parser.hpp"
+#include "tsstore.hpp"
+
+namespace fs = boost::filesystem;
+
+bool parse_time_spec(const std::string& text, time_spec& spec)
+{
+  static const std::regex
+    pattern{"(?:([0-9]+)\\+)?([0-9]{1,2}):([0-5][0-9])(?::([0-5][0-9]))?"};
+  std::smatch subs;
+  if (!std::regex_match(text, subs, pattern)) { return false; }
+  int hour = std::stoi(subs[2]);
+  if (hour > 23) { return false; }
+  spec.day = subs[1].matched ? std::stoi(subs[1]) : -1;
+  spec.seconds = (hour * 60 + std::stoi(subs[3])) * 60
+    + (subs[4].matched ? std::stoi(subs[4]) : 0);
+  return true;
+}
+
+namespace
+{
+  /**
+   *  @return The first time at or after not_before that matches spec.
+   */
+  std::int64_t resolve(const time_spec& spec, std::int64_t not_before)
+  {
+    if (spec.day >= 0) { return spec.day * 86400 + spec.seconds; }
+    std::int64_t time = not_before / 86400 * 86400 + spec.seconds;
+    return time < not_before ? time + 86400 : time;
+  }
+}
+
+namespace
+{
+  /**
+   *  Resolves the times of the query, for a log starting at origin.
+   */
+  void select(const time_query& query, std::int64_t origin,
+              std::int64_t& from, std::int64_t& to)
+  {
+    from = query.has_from ? resolve(query.from, origin)
+      : std::numeric_limits<std::int64_t>::min();
+    to = query.has_to ? resolve(query.to, query.has_from ? from : origin)
+      : std::numeric_limits<std::int64_t>::max();
+  }
+
+  void print_selection(const ts_store& store, std::int64_t from,
+                       std::int64_t to, std::ostream& out,
+                       const std::vector<std::string>& processes,
+                       int top_column, const time_query& query)
+  {
+    print_header(out, processes);
+    set_value_format(out, top_column);
+    row_type row{0, 0, 0, std::vector<float>(processes.size())};
+    auto print = [&](std::int64_t time)
+      {
+        std::int64_t seconds = time % 86400;
+        row.hour = static_cast<int>(seconds / 3600);
+        row.min = static_cast<int>(seconds / 60 % 60);
+        row.sec = static_cast<int>(seconds % 60);
+        print_row(out, row);
+      };
+    if (query.step > 0)
+      {
+        store.resample(from, to, query.step,
+                       [&](std::int64_t time, const std::vector<float>& means)
+                       {
+                         row.columns = means;
+                         print(time);
+                       });
+      }
+    else
+      {
+        store.scan(from, to, [&](const decoded_block& block)
+                   {
+                     for (std::size_t i = 0; i < block.times.size(); ++i)
+                       {
+                         for (std::size_t c = 0; c < row.columns.size(); ++c)
+                           { row.columns[c] = block.columns[c][i]; }
+                         print(block.times[i]);
+                       }
+                   });
+      }
+    out.flush();
+  }
+
+  /**
+   *  The snapshots of a part of a compressed log, timed.
+   */
+  struct gzip_part
+  {
+    std::size_t checkpoint;
+    std::uint64_t end;
+    std::vector<std::int64_t> times;
+    std::vector<row_type> rows;
+    bool ok;
+  };
+
+  void parse_part(const fs::path& gz, const gz_index& index,
+                  const std::vector<std::string>& processes, int top_column,
+                  const read_options& reading, gzip_part& part)
+  {
+    // The part starts with a snapshot, on the day of its checkpoint.
+    std::int64_t day = index.checkpoints()[part.checkpoint].time / 86400
+      * 86400;
+    day_clock clock;
+    snapshot_parser parser(processes, top_column,
+                           [&](const row_type& row)
+                           {
+                             part.times.push_back(day + clock(row));
+                             part.rows.push_back(row);
+                           });
+    // The start of a line, decompressed with the last piece.
+    std::string partial;
+    bool parsed = true;
+    part.ok = index.extract(gz, part.checkpoint, part.end,
+                            [&](const char* data, std::size_t size)
+                            {
+                              if (!parsed) { return; }
+                              const char* end = data + size;
+                              const char* lines = end;
+                              while (lines > data && lines[-1] != '\n')
+                                { --lines; }
+                              if (lines == data)
+                                {
+                                  partial.append(data, end);
+                                  return;
+                                }
+                              if (!partial.empty())
+                                {
+                                  partial.append(data, lines);
+                                  parsed = parser.feed_block(partial.data(),
+                                                             partial.size());
+                                }
+                              else
+                                {
+                                  parsed = parser.feed_block(data,
+                                                             lines - data);
+                                }
+                              partial.assign(lines, end);
+                            }, reading);
+    if (parsed && !partial.empty())
+      { parsed = parser.feed_block(partial.data(), partial.size()); }
+    parser.finish();
+    part.ok = part.ok && parsed;
+  }
+}
+
+int query_and_print(std::istream& in, std::ostream& out,
+                    const std::vector<std::string>& processes, int top_column,
+                    const time_query& query)
+{
+  ts_store store(processes.size());
+  day_clock clock;
+  std::int64_t start = -1;
+  snapshot_parser parser(processes, top_column,
+                         [&](const row_type& row)
+                         {
+                           std::int64_t time = clock(row);
+                           if (start < 0) { start = time; }
+                           store.append(time, row.columns);
+                         });
+  if (!parser.feed_stream(in)) { return 1; }
+  parser.finish();
+
+  std::int64_t from, to;
+  select(query, std::max<std::int64_t>(start, 0), from, to);
+  print_selection(store, from, to, out, processes, top_column, query);
+  return 0;
+}
+
+int query_gzip_and_print(const fs::path& gz, const gz_index& index,
+                         std::ostream& out,
+                         const std::vector<std::string>& processes,
+                         int top_column, const time_query& query,
+                         unsigned threads, const read_options& reading)
+{
+  std::int64_t from, to;
+  select(query, std::max<std::int64_t>(index.origin(), 0), from, to);
+
+  // The snapshots from `from` to `to` are between the first snapshot after
+  // the last checkpoint before from and the first snapshot after the first
+  // checkpoint after to.
+  const std::vector<gz_checkpoint>& points = index.checkpoints();
+  std::size_t first = 0, last = points.size();
+  for (std::size_t i = 1; i < points.size() && points[i].time < from; ++i)
+    { first = i; }
+  for (std::size_t i = first + 1; i < points.size(); ++i)
+    {
+      if (points[i].time > to)
+        {
+          last = i;
+          break;
+        }
+    }
+
+  std::vector<gzip_part> parts;
+  if (first < last)
+    {
+      std::size_t count = std::min<std::size_t>(std::max(threads, 1u),
+                                                last - first);
+      for (std::size_t p = 0; p < count; ++p)
+        {
+          std::size_t begin = first + (last - first) * p / count;
+          std::size_t end = first + (last - first) * (p + 1) / count;
+          parts.push_back(gzip_part{begin, end < points.size()
+                                    ? points[end].header
+                                    : std::numeric_limits<std::uint64_t>::max(),
+                                    {}, {}, false});
+        }
+    }
+  std::vector<std::thread> workers;
+  for (std::size_t p = 1; p < parts.size(); ++p)
+    {
+      workers.emplace_back(parse_part, std::cref(gz), std::cref(index),
+                           std::cref(processes), top_column,
+                           std::cref(reading), std::ref(parts[p]));
+    }
+  if (!parts.empty())
+    { parse_part(gz, index, processes, top_column, reading, parts[0]); }
+  for (auto&& worker : workers) { worker.join(); }
+
+  ts_store store(processes.size());
+  for (auto&& part : parts)
+    {
+      if (!part.ok)
+        {
+          std::cerr << "Error reading file: " << gz.string() << std::endl;
+          return 1;
+        }
+      for (std::size_t i = 0; i < part.rows.size(); ++i)
+        { store.append(part.times[i], part.rows[i].columns); }
+    }
+  print_selection(store, from, to, out, processes, top_column, query);
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef TOP2CSV_QUERY_HPP
+#define TOP2CSV_QUERY_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+class gz_index;
+struct read_options;
+
+/**
+ *  A point in time of a top log given as [<day>+]HH:MM[:SS].  Without a day,
+ *  it is the first time that time of day occurs in the log; days are counted
+ *  from 0, the day the log starts.
+ */
+struct time_spec
+{
+  int day; // -1 when not given
+  std::int64_t seconds;
+};
+
+/**
+ *  @return false if text is not a valid time specification.
+ */
+bool parse_time_spec(const std::string& text, time_spec& spec);
+
+/**
+ *  A selection of snapshots of a top log, possibly resampled.
+ */
+struct time_query
+{
+  bool has_from;
+  time_spec from;
+  bool has_to;
+  time_spec to;
+  std::int64_t step; // seconds per resampled row, 0 for no resampling
+};
+
+/**
+ *  Parse a top log into a compressed store, then produces the CSV output of
+ *  the snapshots selected by the query.  Resampled rows are the averages of
+ *  the snapshots in each period, and are timed at the start of their period.
+ *
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int query_and_print(std::istream& in, std::ostream& out,
+                    const std::vector<std::string>& processes, int top_column,
+                    const time_query& query);
+
+/**
+ *  As query_and_print, for a top log compressed with gzip, with its index:
+ *  only the parts of the log between the checkpoints around the selected
+ *  snapshots are decompressed, and they are split between threads which
+ *  decompress and parse them at once.
+ *
+ *  @param reading How the gzip file is read, including the limits of
+ *                 --max-cpu and --max-io, which the threads are charged to.
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int query_gzip_and_print(const boost::filesystem::path& gz,
+                         const gz_index& index, std::ostream& out,
+                         const std::vector<std::string>& processes,
+                         int top_column, const time_query& query,
+                         unsigned threads, const read_options& reading);
+
+#endif // TOP2CSV_QUERY_HPP
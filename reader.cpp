@@ -0,0 +1,379 @@
+#include "reader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef TOP2CSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "throttle.hpp"
+
+namespace
+{
+#ifdef _WIN32
+  int open_read(const char* path, bool)
+  { return _open(path, _O_RDONLY | _O_BINARY); }
+  long read_some(int fd, char* buf, std::size_t len)
+  { return _read(fd, buf, static_cast<unsigned>(len)); }
+  bool seek_fd(int fd, std::uint64_t offset)
+  { return _lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) >= 0; }
+  void close_fd(int fd) { _close(fd); }
+#else
+  int open_read(const char* path, bool direct)
+  {
+    int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+    if (direct) { flags |= O_DIRECT; }
+#else
+    (void) direct;
+#endif
+    return ::open(path, flags);
+  }
+  long read_some(int fd, char* buf, std::size_t len)
+  { return ::read(fd, buf, len); }
+  bool seek_fd(int fd, std::uint64_t offset)
+  { return ::lseek(fd, static_cast<off_t>(offset), SEEK_SET) >= 0; }
+  void close_fd(int fd) { ::close(fd); }
+#endif
+
+#ifdef POSIX_FADV_WILLNEED
+  // How much of a file prefetch_file asks for.
+  const off_t PREFETCH_BYTES = 4 << 20;
+#endif
+
+  // Alignment of the buffers, offsets and sizes of direct reads.
+  const std::size_t DIRECT_ALIGNMENT = 4096;
+
+  char* aligned_alloc_block(std::size_t size)
+  {
+#ifdef _WIN32
+    return static_cast<char*>(_aligned_malloc(size, DIRECT_ALIGNMENT));
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, DIRECT_ALIGNMENT, size) != 0) { return nullptr; }
+    return static_cast<char*>(p);
+#endif
+  }
+}
+
+void file_reader::aligned_deleter::operator()(char* p) const
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+file_reader::file_reader(const read_options& options)
+  : options_(options), fd_(-1), uncached_(false), failed_(false), offset_(0),
+    lengths_{0, 0}, ready_{false, false}, current_(-1), done_(false),
+    stopping_(false)
+{
+  if (options_.direct)
+    {
+      options_.buffer_size = std::max(DIRECT_ALIGNMENT,
+                                      (options_.buffer_size
+                                       + DIRECT_ALIGNMENT - 1)
+                                      / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT);
+      for (auto&& block : blocks_)
+        { block.reset(aligned_alloc_block(options_.buffer_size)); }
+    }
+  else
+    { buffer_.resize(options_.buffer_size); }
+}
+
+file_reader::~file_reader()
+{
+  close();
+}
+
+bool file_reader::open(const boost::filesystem::path& path)
+{
+  close();
+  failed_ = false;
+  offset_ = 0;
+  if (options_.direct && (!blocks_[0] || !blocks_[1])) { return false; }
+  fd_ = open_read(path.string().c_str(), options_.direct);
+  uncached_ = false;
+  if (fd_ < 0 && options_.direct && errno == EINVAL)
+    {
+      // The file system does not support O_DIRECT.
+      fd_ = open_read(path.string().c_str(), false);
+      uncached_ = true;
+    }
+  if (fd_ < 0) { return false; }
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (!options_.direct) { posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL); }
+#endif
+  setg(nullptr, nullptr, nullptr);
+  if (options_.direct)
+    {
+      ready_[0] = ready_[1] = false;
+      current_ = -1;
+      done_ = stopping_ = false;
+      filler_ = std::thread(&file_reader::fill_loop, this);
+    }
+  return true;
+}
+
+void file_reader::close()
+{
+  if (filler_.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      wake_.notify_all();
+      filler_.join();
+    }
+  if (fd_ >= 0)
+    {
+      close_fd(fd_);
+      fd_ = -1;
+    }
+  setg(nullptr, nullptr, nullptr);
+}
+
+bool file_reader::seek(std::uint64_t offset)
+{
+  if (fd_ < 0 || options_.direct || !seek_fd(fd_, offset)) { return false; }
+  offset_ = offset;
+  setg(nullptr, nullptr, nullptr);
+  return true;
+}
+
+bool file_reader::read_block(char* block, std::size_t& len)
+{
+  len = 0;
+  while (len < options_.buffer_size)
+    {
+      long n = read_some(fd_, block + len, options_.buffer_size - len);
+      if (n < 0 && errno == EINTR) { continue; }
+#ifdef O_DIRECT
+      if (n < 0 && errno == EINVAL && !uncached_)
+        {
+          // The file system accepted O_DIRECT but cannot honor it.
+          ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) & ~O_DIRECT);
+          uncached_ = true;
+          continue;
+        }
+#endif
+      if (n < 0)
+        {
+          failed_ = true;
+          return false;
+        }
+      if (n == 0) { break; }
+      len += n;
+    }
+#ifdef POSIX_FADV_DONTNEED
+  if (uncached_ && len > 0)
+    { posix_fadvise(fd_, offset_, len, POSIX_FADV_DONTNEED); }
+#endif
+  offset_ += len;
+  return len == options_.buffer_size;
+}
+
+void file_reader::fill_loop()
+{
+  for (int i = 0; ; i ^= 1)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this, i] { return stopping_ || !ready_[i]; });
+        if (stopping_) { return; }
+      }
+      std::size_t len = 0;
+      bool more = read_block(blocks_[i].get(), len);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lengths_[i] = len;
+        ready_[i] = true;
+        done_ = !more;
+      }
+      wake_.notify_all();
+      if (!more) { return; }
+    }
+}
+
+file_reader::int_type file_reader::underflow()
+{
+  if (gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+  if (fd_ < 0) { return traits_type::eof(); }
+  if (!options_.direct)
+    {
+      long len;
+      do { len = read_some(fd_, buffer_.data(), buffer_.size()); }
+      while (len < 0 && errno == EINTR);
+      if (len < 0) { failed_ = true; }
+      if (len <= 0) { return traits_type::eof(); }
+      if (options_.bytes_read)
+        { options_.bytes_read->fetch_add(len, std::memory_order_relaxed); }
+      if (options_.limits) { options_.limits->consumed(len); }
+      setg(buffer_.data(), buffer_.data(), buffer_.data() + len);
+      return traits_type::to_int_type(*gptr());
+    }
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (current_ >= 0)
+    {
+      // Hands the consumed block back to the filler thread.
+      ready_[current_] = false;
+      wake_.notify_all();
+      current_ ^= 1;
+    }
+  else
+    { current_ = 0; }
+  wake_.wait(lock, [this] { return ready_[current_] || done_; });
+  if (!ready_[current_] || lengths_[current_] == 0)
+    {
+      setg(nullptr, nullptr, nullptr);
+      return traits_type::eof();
+    }
+  char* block = blocks_[current_].get();
+  std::size_t len = lengths_[current_];
+  setg(block, block, block + len);
+  if (options_.bytes_read)
+    { options_.bytes_read->fetch_add(len, std::memory_order_relaxed); }
+  if (options_.limits)
+    {
+      // The filler thread must be able to hand over the next block meanwhile.
+      lock.unlock();
+      options_.limits->consumed(len);
+    }
+  return traits_type::to_int_type(*gptr());
+}
+
+throttled_reader::throttled_reader(std::streambuf& source,
+                                   resource_limits* limits,
+                                   std::size_t buffer_size)
+  : source_(source), limits_(limits), buffer_(buffer_size)
+{ }
+
+throttled_reader::int_type throttled_reader::underflow()
+{
+  if (gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+  std::streamsize len = source_.sgetn(buffer_.data(), buffer_.size());
+  if (len <= 0) { return traits_type::eof(); }
+  if (limits_) { limits_->consumed(static_cast<std::size_t>(len)); }
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + len);
+  return traits_type::to_int_type(*gptr());
+}
+
+#ifdef TOP2CSV_HAVE_ZLIB
+struct gzip_reader::state
+{
+  z_stream stream;
+};
+#else
+struct gzip_reader::state
+{ };
+#endif
+
+gzip_reader::gzip_reader()
+  : source_(nullptr), failed_(false), done_(true), in_(1 << 16),
+    out_(1 << 18)
+{ }
+
+gzip_reader::~gzip_reader()
+{
+#ifdef TOP2CSV_HAVE_ZLIB
+  if (state_) { inflateEnd(&state_->stream); }
+#endif
+}
+
+bool gzip_reader::open(std::streambuf& source)
+{
+#ifdef TOP2CSV_HAVE_ZLIB
+  if (!state_)
+    {
+      state_.reset(new state());
+      // 16 + MAX_WBITS only accepts the gzip format.
+      if (inflateInit2(&state_->stream, 16 + MAX_WBITS) != Z_OK)
+        {
+          state_.reset();
+          return false;
+        }
+    }
+  else
+    { inflateReset(&state_->stream); }
+  state_->stream.avail_in = 0;
+  source_ = &source;
+  failed_ = false;
+  done_ = false;
+  setg(nullptr, nullptr, nullptr);
+  return true;
+#else
+  (void) source;
+  return false;
+#endif
+}
+
+gzip_reader::int_type gzip_reader::underflow()
+{
+  if (gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+#ifdef TOP2CSV_HAVE_ZLIB
+  z_stream& stream = state_->stream;
+  while (!done_)
+    {
+      if (stream.avail_in == 0)
+        {
+          std::streamsize n = source_->sgetn(in_.data(), in_.size());
+          if (n <= 0)
+            {
+              // The end of the source in the middle of a member.
+              failed_ = true;
+              done_ = true;
+              break;
+            }
+          stream.next_in = reinterpret_cast<Bytef*>(in_.data());
+          stream.avail_in = static_cast<uInt>(n);
+        }
+      stream.next_out = reinterpret_cast<Bytef*>(out_.data());
+      stream.avail_out = static_cast<uInt>(out_.size());
+      int status = inflate(&stream, Z_NO_FLUSH);
+      std::size_t len = out_.size() - stream.avail_out;
+      if (status == Z_STREAM_END)
+        {
+          // Another member may follow.
+          if (stream.avail_in == 0
+              && traits_type::eq_int_type(source_->sgetc(),
+                                          traits_type::eof()))
+            { done_ = true; }
+          else
+            { inflateReset(&stream); }
+        }
+      else if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+          failed_ = true;
+          done_ = true;
+        }
+      if (len > 0)
+        {
+          setg(out_.data(), out_.data(), out_.data() + len);
+          return traits_type::to_int_type(*gptr());
+        }
+    }
+#endif
+  return traits_type::eof();
+}
+
+void prefetch_file(const boost::filesystem::path& path)
+{
+#ifdef POSIX_FADV_WILLNEED
+  int fd = open_read(path.string().c_str(), false);
+  if (fd < 0) { return; }
+  posix_fadvise(fd, 0, PREFETCH_BYTES, POSIX_FADV_WILLNEED);
+  close_fd(fd);
+#else
+  (void) path;
+#endif
+}
@@ -0,0 +1,171 @@
+#ifndef TOP2CSV_READER_HPP
+#define TOP2CSV_READER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+class resource_limits;
+
+struct read_options
+{
+  std::size_t buffer_size; // bytes read at once
+  bool direct;             // bypass the page cache
+  // when not null, the bytes read are added to it
+  std::atomic<std::uint64_t>* bytes_read = nullptr;
+  // when not null, told about every buffer read, and may pause the reader
+  resource_limits* limits = nullptr;
+};
+
+/**
+ *  An input stream buffer reading a file sequentially, with large reads.
+ *
+ *  The kernel is told the file is read sequentially, so it can use a larger
+ *  readahead window than with std::ifstream.
+ *
+ *  In direct mode, the file is read with O_DIRECT into two aligned buffers:
+ *  a background thread fills one while the other is consumed, so that the
+ *  parser does not wait on the disk.  Scanning a large archive then does not
+ *  evict everything else from the page cache.  When the file system does not
+ *  support O_DIRECT, the pages are dropped from the cache right after they
+ *  are read instead.
+ */
+class file_reader : public std::streambuf
+{
+public:
+  explicit file_reader(const read_options& options = read_options{1 << 20,
+                                                                  false});
+  ~file_reader();
+
+  file_reader(const file_reader&) = delete;
+  file_reader& operator=(const file_reader&) = delete;
+
+  /**
+   *  @return false if the file could not be opened.
+   */
+  bool open(const boost::filesystem::path& path);
+  void close();
+
+  /**
+   *  Moves to an offset of the file, to read from there.  Only in buffered
+   *  mode.
+   *
+   *  @return false if the offset could not be reached.
+   */
+  bool seek(std::uint64_t offset);
+  bool is_open() const { return fd_ >= 0; }
+
+  /**
+   *  @return true if a read failed; the content seen so far is truncated.
+   */
+  bool failed() const { return failed_; }
+
+protected:
+  int_type underflow() override;
+
+private:
+  struct aligned_deleter
+  {
+    void operator()(char* p) const;
+  };
+
+  bool read_block(char* block, std::size_t& len);
+  void fill_loop();
+
+  read_options options_;
+  int fd_;
+  bool uncached_;
+  std::atomic<bool> failed_;
+  std::uint64_t offset_;
+  std::vector<char> buffer_;
+
+  // Direct mode only; the filler thread owns the blocks that are not ready.
+  std::unique_ptr<char, aligned_deleter> blocks_[2];
+  std::size_t lengths_[2];
+  bool ready_[2];
+  int current_;
+  bool done_;
+  bool stopping_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread filler_;
+};
+
+/**
+ *  An input stream buffer reading another stream buffer, such as the one of
+ *  std::cin, in blocks, and telling the limits of --max-cpu and --max-io
+ *  about every block, so that inputs which are not files are paced as
+ *  file_reader paces files.
+ */
+class throttled_reader : public std::streambuf
+{
+public:
+  /**
+   *  @param limits When not null, told about every block read, and may pause
+   *                the reader.
+   */
+  throttled_reader(std::streambuf& source, resource_limits* limits,
+                   std::size_t buffer_size = 1 << 16);
+
+protected:
+  int_type underflow() override;
+
+private:
+  std::streambuf& source_;
+  resource_limits* limits_;
+  std::vector<char> buffer_;
+};
+
+/**
+ *  An input stream buffer decompressing gzip data read from another stream
+ *  buffer, as it is read.  Several gzip members one after the other are
+ *  decompressed as one.  Only works in builds with zlib.
+ */
+class gzip_reader : public std::streambuf
+{
+public:
+  gzip_reader();
+  ~gzip_reader();
+
+  gzip_reader(const gzip_reader&) = delete;
+  gzip_reader& operator=(const gzip_reader&) = delete;
+
+  /**
+   *  @return false if this build cannot decompress.
+   */
+  bool open(std::streambuf& source);
+
+  /**
+   *  @return true if the data is not valid gzip, or is truncated.
+   */
+  bool failed() const { return failed_; }
+
+protected:
+  int_type underflow() override;
+
+private:
+  struct state;
+
+  std::unique_ptr<state> state_;
+  std::streambuf* source_;
+  bool failed_;
+  bool done_;
+  std::vector<char> in_;
+  std::vector<char> out_;
+};
+
+/**
+ *  Asks the kernel to start reading the beginning of a file in the
+ *  background, because it will be read soon.  Does nothing on systems that do
+ *  not support it.
+ */
+void prefetch_file(const boost::filesystem::path& path);
+
+#endif // TOP2CSV_READER_HPP
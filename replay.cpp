@@ -0,0 +1,55 @@
+#include "replay.hpp"
+
+snapshot_source::snapshot_source(std::istream& in)
+  : in_(in), pending_(false)
+{ }
+
+bool snapshot_source::next(std::string& text, std::int64_t& time)
+{
+  text.clear();
+  time = -1;
+  row_type row;
+  if (pending_)
+    {
+      pending_ = false;
+      parse_snapshot_header(line_.data(), line_.size(), row);
+      time = clock_(row);
+      text = line_ + '\n';
+    }
+  while (std::getline(in_, line_))
+    {
+      if (parse_snapshot_header(line_.data(), line_.size(), row))
+        {
+          if (time >= 0)
+            {
+              pending_ = true;
+              return true;
+            }
+          time = clock_(row);
+        }
+      text += line_;
+      text += '\n';
+    }
+  return !text.empty();
+}
+
+replay_schedule::replay_schedule(double speed, double rate)
+  : speed_(speed), rate_(rate), start_(clock_type::now()), first_(-1),
+    count_(0)
+{ }
+
+replay_schedule::clock_type::time_point
+replay_schedule::due(std::int64_t time)
+{
+  std::chrono::duration<double> offset(0);
+  if (rate_ > 0)
+    { offset = std::chrono::duration<double>(count_ / rate_); }
+  else if (speed_ > 0 && time >= 0)
+    {
+      if (first_ < 0) { first_ = time; }
+      offset = std::chrono::duration<double>((time - first_) / speed_);
+    }
+  ++count_;
+  return start_
+    + std::chrono::duration_cast<clock_type::duration>(offset);
+}
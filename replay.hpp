@@ -0,0 +1,67 @@
+#ifndef TOP2CSV_REPLAY_HPP
+#define TOP2CSV_REPLAY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include "parser.hpp"
+
+/**
+ *  Reads a top log one snapshot at a time, as the text top wrote for it,
+ *  with its time.  Used to write a log again at the pace it was recorded at.
+ */
+class snapshot_source
+{
+public:
+  explicit snapshot_source(std::istream& in);
+
+  /**
+   *  Reads the next snapshot: its header and the lines up to the next
+   *  header, each with its end of line.  Lines before the first header are
+   *  part of the first snapshot.
+   *
+   *  @param time Set to the time of the snapshot, as with a day_clock, or -1
+   *              if the log has no header.
+   *  @return false at the end of the log.
+   */
+  bool next(std::string& text, std::int64_t& time);
+
+private:
+  std::istream& in_;
+  day_clock clock_;
+  std::string line_;
+  bool pending_; // line_ is a header read with the previous snapshot
+};
+
+/**
+ *  When each snapshot of a log is due, relative to the start of the replay:
+ *  at the time it was recorded at, divided by a speed factor, or at a fixed
+ *  rate whatever its time.
+ */
+class replay_schedule
+{
+public:
+  typedef std::chrono::steady_clock clock_type;
+
+  /**
+   *  @param speed How many times faster than recorded; 0 for no wait.
+   *  @param rate Snapshots per second instead, if not 0.
+   */
+  replay_schedule(double speed, double rate);
+
+  /**
+   *  @param time The time of the snapshot, as given by snapshot_source.
+   *  @return When the next snapshot is due.
+   */
+  clock_type::time_point due(std::int64_t time);
+
+private:
+  double speed_;
+  double rate_;
+  clock_type::time_point start_;
+  std::int64_t first_;
+  std::uint64_t count_;
+};
+
+#endif // TOP2CSV_REPLAY_HPP
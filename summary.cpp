@@ -0,0 +1,251 @@
+#include "summary.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <sstream>
+#include "kernels.hpp"
+#include "symbols.hpp"
+
+namespace fs = boost::filesystem;
+
+moments::moments()
+  : count(0), mean(0), m2(0),
+    min(std::numeric_limits<double>::infinity()),
+    max(-std::numeric_limits<double>::infinity())
+{ }
+
+void moments::add(double value)
+{
+  ++count;
+  double delta = value - mean;
+  mean += delta / count;
+  m2 += delta * (value - mean);
+  min = std::min(min, value);
+  max = std::max(max, value);
+}
+
+void moments::merge(const moments& other)
+{
+  if (other.count == 0) { return; }
+  if (count == 0) { *this = other; return; }
+  double n = static_cast<double>(count) + other.count;
+  double delta = other.mean - mean;
+  mean += delta * other.count / n;
+  m2 += other.m2 + delta * delta * count * other.count / n;
+  count += other.count;
+  min = std::min(min, other.min);
+  max = std::max(max, other.max);
+}
+
+moments moments::of(const float* values, std::size_t count)
+{
+  moments m;
+  if (count == 0) { return m; }
+  float min, max;
+  column_min_max(values, count, min, max);
+  m.count = count;
+  m.mean = column_mean(values, count);
+  m.m2 = column_m2(values, count, m.mean);
+  m.min = min;
+  m.max = max;
+  return m;
+}
+
+double moments::stddev() const
+{
+  return count > 1 ? std::sqrt(m2 / (count - 1)) : 0.;
+}
+
+summary::summary()
+  : files_(0)
+{ }
+
+void summary::add(const std::vector<std::string>& processes,
+                  const std::vector<row_type>& rows)
+{
+  // Each column is gathered into a contiguous array, which the kernels
+  // reduce with the widest instructions the processor has.
+  std::vector<moments> file(processes.size());
+  std::vector<float> column(rows.size());
+  for (std::size_t i = 0; i < processes.size(); ++i)
+    {
+      std::size_t count = 0;
+      for (auto&& row : rows)
+        {
+          if (i < row.columns.size()) { column[count++] = row.columns[i]; }
+        }
+      file[i] = moments::of(column.data(), count);
+    }
+  symbol_table& symbols = symbol_table::global();
+  std::vector<std::uint32_t> ids;
+  for (auto&& name : processes) { ids.push_back(symbols.intern(name)); }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++files_;
+  for (std::size_t i = 0; i < ids.size(); ++i)
+    { process(ids[i]).merge(file[i]); }
+}
+
+moments& summary::process(std::uint32_t id)
+{
+  auto inserted = processes_.insert(std::make_pair(id, moments()));
+  if (inserted.second) { ids_.push_back(id); }
+  return inserted.first->second;
+}
+
+bool summary::merge(const summary& other)
+{
+  if (!column_.empty() && !other.column_.empty() && column_ != other.column_)
+    { return false; }
+  if (column_.empty()) { column_ = other.column_; }
+  shards_.insert(shards_.end(), other.shards_.begin(), other.shards_.end());
+  files_ += other.files_;
+  for (auto id : other.ids_) { process(id).merge(other.processes_.at(id)); }
+  return true;
+}
+
+bool summary::check_shards() const
+{
+  if (shards_.empty()) { return true; }
+  bool ok = true;
+  std::set<unsigned> seen;
+  unsigned count = 0;
+  for (auto&& shard : shards_)
+    {
+      unsigned i = 0, n = 0;
+      char slash = 0;
+      std::istringstream in(shard);
+      in >> i >> slash >> n;
+      if (count == 0) { count = n; }
+      if (n != count)
+        {
+          std::cerr << "Error: shard " << shard << " is from a split in "
+                    << n << " instead of " << count << std::endl;
+          ok = false;
+        }
+      if (!seen.insert(i).second)
+        {
+          std::cerr << "Error: shard " << shard << " is merged more than once"
+                    << std::endl;
+          ok = false;
+        }
+    }
+  for (unsigned i = 1; i <= count; ++i)
+    {
+      if (!seen.count(i))
+        {
+          std::cerr << "Warning: shard " << i << "/" << count << " is missing"
+                    << std::endl;
+          ok = false;
+        }
+    }
+  return ok;
+}
+
+bool summary::write(const fs::path& path) const
+{
+  std::ofstream out(path.string());
+  if (!out) { return false; }
+  write(out);
+  out.close();
+  return static_cast<bool>(out);
+}
+
+void summary::write(std::ostream& out) const
+{
+  out << "# column: " << column_ << "\n";
+  for (auto&& shard : shards_) { out << "# shard: " << shard << "\n"; }
+  out << "# files: " << files_ << "\n";
+  out << "Process,Samples,Mean,StdDev,Min,Max,M2\n";
+  out << std::setprecision(std::numeric_limits<double>::max_digits10);
+  symbol_table& symbols = symbol_table::global();
+  for (auto id : ids_)
+    {
+      const moments& m = processes_.at(id);
+      out << symbols.name(id) << "," << m.count << "," << m.mean << ","
+          << m.stddev() << "," << (m.count ? m.min : 0.) << ","
+          << (m.count ? m.max : 0.) << "," << m.m2 << "\n";
+    }
+}
+
+bool summary::read(const fs::path& path)
+{
+  std::ifstream in(path.string());
+  if (!in) { return false; }
+  std::string line;
+  bool header = false;
+  while (std::getline(in, line))
+    {
+      if (line.compare(0, 10, "# column: ") == 0)
+        { column_ = line.substr(10); }
+      else if (line.compare(0, 9, "# shard: ") == 0)
+        { shards_.push_back(line.substr(9)); }
+      else if (line.compare(0, 9, "# files: ") == 0)
+        { files_ += std::stoull(line.substr(9)); }
+      else if (line.compare(0, 8, "Process,") == 0)
+        { header = true; }
+      else if (header && !line.empty())
+        {
+          std::istringstream fields(line);
+          std::string name, value;
+          std::vector<double> values;
+          std::getline(fields, name, ',');
+          while (std::getline(fields, value, ','))
+            { values.push_back(std::stod(value)); }
+          if (values.size() != 6) { return false; }
+          moments m;
+          m.count = static_cast<std::uint64_t>(values[0]);
+          m.mean = values[1];
+          if (m.count)
+            {
+              m.min = values[3];
+              m.max = values[4];
+            }
+          m.m2 = values[5];
+          process(symbol_table::global().intern(name)).merge(m);
+        }
+    }
+  return header;
+}
+
+int merge_summaries(const std::vector<std::string>& inputs,
+                    const std::string& output)
+{
+  summary merged;
+  for (auto&& input : inputs)
+    {
+      summary s;
+      try
+        {
+          if (!s.read(input))
+            {
+              std::cerr << "Error reading summary: " << input << std::endl;
+              return 1;
+            }
+        }
+      catch (const std::exception&)
+        {
+          std::cerr << "Error: malformed summary: " << input << std::endl;
+          return 1;
+        }
+      if (!merged.merge(s))
+        {
+          std::cerr << "Error: " << input << " does not summarize the same "
+                    << "column as the previous summaries" << std::endl;
+          return 1;
+        }
+    }
+  int ret_val = merged.check_shards() ? 0 : 1;
+  if (output.empty())
+    { merged.write(std::cout); }
+  else if (!merged.write(output))
+    {
+      std::cerr << "Error writing file: " << output << std::endl;
+      return 1;
+    }
+  return ret_val;
+}
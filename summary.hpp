@@ -0,0 +1,104 @@
+#ifndef TOP2CSV_SUMMARY_HPP
+#define TOP2CSV_SUMMARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include "parser.hpp"
+
+/**
+ *  Count, mean, variance, minimum and maximum of a series of values.  Two
+ *  moments computed over separate series can be merged exactly as if they
+ *  had been computed over both series.
+ */
+struct moments
+{
+  std::uint64_t count;
+  double mean;
+  double m2; // sum of squared differences to the mean
+  double min;
+  double max;
+
+  moments();
+
+  /**
+   *  @return The moments of count values, computed in two passes.
+   */
+  static moments of(const float* values, std::size_t count);
+
+  void add(double value);
+  void merge(const moments& other);
+  double stddev() const;
+};
+
+/**
+ *  Per process statistics over all the snapshots of one or more top logs.
+ *  Processes are keyed by their id in the global symbol_table, so that
+ *  merging compares integers rather than names.
+ *
+ *  Summaries are written as CSV files that can be read back and merged
+ *  together, so that the summaries of a --find split in shards across several
+ *  processes can be combined into the summary of the whole --find.
+ */
+class summary
+{
+public:
+  summary();
+
+  /**
+   *  Adds the rows of a top log.  Can be called from several threads.
+   */
+  void add(const std::vector<std::string>& processes,
+           const std::vector<row_type>& rows);
+
+  /**
+   *  Merges another summary into this one.
+   *
+   *  @return false if the summaries are not for the same column.
+   */
+  bool merge(const summary& other);
+
+  void set_column(const std::string& column) { column_ = column; }
+  void add_shard(const std::string& shard) { shards_.push_back(shard); }
+
+  /**
+   *  Checks that the shards merged in this summary are all the shards of a
+   *  split and that none was merged twice.  Prints what is wrong on std::cerr.
+   *
+   *  @return true if the shards are complete or if there are no shards.
+   */
+  bool check_shards() const;
+
+  bool write(const boost::filesystem::path& path) const;
+  void write(std::ostream& out) const;
+
+  /**
+   *  @return false if the file could not be read or is not a summary.
+   */
+  bool read(const boost::filesystem::path& path);
+
+private:
+  std::mutex mutex_;
+  std::string column_;
+  std::vector<std::string> shards_;
+  std::uint64_t files_;
+  moments& process(std::uint32_t id);
+
+  std::vector<std::uint32_t> ids_; // symbol ids, in order of first appearance
+  std::unordered_map<std::uint32_t, moments> processes_;
+};
+
+/**
+ *  Merges summary files into a single summary, written to output or to
+ *  std::cout when output is empty.
+ *
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int merge_summaries(const std::vector<std::string>& inputs,
+                    const std::string& output);
+
+#endif // TOP2CSV_SUMMARY_HPP
@@ -0,0 +1,108 @@
+#include "symbols.hpp"
+
+#include <stdexcept>
+#include "binary.hpp"
+
+namespace
+{
+  std::size_t hash_name(const char* name, std::size_t length)
+  {
+    std::uint64_t hash = fnv1a(name, length);
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+  }
+}
+
+symbol_table::table::table(std::size_t size)
+  : mask(size - 1), slots(new std::atomic<std::uint32_t>[size])
+{
+  for (std::size_t i = 0; i < size; ++i) { slots[i].store(0); }
+}
+
+symbol_table& symbol_table::global()
+{
+  static symbol_table symbols;
+  return symbols;
+}
+
+symbol_table::symbol_table()
+  : size_(0)
+{
+  for (auto&& chunk : chunks_) { chunk.store(nullptr); }
+  tables_.emplace_back(new table(1024));
+  table_.store(tables_.back().get());
+}
+
+symbol_table::~symbol_table()
+{
+  for (auto&& chunk : chunks_) { delete[] chunk.load(); }
+}
+
+std::uint32_t symbol_table::find_in(const table& t, const char* name,
+                                    std::size_t length, std::size_t hash) const
+{
+  for (std::size_t slot = hash & t.mask; ; slot = (slot + 1) & t.mask)
+    {
+      std::uint32_t entry = t.slots[slot].load(std::memory_order_acquire);
+      if (entry == 0) { return none; }
+      const std::string& candidate = this->name(entry - 1);
+      if (candidate.size() == length
+          && candidate.compare(0, length, name, length) == 0)
+        { return entry - 1; }
+    }
+}
+
+void symbol_table::insert_in(table& t, std::uint32_t id, std::size_t hash)
+{
+  std::size_t slot = hash & t.mask;
+  while (t.slots[slot].load(std::memory_order_relaxed) != 0)
+    { slot = (slot + 1) & t.mask; }
+  t.slots[slot].store(id + 1, std::memory_order_release);
+}
+
+std::uint32_t symbol_table::find(const char* name, std::size_t length) const
+{
+  return find_in(*table_.load(std::memory_order_acquire), name, length,
+                 hash_name(name, length));
+}
+
+std::uint32_t symbol_table::intern(const char* name, std::size_t length)
+{
+  std::size_t hash = hash_name(name, length);
+  std::uint32_t id = find_in(*table_.load(std::memory_order_acquire), name,
+                             length, hash);
+  if (id != none) { return id; }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  table* current = table_.load(std::memory_order_relaxed);
+  id = find_in(*current, name, length, hash);
+  if (id != none) { return id; }
+  std::size_t size = size_.load(std::memory_order_relaxed);
+  if (size == CHUNK_SIZE * MAX_CHUNKS)
+    { throw std::length_error("too many process names"); }
+  std::atomic<std::string*>& chunk_slot = chunks_[size / CHUNK_SIZE];
+  std::string* chunk = chunk_slot.load(std::memory_order_relaxed);
+  if (!chunk)
+    {
+      chunk = new std::string[CHUNK_SIZE];
+      chunk_slot.store(chunk, std::memory_order_release);
+    }
+  chunk[size % CHUNK_SIZE].assign(name, length);
+  id = static_cast<std::uint32_t>(size);
+  size_.store(size + 1, std::memory_order_release);
+
+  if (2 * (size + 1) > current->mask + 1)
+    {
+      // Kept at most half full, so that probes stay short.
+      tables_.emplace_back(new table(2 * (current->mask + 1)));
+      table* larger = tables_.back().get();
+      for (std::uint32_t i = 0; i <= id; ++i)
+        {
+          const std::string& n = this->name(i);
+          insert_in(*larger, i, hash_name(n.data(), n.size()));
+        }
+      table_.store(larger, std::memory_order_release);
+    }
+  else
+    { insert_in(*current, id, hash); }
+  return id;
+}
@@ -0,0 +1,89 @@
+#ifndef TOP2CSV_SYMBOLS_HPP
+#define TOP2CSV_SYMBOLS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ *  The process names seen by the program, each stored once and identified by
+ *  a stable 32-bit id, so that rows, summaries and presets compare integers
+ *  instead of strings.
+ *
+ *  Looking up a name or the name of an id never locks: the names live in
+ *  chunks that never move, and the hash table from names to ids is only
+ *  written through atomic stores.  Adding a name takes a mutex; when the
+ *  table gets too full, a larger one replaces it and the old one is kept
+ *  until the program exits, so that a reader still using it finds every name
+ *  it held.  A name missing from an old table is looked up again, under the
+ *  mutex, before being added.
+ */
+class symbol_table
+{
+public:
+  static const std::uint32_t none = 0xffffffffu;
+
+  /**
+   *  @return The table shared by the whole program.
+   */
+  static symbol_table& global();
+
+  symbol_table();
+  ~symbol_table();
+
+  symbol_table(const symbol_table&) = delete;
+  symbol_table& operator=(const symbol_table&) = delete;
+
+  /**
+   *  @return The id of the name, or none if it was never interned.
+   */
+  std::uint32_t find(const char* name, std::size_t length) const;
+  std::uint32_t find(const std::string& name) const
+  { return find(name.data(), name.size()); }
+
+  /**
+   *  @return The id of the name, added to the table if needed.
+   */
+  std::uint32_t intern(const char* name, std::size_t length);
+  std::uint32_t intern(const std::string& name)
+  { return intern(name.data(), name.size()); }
+
+  /**
+   *  @param id An id returned by intern or find.
+   */
+  const std::string& name(std::uint32_t id) const
+  {
+    return chunks_[id / CHUNK_SIZE].load(std::memory_order_acquire)
+      [id % CHUNK_SIZE];
+  }
+
+  std::size_t size() const { return size_.load(std::memory_order_acquire); }
+
+private:
+  static const std::size_t CHUNK_SIZE = 1024;
+  static const std::size_t MAX_CHUNKS = 4096;
+
+  struct table
+  {
+    explicit table(std::size_t size);
+
+    std::size_t mask;
+    std::unique_ptr<std::atomic<std::uint32_t>[]> slots; // id + 1, 0 if free
+  };
+
+  std::uint32_t find_in(const table& t, const char* name,
+                        std::size_t length, std::size_t hash) const;
+  void insert_in(table& t, std::uint32_t id, std::size_t hash);
+
+  std::atomic<std::string*> chunks_[MAX_CHUNKS];
+  std::atomic<std::size_t> size_;
+  std::atomic<table*> table_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<table> > tables_; // current and retired
+};
+
+#endif // TOP2CSV_SYMBOLS_HPP
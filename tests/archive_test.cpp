@@ -0,0 +1,157 @@
+/**
+ *  Writes a tar archive with names that need a ustar prefix or a GNU long
+ *  name, adds a pax extended header by hand, and checks that reading it back
+ *  gives every entry with its content.  Also checks that a truncated archive
+ *  is reported, that gzip data of several members is decompressed as a whole
+ *  when the build supports it, and that the entry paths that could name a
+ *  file outside of an output directory are told apart.
+ */
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef TOP2CSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "archive.hpp"
+#include "reader.hpp"
+
+namespace
+{
+  /**
+   *  Changes the type of the entry whose header is at offset, and updates
+   *  the checksum of the header.
+   */
+  void set_type(std::string& archive, std::size_t offset, char type)
+  {
+    char* header = &archive[offset];
+    header[156] = type;
+    unsigned sum = 0;
+    for (int i = 0; i < 512; ++i)
+      {
+        sum += i >= 148 && i < 156 ? ' '
+          : static_cast<unsigned char>(header[i]);
+      }
+    std::snprintf(header + 148, 7, "%06o", sum);
+  }
+
+  /**
+   *  @return The entries read, as path=content, or "failed" after them if
+   *          the archive is not valid.
+   */
+  std::vector<std::string> read_all(std::streambuf& source)
+  {
+    std::vector<std::string> entries;
+    tar_reader tar(source);
+    tar_entry entry;
+    while (tar.next(entry))
+      {
+        if (!entry.regular) { continue; }
+        std::ostringstream content;
+        content << &tar;
+        entries.push_back(entry.path + "=" + content.str());
+      }
+    if (tar.failed()) { entries.push_back("failed"); }
+    return entries;
+  }
+
+#ifdef TOP2CSV_HAVE_ZLIB
+  std::string gzip(const std::string& data)
+  {
+    z_stream stream{};
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+                 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+  }
+#endif
+}
+
+int main()
+{
+  const std::string prefixed = std::string(60, 'd') + "/"
+    + std::string(60, 'e') + "/top.log";
+  const std::string long_name = std::string(120, 'l') + "/top.log.1";
+  std::string big(100000, 'x');
+  for (std::size_t i = 0; i < big.size(); i += 7) { big[i] = '\n'; }
+
+  std::ostringstream written;
+  tar_writer writer(written);
+  writer.add("host/top.log", "short\n", 1700000000);
+  writer.add(prefixed, "prefixed\n", 1700000000);
+  writer.add(long_name, "long\n", 1700000000);
+  // A pax header naming the next entry, written as a regular file first.
+  std::string record = " path=pax/" + std::string(150, 'p') + "/top.log\n";
+  record = std::to_string(record.size() + 3) + record; // a 3 digit length
+  std::size_t pax_offset = written.str().size();
+  writer.add("PaxHeader", record, 0);
+  writer.add("ignored", big, 1700000000);
+  writer.finish();
+  std::string archive = written.str();
+  set_type(archive, pax_offset, 'x');
+
+  const std::vector<std::string> expected = {
+    "host/top.log=short\n",
+    prefixed + "=prefixed\n",
+    long_name + "=long\n",
+    "pax/" + std::string(150, 'p') + "/top.log=" + big,
+  };
+  int ret_val = 0;
+  std::stringbuf source(archive);
+  if (read_all(source) != expected)
+    {
+      std::cerr << "Error: the entries read back differ" << std::endl;
+      ret_val = 1;
+    }
+
+  std::stringbuf truncated(archive.substr(0, archive.size() - 5000));
+  std::vector<std::string> entries = read_all(truncated);
+  if (entries.empty() || entries.back() != "failed")
+    {
+      std::cerr << "Error: a truncated archive was not reported" << std::endl;
+      ret_val = 1;
+    }
+
+#ifdef TOP2CSV_HAVE_ZLIB
+  std::size_t half = archive.size() / 2;
+  std::stringbuf compressed(gzip(archive.substr(0, half))
+                            + gzip(archive.substr(half)));
+  gzip_reader gunzip;
+  if (!gunzip.open(compressed) || read_all(gunzip) != expected
+      || gunzip.failed())
+    {
+      std::cerr << "Error: the compressed archive was not read back"
+                << std::endl;
+      ret_val = 1;
+    }
+#endif
+
+  for (const char* path : {"host/top.log", "./host/top.log", "top.log.1",
+                           "host../..top.log"})
+    {
+      if (!is_safe_entry_path(path))
+        {
+          std::cerr << "Error: " << path << " taken for unsafe" << std::endl;
+          ret_val = 1;
+        }
+    }
+  // Any '..' is refused, even one that does not go out.
+  for (const char* path : {"", "/top.log", "/etc/host/top.log", "../top.log",
+                           "./x/../../y/top.log", "host/../top.log"})
+    {
+      if (is_safe_entry_path(path))
+        {
+          std::cerr << "Error: " << path << " taken for safe" << std::endl;
+          ret_val = 1;
+        }
+    }
+  return ret_val;
+}
@@ -0,0 +1,105 @@
+/**
+ *  Compresses a generated top log spanning several days, in two gzip
+ *  members, indexes it with a small span and checks that decompressing from
+ *  every checkpoint gives the log from the snapshot of the checkpoint, which
+ *  is timed as a day_clock would, and that a saved index is read back.
+ *  Does nothing in builds without zlib.
+ */
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef TOP2CSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "gzindex.hpp"
+
+namespace fs = boost::filesystem;
+
+int main()
+{
+#ifdef TOP2CSV_HAVE_ZLIB
+  std::string log;
+  for (int i = 0; i < 20000; ++i)
+    {
+      int seconds = (i * 17 + 80000) % 86400;
+      char header[64];
+      std::snprintf(header, sizeof(header), "top - %02d:%02d:%02d up 1 day\n",
+                    seconds / 3600, seconds / 60 % 60, seconds % 60);
+      log += header;
+      for (int p = 0; p < 5; ++p)
+        {
+          log += " " + std::to_string(1000 + p) + " root 20 0 "
+            + std::to_string((i * 31 + p * 7) % 9000) + "m 10m 5m S "
+            + std::to_string(p) + ".0 0.1 0:00.01 proc"
+            + std::to_string(p) + "\n";
+        }
+    }
+
+  fs::path gz = fs::temp_directory_path()
+    / fs::unique_path("top2csv-gzindex-%%%%%%%%.gz");
+  gzFile file = gzopen(gz.string().c_str(), "wb");
+  std::size_t half = log.size() / 2;
+  gzwrite(file, log.data(), static_cast<unsigned>(half));
+  gzclose(file);
+  file = gzopen(gz.string().c_str(), "ab");
+  gzwrite(file, log.data() + half, static_cast<unsigned>(log.size() - half));
+  gzclose(file);
+
+  int ret_val = 0;
+  gz_index index;
+  if (!index.build(gz, 64 << 10) || index.checkpoints().size() < 10)
+    {
+      std::cerr << "Error: the index was not built" << std::endl;
+      ret_val = 1;
+    }
+  std::int64_t day = 0, last = -1, time = 0;
+  std::size_t header = 0;
+  for (auto&& point : index.checkpoints())
+    {
+      // The time of the snapshot of the checkpoint, counted from the start.
+      while (header <= point.header && header != std::string::npos)
+        {
+          int seconds = std::stoi(log.substr(header + 6, 2)) * 3600
+            + std::stoi(log.substr(header + 9, 2)) * 60
+            + std::stoi(log.substr(header + 12, 2));
+          if (seconds < last) { ++day; }
+          last = seconds;
+          time = day * 86400 + seconds;
+          header = log.find("\ntop - ", header);
+          if (header != std::string::npos) { ++header; }
+        }
+      std::string data;
+      if (log.compare(point.header, 6, "top - ") != 0 || point.time != time
+          || !index.extract(gz, &point - &index.checkpoints()[0], -1,
+                            [&data](const char* text, std::size_t size)
+                            { data.append(text, size); })
+          || data != log.substr(point.header))
+        {
+          std::cerr << "Error: wrong data from checkpoint at " << point.out
+                    << std::endl;
+          ret_val = 1;
+        }
+    }
+  if (day < 2)
+    {
+      std::cerr << "Error: the log does not span several days" << std::endl;
+      ret_val = 1;
+    }
+
+  fs::path saved = gz_index::default_path(gz);
+  gz_index loaded;
+  if (!index.save(saved) || !loaded.load(saved, gz)
+      || loaded.origin() != index.origin()
+      || loaded.checkpoints().size() != index.checkpoints().size())
+    {
+      std::cerr << "Error: the index was not read back" << std::endl;
+      ret_val = 1;
+    }
+  fs::remove(saved);
+  fs::remove(gz);
+  return ret_val;
+#else
+  return 0;
+#endif
+}
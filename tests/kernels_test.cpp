@@ -0,0 +1,72 @@
+/**
+ *  Checks that the aggregation kernels of every instruction set supported by
+ *  the processor give the same results as the scalar ones, for lengths that
+ *  leave every possible tail and for values of both columns.
+ */
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "kernels.hpp"
+
+int main()
+{
+  std::mt19937 generator(20240501);
+  std::uniform_int_distribution<int> kib(0, 4 << 20), tenths(0, 1000);
+  std::vector<std::vector<float> > columns;
+  for (std::size_t size = 0; size < 80; ++size)
+    {
+      columns.emplace_back(size);
+      for (auto&& v : columns.back()) { v = kib(generator); }
+    }
+  columns.emplace_back(100003);
+  for (auto&& v : columns.back()) { v = kib(generator); }
+  columns.emplace_back(100003);
+  for (auto&& v : columns.back()) { v = tenths(generator) / 10.f; }
+
+  struct result
+  {
+    double sum;
+    float min;
+    float max;
+    double variance;
+  };
+  auto run = [&]
+    {
+      std::vector<result> results;
+      for (auto&& c : columns)
+        {
+          result r;
+          r.sum = column_sum(c.data(), c.size());
+          column_min_max(c.data(), c.size(), r.min, r.max);
+          r.variance = column_variance(c.data(), c.size());
+          results.push_back(r);
+        }
+      return results;
+    };
+  use_kernel_isa(kernel_isa::scalar);
+  const std::vector<result> expected = run();
+
+  int ret_val = 0;
+  for (auto isa : {kernel_isa::avx2, kernel_isa::avx512})
+    {
+      if (use_kernel_isa(isa) != isa) { continue; }
+      std::vector<result> results = run();
+      for (std::size_t i = 0; i < columns.size(); ++i)
+        {
+          const result& r = results[i];
+          const result& e = expected[i];
+          // Sums are exact; squared differences are rounded in another order.
+          if (r.sum != e.sum || r.min != e.min || r.max != e.max
+              || std::fabs(r.variance - e.variance) > 1e-9 * e.variance)
+            {
+              std::cerr << "Error: " << kernel_isa_name(isa) << " differs "
+                        << "from scalar on " << columns[i].size()
+                        << " values" << std::endl;
+              ret_val = 1;
+            }
+        }
+      std::cout << kernel_isa_name(isa) << " checked" << std::endl;
+    }
+  return ret_val;
+}
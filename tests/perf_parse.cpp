@@ -0,0 +1,193 @@
+/**
+ *  Parses a generated top log and checks both the output and the throughput.
+ *
+ *  Usage: perf_parse <minimum %> [expected output hash] [snapshots]
+ *
+ *  The log is generated in memory from a fixed seed, so it is the same on
+ *  every platform.  The CSV output of parse_and_print is hashed and compared
+ *  with the expected hash, so that a faster parser can be checked to produce
+ *  the same output byte for byte, and the rows formatted on several threads
+ *  must be the same as the ones printed on one.
+ *
+ *  The throughput is measured against a reference loop timed in the same
+ *  process, which reads the log line by line and hashes it, so that the
+ *  budget holds on fast and slow machines alike, whatever the build.  The
+ *  test fails if the best of three runs of the parser is slower than this
+ *  percentage of the best of three runs of the reference loop.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "binary.hpp"
+#include "format.hpp"
+#include "parser.hpp"
+
+namespace
+{
+  const std::vector<std::string> processes{"dbserver", "historyserver",
+                                           "SigLoc", "ascmanager", "BmfCol",
+                                           "TelSvr"};
+
+  std::string generate(unsigned snapshots)
+  {
+    // Only the raw output of mt19937 is specified by the standard, unlike
+    // the distributions, hence the modulos.
+    std::mt19937 random(20240501);
+    const char* others[] = {"bash", "sshd", "cron", "rsyslogd", "java",
+                            "python3", "kworker/0:1", "systemd"};
+    std::string log;
+    char line[256];
+    int hour = 23, min = 50, sec = 0;
+    for (unsigned s = 0; s < snapshots; ++s)
+      {
+        std::snprintf(line, sizeof(line),
+                      "top - %02d:%02d:%02d up 10 days,  3:02,  2 users,  "
+                      "load average: 0.10, 0.20, 0.30\n", hour, min, sec);
+        log += line;
+        log += "Tasks: 180 total,   1 running, 179 sleeping,   0 stopped,   "
+          "0 zombie\n"
+          "Cpu(s):  2.0%us,  1.0%sy,  0.0%ni, 96.0%id,  1.0%wa,  0.0%hi,  "
+          "0.0%si,  0.0%st\n"
+          "Mem:   8000000k total,  7000000k used,  1000000k free,   "
+          "100000k buffers\n"
+          "Swap:  2000000k total,        0k used,  2000000k free,  "
+          "3000000k cached\n\n"
+          "  PID USER      PR  NI  VIRT  RES  SHR S %CPU %MEM    TIME+  "
+          "COMMAND\n";
+        for (unsigned p = 0; p < 40; ++p)
+          {
+            const std::string name = p < 2 * processes.size()
+              ? processes[p / 2] : others[p % 8];
+            char virt[32];
+            unsigned r = random() % 3000;
+            if (r < 1000)
+              { std::snprintf(virt, sizeof(virt), "%um", r + 1); }
+            else if (r < 2000)
+              { std::snprintf(virt, sizeof(virt), "%u.%ug", r / 500, r % 10); }
+            else
+              { std::snprintf(virt, sizeof(virt), "%u", r * 37); }
+            unsigned cpu = random() % 1000;
+            std::snprintf(line, sizeof(line),
+                          "%5u root      20   0 %5s  10m 5m S %2u.%u  0.1   "
+                          "0:00.%02u %s\n", 1000 + p, virt, cpu / 10, cpu % 10,
+                          p % 100, name.c_str());
+            log += line;
+          }
+        log += "\n";
+        sec += 1 + random() % 5;
+        if (sec >= 60) { sec -= 60; ++min; }
+        if (min >= 60) { min -= 60; ++hour; }
+        if (hour >= 24) { hour -= 24; }
+      }
+    return log;
+  }
+
+  // Where the reference loop stores its hash, so that it cannot be left out.
+  volatile std::uint64_t reference_hash;
+
+  /**
+   *  The least any parser of the log has to do: read it line by line, and
+   *  look at every byte.
+   *
+   *  @return The hash of the lines.
+   */
+  std::uint64_t reference(const std::string& log)
+  {
+    std::istringstream in(log);
+    std::string line;
+    std::uint64_t hash = 0;
+    while (std::getline(in, line)) { hash ^= fnv1a(line); }
+    return hash;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+    {
+      std::cerr << "Usage: perf_parse <minimum %> [expected hash] "
+                << "[snapshots]" << std::endl;
+      return 1;
+    }
+  double budget = std::atof(argv[1]);
+  unsigned snapshots = argc > 3 ? std::atoi(argv[3]) : 300;
+  const std::string log = generate(snapshots);
+  double mb = log.size() / 1048576.;
+
+  double best_reference = 0;
+  for (int run = 0; run < 3; ++run)
+    {
+      auto start = std::chrono::steady_clock::now();
+      reference_hash = reference(log);
+      std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+      best_reference = std::max(best_reference, mb / elapsed.count());
+    }
+
+  double best = 0;
+  std::string csv;
+  for (int run = 0; run < 3; ++run)
+    {
+      std::istringstream in(log);
+      std::ostringstream out;
+      auto start = std::chrono::steady_clock::now();
+      for (int column : {VIRT_COL, CPU_COL})
+        {
+          in.clear();
+          in.seekg(0);
+          if (parse_and_print(in, out, processes, column) != 0)
+            {
+              std::cerr << "Error: the generated log was rejected"
+                        << std::endl;
+              return 1;
+            }
+        }
+      std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+      best = std::max(best, 2 * mb / elapsed.count());
+      csv = out.str();
+    }
+
+  std::string parallel;
+  for (int column : {VIRT_COL, CPU_COL})
+    {
+      std::istringstream in(log);
+      std::ostringstream out;
+      parse_and_print_parallel(in, out, "", processes, column, 4);
+      parallel += out.str();
+    }
+  if (parallel != csv)
+    {
+      std::cerr << "Error: the rows formatted in parallel differ" << std::endl;
+      return 1;
+    }
+
+  char digest[17];
+  std::snprintf(digest, sizeof(digest), "%016" PRIx64, fnv1a(csv));
+  double share = 100 * best / best_reference;
+  std::cout << "parsed " << 2 * mb << " MB at " << best << " MB/s, "
+            << share << "% of the " << best_reference << " MB/s of the "
+            << "reference loop (budget " << budget << "%), output hash "
+            << digest << std::endl;
+  int ret_val = 0;
+  if (argc > 2 && std::string(argv[2]) != digest)
+    {
+      std::cerr << "Error: output hash " << digest << " instead of " << argv[2]
+                << std::endl;
+      ret_val = 1;
+    }
+  if (share < budget)
+    {
+      std::cerr << "Error: " << share << "% of the reference loop is below "
+                << "the budget of " << budget << "%" << std::endl;
+      ret_val = 1;
+    }
+  return ret_val;
+}
@@ -0,0 +1,58 @@
+/**
+ *  Splits a top log whose time goes past midnight into snapshots, and checks
+ *  that they are given back whole, with the lines before the first header,
+ *  and timed as a day_clock would, and that a schedule at 1000 times the
+ *  speed of the log spaces them as they were recorded.
+ */
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "replay.hpp"
+
+int main()
+{
+  const std::vector<std::string> expected = {
+    "garbage before the first snapshot\ntop - 23:59:50 up 1 day\n"
+    " 1 root 20 0 10m 1m 1m S 0.0 0.1 0:00.01 proc\n",
+    "top - 23:59:58 up 1 day\n\n",
+    "top - 00:00:04 up 1 day\n 1 root 20 0 10m 1m 1m S 0.0 0.1 0:00.01 top -\n",
+  };
+  const std::vector<std::int64_t> times = {86390, 86398, 86404};
+  std::string log;
+  for (auto&& text : expected) { log += text; }
+  log.pop_back(); // an unterminated last line is given back terminated
+
+  int ret_val = 0;
+  std::istringstream in(log);
+  snapshot_source source(in);
+  replay_schedule schedule(1000, 0);
+  auto start = schedule.due(times[0]);
+  std::string text;
+  std::int64_t time;
+  std::size_t i = 0;
+  for (; source.next(text, time); ++i)
+    {
+      if (i >= expected.size() || text != expected[i] || time != times[i])
+        {
+          std::cerr << "Error: wrong snapshot " << i << std::endl;
+          ret_val = 1;
+          continue;
+        }
+      std::chrono::duration<double, std::milli> offset
+        = (i > 0 ? schedule.due(time) : start) - start;
+      if (std::abs(offset.count() - (time - times[0])) > 0.001)
+        {
+          std::cerr << "Error: snapshot " << i << " is not due when expected"
+                    << std::endl;
+          ret_val = 1;
+        }
+    }
+  if (i != expected.size())
+    {
+      std::cerr << "Error: " << i << " snapshots read" << std::endl;
+      ret_val = 1;
+    }
+  return ret_val;
+}
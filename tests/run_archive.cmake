@@ -0,0 +1,67 @@
+# Converts the top logs of a tar archive with --find, into a directory with
+# --output-dir then into a new archive with --output-tar, and compares the
+# outputs with golden files.  The entries of the archive that could name a
+# file outside of the output must be skipped with a warning.
+#
+# Variables: TOP2CSV, the program; ARCHIVE, the archive; ARGS, the other
+# arguments separated by '|'; OUTPUT_DIR, a directory to write into, emptied
+# first; GOLDEN, the directory of the golden files; EXPECTED, the outputs as
+# <path>=<golden file> separated by '|'; UNSAFE, the entries to skip,
+# separated by '|'.
+string(REPLACE "|" ";" args "${ARGS}")
+string(REPLACE "|" ";" expected "${EXPECTED}")
+string(REPLACE "|" ";" unsafe "${UNSAFE}")
+file(REMOVE_RECURSE ${OUTPUT_DIR})
+file(MAKE_DIRECTORY ${OUTPUT_DIR}/tar)
+
+# Compares the files under dir with the expected outputs.
+function(check_outputs dir)
+  set(names)
+  foreach(entry ${expected})
+    string(REGEX REPLACE "=.*" "" name "${entry}")
+    string(REGEX REPLACE "^[^=]*=" "" golden "${entry}")
+    list(APPEND names ${name})
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+      ${dir}/${name} ${GOLDEN}/${golden} RESULT_VARIABLE different)
+    if(different)
+      message(FATAL_ERROR "${dir}/${name} differs from ${golden}")
+    endif()
+  endforeach()
+  file(GLOB_RECURSE written RELATIVE ${dir} ${dir}/*)
+  list(SORT names)
+  list(SORT written)
+  if(NOT written STREQUAL names)
+    message(FATAL_ERROR "${dir} holds ${written} instead of ${names}")
+  endif()
+endfunction()
+
+# Runs top2csv with its arguments followed by more, and checks that every
+# unsafe entry was reported.
+function(run_top2csv)
+  execute_process(COMMAND ${TOP2CSV} --find ${ARCHIVE} ${ARGN} ${args}
+    RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE errors)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "top2csv exited with ${result}")
+  endif()
+  foreach(entry ${unsafe})
+    string(FIND "${errors}" "Warning: skipping ${entry}," found)
+    if(found EQUAL -1)
+      message(FATAL_ERROR "${entry} was not skipped:\n${errors}")
+    endif()
+  endforeach()
+endfunction()
+
+run_top2csv(--output-dir ${OUTPUT_DIR}/dir)
+check_outputs(${OUTPUT_DIR}/dir)
+file(GLOB outside RELATIVE ${OUTPUT_DIR} ${OUTPUT_DIR}/*)
+if(NOT outside STREQUAL "dir;tar")
+  message(FATAL_ERROR "${OUTPUT_DIR} holds ${outside} besides the outputs")
+endif()
+
+run_top2csv(--output-tar ${OUTPUT_DIR}/outputs.tar)
+execute_process(COMMAND ${CMAKE_COMMAND} -E tar xf ${OUTPUT_DIR}/outputs.tar
+  WORKING_DIRECTORY ${OUTPUT_DIR}/tar RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${OUTPUT_DIR}/outputs.tar could not be read")
+endif()
+check_outputs(${OUTPUT_DIR}/tar)
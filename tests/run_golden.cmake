@@ -0,0 +1,27 @@
+# Runs top2csv and compares its standard output with a golden file.
+#
+# Variables: TOP2CSV, the program; ARGS, its arguments separated by '|';
+# OUTPUT, where to write the output; EXPECTED, the golden file.  Optionally,
+# EXTRA_OUTPUT, another file written by top2csv, and EXTRA_EXPECTED, its
+# golden file.
+string(REPLACE "|" ";" args "${ARGS}")
+if(EXTRA_OUTPUT)
+  file(REMOVE ${EXTRA_OUTPUT})
+endif()
+execute_process(COMMAND ${TOP2CSV} ${args} OUTPUT_FILE ${OUTPUT}
+  RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "top2csv exited with ${result}")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${EXPECTED}
+  RESULT_VARIABLE different)
+if(different)
+  message(FATAL_ERROR "${OUTPUT} differs from ${EXPECTED}")
+endif()
+if(EXTRA_OUTPUT)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${EXTRA_OUTPUT}
+    ${EXTRA_EXPECTED} RESULT_VARIABLE different)
+  if(different)
+    message(FATAL_ERROR "${EXTRA_OUTPUT} differs from ${EXTRA_EXPECTED}")
+  endif()
+endif()
@@ -0,0 +1,166 @@
+/**
+ *  Converts a small tree of top logs with --find split in two shards, as two
+ *  processes would, and checks that every top log is converted by exactly
+ *  one of them, and that merging the summaries of the shards with
+ *  'top2csv merge' gives the summary of the unsharded --find.
+ *
+ *  Usage: shard_test <top2csv> <data directory>
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  std::string quote(const fs::path& path)
+  { return "\"" + path.string() + "\""; }
+
+  /**
+   *  Runs top2csv with its listing of the files sent to a log.
+   *
+   *  @return false if top2csv failed.
+   */
+  bool run(const fs::path& top2csv, const std::string& args,
+           const fs::path& log)
+  {
+    std::string command = quote(top2csv) + " " + args + " > " + quote(log);
+    if (std::system(command.c_str()) == 0) { return true; }
+    std::cerr << "Error: failed: " << command << std::endl;
+    return false;
+  }
+
+  /**
+   *  The content of a summary: its header lines, and the values of each
+   *  process.
+   */
+  struct summary_file
+  {
+    std::vector<std::string> header;
+    std::map<std::string, std::vector<double> > processes;
+  };
+
+  bool read_summary(const fs::path& path, summary_file& summary)
+  {
+    std::ifstream in(path.string());
+    std::string line;
+    while (std::getline(in, line))
+      {
+        if (line.compare(0, 9, "# shard: ") == 0) { continue; }
+        if (line.empty() || line[0] == '#'
+            || line.compare(0, 8, "Process,") == 0)
+          {
+            summary.header.push_back(line);
+            continue;
+          }
+        std::istringstream fields(line);
+        std::string name, value;
+        std::getline(fields, name, ',');
+        while (std::getline(fields, value, ','))
+          { summary.processes[name].push_back(std::stod(value)); }
+      }
+    return !summary.processes.empty();
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+    {
+      std::cerr << "Usage: shard_test <top2csv> <data directory>"
+                << std::endl;
+      return 1;
+    }
+  const fs::path top2csv = argv[1], data = argv[2];
+  const std::string processes = " --mem dbserver historyserver SigLoc sshd";
+  fs::path dir = fs::temp_directory_path()
+    / fs::unique_path("top2csv-shard-%%%%%%%%");
+  fs::path tree = dir / "tree";
+
+  // Top logs at two depths, so that the shards depend on whole paths.
+  std::vector<fs::path> logs;
+  const char* sources[] = {"basic.log", "truncated.log", "headers_only.log"};
+  for (int i = 0; i < 12; ++i)
+    {
+      fs::path log = fs::path(i % 2 ? "site" : "")
+        / ("host" + std::to_string(i)) / (i % 3 ? "top.log" : "top.log.1");
+      fs::create_directories((tree / log).parent_path());
+      fs::copy_file(data / sources[i % 3], tree / log);
+      logs.push_back(log);
+    }
+
+  int ret_val = 0;
+  for (int shard = 1; shard <= 2; ++shard)
+    {
+      std::string n = std::to_string(shard);
+      if (!run(top2csv, "--find " + quote(tree) + " --output-dir "
+               + quote(dir / ("out" + n)) + " --shard " + n + "/2 --summary "
+               + quote(dir / ("shard" + n + ".csv")) + processes,
+               dir / ("shard" + n + ".txt")))
+        { ret_val = 1; }
+    }
+  std::size_t converted[2] = {0, 0};
+  for (auto&& log : logs)
+    {
+      fs::path output = log;
+      output += "-mem.csv";
+      bool first = fs::exists(dir / "out1" / output);
+      bool second = fs::exists(dir / "out2" / output);
+      if (first == second)
+        {
+          std::cerr << "Error: " << log.string() << " converted "
+                    << (first ? "twice" : "by no shard") << std::endl;
+          ret_val = 1;
+        }
+      ++converted[first ? 0 : 1];
+    }
+  if (converted[0] == 0 || converted[1] == 0)
+    {
+      std::cerr << "Error: a shard converted no top log" << std::endl;
+      ret_val = 1;
+    }
+
+  summary_file merged, whole;
+  if (!run(top2csv, "merge -o " + quote(dir / "merged.csv") + " "
+           + quote(dir / "shard1.csv") + " " + quote(dir / "shard2.csv"),
+           dir / "merge.txt")
+      || !run(top2csv, "--find " + quote(tree) + " --output-dir "
+              + quote(dir / "out") + " --summary " + quote(dir / "whole.csv")
+              + processes, dir / "whole.txt")
+      || !read_summary(dir / "merged.csv", merged)
+      || !read_summary(dir / "whole.csv", whole))
+    {
+      std::cerr << "Error: the summaries could not be written" << std::endl;
+      fs::remove_all(dir);
+      return 1;
+    }
+  // Merged moments are the same, but for rounding.
+  bool same = merged.header == whole.header
+    && merged.processes.size() == whole.processes.size();
+  for (auto&& p : whole.processes)
+    {
+      const std::vector<double>& values = merged.processes[p.first];
+      same = same && values.size() == p.second.size();
+      for (std::size_t i = 0; same && i < values.size(); ++i)
+        {
+          same = std::fabs(values[i] - p.second[i])
+            <= 1e-9 * std::max(1., std::fabs(p.second[i]));
+        }
+    }
+  if (!same)
+    {
+      std::cerr << "Error: the merged summary differs from the summary of "
+                << "the whole --find" << std::endl;
+      ret_val = 1;
+    }
+  fs::remove_all(dir);
+  return ret_val;
+}
@@ -0,0 +1,62 @@
+/**
+ *  Interns the same names from several threads at once, enough of them for
+ *  the symbol table to grow a few times, and checks that every thread got
+ *  the same id for a name and that ids give back their names.
+ */
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "symbols.hpp"
+
+int main()
+{
+  const unsigned threads = 8, names = 20000;
+  symbol_table symbols;
+  std::vector<std::vector<std::uint32_t> > ids(threads);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&, t]
+                           {
+                             // Each thread goes through the names in its own
+                             // order, and looks them up as well.
+                             ids[t].resize(names);
+                             for (unsigned i = 0; i < names; ++i)
+                               {
+                                 unsigned n = (i * 7919 + t * 104729) % names;
+                                 std::string name = "proc" + std::to_string(n);
+                                 ids[t][n] = symbols.intern(name);
+                                 symbols.find(name);
+                               }
+                           });
+    }
+  for (auto&& worker : workers) { worker.join(); }
+
+  int ret_val = 0;
+  if (symbols.size() != names)
+    {
+      std::cerr << "Error: " << symbols.size() << " names instead of "
+                << names << std::endl;
+      ret_val = 1;
+    }
+  for (unsigned n = 0; n < names; ++n)
+    {
+      std::string name = "proc" + std::to_string(n);
+      for (unsigned t = 0; t < threads; ++t)
+        {
+          if (ids[t][n] != ids[0][n] || symbols.name(ids[t][n]) != name
+              || symbols.find(name) != ids[t][n])
+            {
+              std::cerr << "Error: inconsistent id for " << name << std::endl;
+              return 1;
+            }
+        }
+    }
+  if (symbols.find("unknown") != symbol_table::none)
+    {
+      std::cerr << "Error: found a name never interned" << std::endl;
+      ret_val = 1;
+    }
+  return ret_val;
+}
@@ -0,0 +1,75 @@
+/**
+ *  Takes tokens from a bucket at chosen times and checks that the pauses
+ *  asked for follow from its rate and its burst, then checks that reading
+ *  more than --max-io allows through resource_limits pauses for as long as
+ *  the rate says.
+ */
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include "throttle.hpp"
+
+namespace
+{
+  typedef token_bucket::clock_type clock_type;
+
+  clock_type::time_point at(clock_type::time_point start, double seconds)
+  {
+    return start + std::chrono::duration_cast<clock_type::duration>
+      (std::chrono::duration<double>(seconds));
+  }
+}
+
+int main()
+{
+  // The bucket of --max-io 1, but with a burst of two seconds rather than
+  // one, so that the burst and the rate can be told apart.
+  const double rate = 1048576, burst = 2 * rate;
+  auto start = clock_type::now();
+  token_bucket io(rate, burst, start);
+  struct step
+  {
+    double time;   // seconds since start
+    double bytes;  // taken
+    double pause;  // expected, in seconds
+  };
+  const step steps[] = {
+    {0, burst, 0},           // the burst is free
+    {0, rate / 4, 0.25},     // then every byte must wait for the rate
+    {0, rate / 4, 0.5},      // debts add up
+    {0.5, 0, 0},             // and are paid back by waiting
+    {1.5, rate / 2, 0},      // a second later, a second worth is free
+    {1.5, rate, 0.5},
+    {100, 3 * rate, 1},      // however long idle, no more than the burst
+  };
+  int ret_val = 0;
+  for (auto&& s : steps)
+    {
+      double pause = io.pause(s.bytes, at(start, s.time)).count();
+      if (std::fabs(pause - s.pause) > 1e-6)
+        {
+          std::cerr << "Error: taking " << s.bytes << " bytes at " << s.time
+                    << " s pauses " << pause << " s instead of " << s.pause
+                    << " s" << std::endl;
+          ret_val = 1;
+        }
+    }
+
+  // --max-io 8: the first second worth of reads is free, the next 2 MiB
+  // pause for a quarter of a second.
+  resource_limits limits(0, 8);
+  auto begin = clock_type::now();
+  limits.consumed(8 << 20);
+  double free = std::chrono::duration<double>(clock_type::now() - begin)
+    .count();
+  limits.consumed(2 << 20);
+  double paused = std::chrono::duration<double>(clock_type::now() - begin)
+    .count();
+  if (free > 0.1 || paused < 0.24 || paused > 1)
+    {
+      std::cerr << "Error: --max-io 8 paused " << free << " s, then "
+                << paused << " s instead of 0 and 0.25 s" << std::endl;
+      ret_val = 1;
+    }
+  return ret_val;
+}
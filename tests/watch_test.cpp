@@ -0,0 +1,189 @@
+/**
+ *  Watches a small tree of top logs with top2csv --watch while one of them
+ *  is rewritten over and over, so that it is converted again while its
+ *  previous output is still waiting in the batch, and checks that every
+ *  output ever seen under its final name is a whole CSV file, that the last
+ *  conversion wins, and that no temporary file is left behind.
+ *
+ *  Usage: watch_test <top2csv> <data directory>
+ */
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  std::string quote(const fs::path& path)
+  { return "\"" + path.string() + "\""; }
+
+  std::string read_file(const fs::path& path)
+  {
+    std::ifstream in(path.string(), std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+  }
+
+  /**
+   *  Writes a top log aside then moves it into place, as log rotation does,
+   *  so that top2csv never reads it partially written.
+   */
+  void put_log(const fs::path& log, const std::string& content)
+  {
+    fs::path tmp = log;
+    tmp += ".new";
+    std::ofstream(tmp.string(), std::ios::binary) << content;
+    fs::rename(tmp, log);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+    {
+      std::cerr << "Usage: watch_test <top2csv> <data directory>"
+                << std::endl;
+      return 1;
+    }
+  const fs::path top2csv = argv[1], data = argv[2];
+  const char* processes[] = {"dbserver", "historyserver", "SigLoc", "sshd"};
+  fs::path dir = fs::temp_directory_path()
+    / fs::unique_path("top2csv-watch-%%%%%%%%");
+  fs::path tree = dir / "tree";
+
+  // The outputs of the versions of the rewritten top log: the first two
+  // alternate, the last one is only written at the end.
+  const char* sources[] = {"basic.log", "truncated.log", "headers_only.log"};
+  std::string logs[3], outputs[3];
+  fs::create_directories(tree);
+  for (int i = 0; i < 3; ++i)
+    {
+      logs[i] = read_file(data / sources[i]);
+      fs::path csv = dir / (std::to_string(i) + ".csv");
+      std::string command = quote(top2csv) + " --mem -i "
+        + quote(data / sources[i]) + " -o " + quote(csv);
+      for (auto process : processes)
+        { command += std::string(" ") + process; }
+      if (std::system(command.c_str()) != 0)
+        {
+          std::cerr << "Error: failed: " << command << std::endl;
+          fs::remove_all(dir);
+          return 1;
+        }
+      outputs[i] = read_file(csv);
+    }
+  std::vector<fs::path> watched;
+  for (int i = 0; i < 4; ++i)
+    {
+      watched.push_back(tree / ("host" + std::to_string(i)) / "top.log");
+      fs::create_directories(watched.back().parent_path());
+      put_log(watched.back(), logs[0]);
+    }
+
+  fs::path errors = dir / "errors.txt";
+  pid_t child = ::fork();
+  if (child == 0)
+    {
+      int out = ::open("/dev/null", O_WRONLY);
+      int err = ::open(errors.string().c_str(), O_WRONLY | O_CREAT, 0644);
+      ::dup2(out, 1);
+      ::dup2(err, 2);
+      // A batch of 3 outputs stays open while the others are converted.
+      std::string root = tree.string();
+      std::vector<const char*> args = {"top2csv", "--watch", root.c_str(),
+                                       "--watch-workers", "4",
+                                       "--watch-debounce", "0",
+                                       "--watch-rescan", "1",
+                                       "--fsync-batch", "3", "--mem"};
+      for (auto process : processes) { args.push_back(process); }
+      args.push_back(nullptr);
+      ::execv(top2csv.string().c_str(), const_cast<char**>(args.data()));
+      ::_exit(127);
+    }
+  if (child < 0)
+    {
+      std::cerr << "Error: cannot run " << top2csv.string() << std::endl;
+      fs::remove_all(dir);
+      return 1;
+    }
+
+  int ret_val = 0;
+  auto check_outputs = [&]
+    {
+      for (auto&& log : watched)
+        {
+          fs::path csv = log;
+          csv += "-mem.csv";
+          if (!fs::exists(csv)) { continue; }
+          std::string output = read_file(csv);
+          if (output != outputs[0] && output != outputs[1]
+              && output != outputs[2])
+            {
+              std::cerr << "Error: " << csv.string() << " is not a whole "
+                        << "output" << std::endl;
+              ret_val = 1;
+            }
+        }
+    };
+  typedef std::chrono::steady_clock clock_type;
+  auto stop = clock_type::now() + std::chrono::seconds(3);
+  for (unsigned n = 0; ret_val == 0 && clock_type::now() < stop; ++n)
+    {
+      put_log(watched[0], logs[n % 2]);
+      if (n % 4 == 0) { put_log(watched[1 + n / 4 % 3], logs[0]); }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      check_outputs();
+    }
+  // The last version of the rewritten top log must win.
+  put_log(watched[0], logs[2]);
+  fs::path last = watched[0];
+  last += "-mem.csv";
+  stop = clock_type::now() + std::chrono::seconds(10);
+  while (clock_type::now() < stop
+         && (!fs::exists(last) || read_file(last) != outputs[2]))
+    { std::this_thread::sleep_for(std::chrono::milliseconds(50)); }
+  check_outputs();
+  if (read_file(last) != outputs[2])
+    {
+      std::cerr << "Error: " << last.string() << " is not the output of the "
+                << "last version of its top log" << std::endl;
+      ret_val = 1;
+    }
+
+  ::kill(child, SIGTERM);
+  int status = 0;
+  ::waitpid(child, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      std::cerr << "Error: top2csv --watch failed" << std::endl;
+      ret_val = 1;
+    }
+  std::string messages = read_file(errors);
+  if (!messages.empty())
+    {
+      std::cerr << "Error: top2csv --watch reported:\n" << messages;
+      ret_val = 1;
+    }
+  for (fs::recursive_directory_iterator it(tree), end; it != end; ++it)
+    {
+      if (it->path().extension() == ".tmp")
+        {
+          std::cerr << "Error: " << it->path().string() << " was left behind"
+                    << std::endl;
+          ret_val = 1;
+        }
+    }
+  fs::remove_all(dir);
+  return ret_val;
+}
@@ -0,0 +1,116 @@
+#include "throttle.hpp"
+
+#include <algorithm>
+#include <ctime>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+  /**
+   *  @return The CPU time used by all the threads of the process, in seconds.
+   */
+  double process_cpu_seconds()
+  {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel,
+                         &user))
+      { return 0; }
+    auto ticks = [](const FILETIME& t)
+      {
+        return (static_cast<unsigned long long>(t.dwHighDateTime) << 32)
+          | t.dwLowDateTime;
+      };
+    return (ticks(kernel) + ticks(user)) / 1e7; // 100 ns ticks
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) != 0) { return 0; }
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+  }
+}
+
+token_bucket::token_bucket(double rate, double burst,
+                           clock_type::time_point start)
+  : rate_(rate), burst_(burst), tokens_(burst), last_(start)
+{ }
+
+void token_bucket::take(double tokens)
+{
+  auto wait = pause(tokens, clock_type::now());
+  if (wait.count() > 0) { std::this_thread::sleep_for(wait); }
+}
+
+std::chrono::duration<double>
+token_bucket::pause(double tokens, clock_type::time_point now)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::chrono::duration<double> elapsed = now - last_;
+  if (elapsed.count() > 0)
+    {
+      last_ = now;
+      tokens_ = std::min(burst_, tokens_ + rate_ * elapsed.count());
+    }
+  tokens_ -= tokens;
+  return std::chrono::duration<double>(tokens_ < 0 ? -tokens_ / rate_ : 0);
+}
+
+resource_limits::resource_limits(double max_cpu, double max_io)
+  : last_cpu_(process_cpu_seconds())
+{
+  // Up to a second of work can be done at full speed after a pause.
+  if (max_cpu > 0)
+    { cpu_.reset(new token_bucket(max_cpu / 100, max_cpu / 100)); }
+  if (max_io > 0)
+    { io_.reset(new token_bucket(max_io * 1048576, max_io * 1048576)); }
+}
+
+void resource_limits::consumed(std::size_t bytes)
+{
+  if (io_) { io_->take(static_cast<double>(bytes)); }
+  if (cpu_)
+    {
+      double used;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double now = process_cpu_seconds();
+        used = now - last_cpu_;
+        last_cpu_ = now;
+      }
+      if (used > 0) { cpu_->take(used); }
+    }
+}
+
+bool set_idle_priority()
+{
+#ifdef _WIN32
+  return SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN)
+    != 0;
+#else
+  bool ok = true;
+#ifdef __linux__
+  // ioprio_set has no glibc wrapper: class 3 is idle, shifted by 13 bits.
+  const int IOPRIO_WHO_PROCESS = 1, IOPRIO_CLASS_IDLE = 3;
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << 13)
+      != 0)
+    { ok = false; }
+#endif
+#ifdef SCHED_IDLE
+  sched_param param{};
+  if (sched_setscheduler(0, SCHED_IDLE, &param) != 0) { ok = false; }
+#else
+  if (setpriority(PRIO_PROCESS, 0, 19) != 0) { ok = false; }
+#endif
+  return ok;
+#endif
+}
@@ -0,0 +1,90 @@
+#ifndef TOP2CSV_THROTTLE_HPP
+#define TOP2CSV_THROTTLE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+/**
+ *  A token bucket: tokens accumulate at a fixed rate, up to a burst, and are
+ *  taken by the threads doing the work.  A thread taking more tokens than
+ *  there are leaves the bucket in debt and sleeps until the debt would be
+ *  paid back, so that the threads together never go faster than the rate
+ *  for long, however many there are.
+ */
+class token_bucket
+{
+public:
+  typedef std::chrono::steady_clock clock_type;
+
+  /**
+   *  @param rate Tokens added per second.
+   *  @param burst Tokens that can accumulate while nothing is taken.
+   *  @param start When the bucket is full.
+   */
+  token_bucket(double rate, double burst,
+               clock_type::time_point start = clock_type::now());
+
+  /**
+   *  Takes tokens and sleeps for the pause they call for.
+   */
+  void take(double tokens);
+
+  /**
+   *  Takes tokens at the time now, without sleeping.
+   *
+   *  @return How long the taker must pause for the debt to be paid back.
+   */
+  std::chrono::duration<double> pause(double tokens,
+                                      clock_type::time_point now);
+
+private:
+  std::mutex mutex_;
+  double rate_;
+  double burst_;
+  double tokens_;
+  clock_type::time_point last_;
+};
+
+/**
+ *  The limits of --max-cpu and --max-io, enforced by the threads reading,
+ *  decompressing, parsing and formatting the top logs: each time one of them
+ *  has consumed a buffer or formatted a range of rows, it reports the bytes
+ *  read, if any, and the bucket of the CPU is charged with the CPU time the
+ *  whole process used since the last report.
+ */
+class resource_limits
+{
+public:
+  /**
+   *  @param max_cpu Percentage of one processor, 0 for no limit.
+   *  @param max_io MB read per second, 0 for no limit.
+   */
+  resource_limits(double max_cpu, double max_io);
+
+  /**
+   *  Reports bytes read and parsed, and sleeps if a limit was exceeded.  Can
+   *  be called from several threads.
+   */
+  void consumed(std::size_t bytes);
+
+private:
+  std::unique_ptr<token_bucket> cpu_; // in seconds of CPU time
+  std::unique_ptr<token_bucket> io_;  // in bytes
+  std::mutex mutex_;
+  double last_cpu_;
+};
+
+/**
+ *  Gives the whole process the lowest CPU and I/O priorities, so that it only
+ *  uses what other processes leave: the SCHED_IDLE policy and the idle I/O
+ *  class on Linux, the highest nice value on other Unix systems, and the
+ *  background mode on Windows.  Threads started afterwards inherit them, so
+ *  it must be called before any thread is started.
+ *
+ *  @return false if the priorities could not be lowered.
+ */
+bool set_idle_priority();
+
+#endif // TOP2CSV_THROTTLE_HPP
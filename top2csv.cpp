@@ -1,108 +1,536 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <regex>
+#include <set>
+#include <thread>
+#include <sys/stat.h>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include "alerts.hpp"
+#include "archive.hpp"
+#include "chart.hpp"
+#include "correlate.hpp"
+#include "discovery.hpp"
+#include "format.hpp"
+#include "gzindex.hpp"
+#include "heatmap.hpp"
+#include "join.hpp"
+#include "ioplan.hpp"
+#include "output.hpp"
+#include "parser.hpp"
+#include "presets.hpp"
+#include "progress.hpp"
+#include "query.hpp"
+#include "reader.hpp"
+#include "summary.hpp"
+#include "throttle.hpp"
+#include "tune.hpp"
+#include "watch.hpp"
 
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
-struct row_type
+namespace
 {
-  int hour;
-  int min;
-  int sec;
-  std::vector<float> columns;
-};
+  volatile std::sig_atomic_t stop_requested = 0;
 
-const int VIRT_COL = 4;
-const int CPU_COL = 8;
+  extern "C" void request_stop(int) { stop_requested = 1; }
+
+  std::mutex console_mutex;
+
+  // Whether the top logs found and the outputs written are listed.
+  bool list_files = true;
+
+  // The --max-cpu and --max-io limits, if any.
+  resource_limits* limits = nullptr;
+
+  // Bytes read by stream_and_print between two reports to the limits.
+  const std::size_t LIMITS_REPORT_BYTES = 1 << 20;
+
+  // Top logs --tune measures, at most.
+  const std::size_t TUNE_SAMPLE_LOGS = 16;
+
+  /**
+   *  The device and inode of a file, which tell a log renamed by log
+   *  rotation from the new log created under its name.  Without inodes, as
+   *  on Windows, they are always the same.
+   */
+  struct file_identity
+  {
+    dev_t device;
+    ino_t inode;
+
+    bool operator!=(const file_identity& other) const
+    { return device != other.device || inode != other.inode; }
+  };
+
+  /**
+   *  @return false if the file does not exist or cannot be accessed.
+   */
+  bool identify(const std::string& path, file_identity& identity)
+  {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) { return false; }
+    identity = file_identity{st.st_dev, st.st_ino};
+    return true;
+  }
+}
 
 /**
- *  Parse a top log from std::cin and produces the CSV output on std::cout.
+ *  @return Where the output for a top log found under root is written: next
+ *          to the top log, or at the same relative location under
+ *          output_root when it is not empty.
+ */
+fs::path output_path_for(const fs::path& log, const fs::path& root,
+                         const fs::path& output_root, int top_column)
+{
+  fs::path output = output_root.empty() ? log
+    : output_root / log.lexically_relative(root);
+  if (top_column == VIRT_COL) { output += "-mem.csv"; }
+  else { output += "-cpu.csv"; }
+  return output;
+}
+
+/**
+ *  Writes the rows of a top log into a temporary output file and queues it
+ *  for publication in the batch.  Can be called from several threads at
+ *  once.
  *
- *  Since it's using the standard input and output for convenience, necessary
- *  piping needs to be done before the function is called by the program.
+ *  @return false if the output could not be written.
+ */
+bool write_output(const fs::path& output,
+                  const std::vector<std::string>& processes, int top_column,
+                  const std::vector<row_type>& rows, output_batch& batch)
+{
+  boost::system::error_code ec;
+  fs::create_directories(output.parent_path(), ec);
+  if (ec)
+    {
+      std::lock_guard<std::mutex> lock(console_mutex);
+      std::cerr << "Error creating directory: "
+                << output.parent_path().string() << std::endl;
+      return false;
+    }
+  fs::path tmp = output_batch::temporary_path(output);
+  std::ofstream ofs(tmp.string());
+  if (!ofs)
+    {
+      std::lock_guard<std::mutex> lock(console_mutex);
+      std::cerr << "Error opening file: " << tmp.string() << std::endl;
+      return false;
+    }
+  if (list_files)
+    {
+      std::lock_guard<std::mutex> lock(console_mutex);
+      std::cout << "Writing: " << output.string() << std::endl;
+    }
+  print_rows(ofs, processes, top_column, rows);
+  ofs.close();
+  if (!ofs)
+    {
+      std::lock_guard<std::mutex> lock(console_mutex);
+      std::cerr << "Error writing file: " << tmp.string() << std::endl;
+      fs::remove(tmp, ec);
+      return false;
+    }
+  return batch.add(output, tmp);
+}
+
+/**
+ *  Converts a top log into a temporary output file and queues it for
+ *  publication in the batch.  Can be called from several threads at once.
  *
- *  @param processes A list of process names to be analysed.
- *  @param top_column The column from the top log to be collected. Only 4 (VIRT)
- *                    and 8 (%CPU) are supported.
- *  @return 0 if everything went fine, 1 otherwise.
+ *  @param stats When not null, the rows of the top log are added to it.
+ *  @return false if the output could not be written.
  */
-int parse_and_print(std::vector<std::string> processes, int top_column)
+bool convert_log(const fs::path& log, const fs::path& output,
+                 const std::vector<std::string>& processes, int top_column,
+                 const read_options& reading, output_batch& batch,
+                 summary* stats)
 {
+  file_reader reader(reading);
+  // If the file cannot be opened, it is silently skipped.
+  if (!reader.open(log)) { return true; }
+  std::istream ifs(&reader);
+  // Silently ignore errors here.
   std::vector<row_type> rows;
-  std::string line;
-  while (std::getline(std::cin, line))
-    {
-      static const std::regex
-        top{"^top - ([0-2][0-9]):([0-5][0-9]):([0-5][0-9])"};
-      static const std::regex tokenizer{"[^ \t]+"};
-      std::smatch subs;
-      if (regex_search(line, subs, top))
-        {
-          // Converts to ints, it takes less space
-          row_type row {std::stoi(subs[1]),
-              std::stoi(subs[2]),
-              std::stoi(subs[3]),
-              std::vector<float>(processes.size(), 0.f)};
-          rows.push_back(row);
+  parse_log(ifs, processes, top_column, rows);
+  if (reader.failed())
+    {
+      std::lock_guard<std::mutex> lock(console_mutex);
+      std::cerr << "Error reading file: " << log.string() << std::endl;
+      return false;
+    }
+  if (stats) { stats->add(processes, rows); }
+  return write_output(output, processes, top_column, rows, batch);
+}
+
+/**
+ *  Converts the top logs of a tar archive, compressed with gzip or not, as
+ *  the archive is read: nothing is extracted, and each top log is parsed
+ *  straight from the decompressed stream.  The outputs are written under
+ *  output_root as for the top logs of a directory, or into a new tar archive
+ *  when output_tar is not empty.
+ *
+ *  @param stats When not null, the rows of the top logs are added to it.
+ *  @param progress When not null, told about every top log converted.
+ *  @return false if the archive could not be read or an output could not be
+ *          written.
+ */
+bool convert_archive(const fs::path& archive, const fs::path& output_root,
+                     const fs::path& output_tar,
+                     const std::vector<std::string>& processes, int top_column,
+                     const read_options& reading, const shard_spec& shard,
+                     output_batch& batch, summary* stats,
+                     progress_reporter* progress)
+{
+  file_reader file(reading);
+  if (!file.open(archive))
+    {
+      std::cerr << "Error opening file: " << archive.string() << std::endl;
+      return false;
+    }
+  bool compressed = is_gzip_file(archive);
+  gzip_reader gunzip;
+  if (compressed && !gunzip.open(file))
+    {
+      std::cerr << "Error: this build does not support compression."
+                << std::endl;
+      return false;
+    }
+  tar_reader tar(compressed ? static_cast<std::streambuf&>(gunzip) : file);
+
+  std::ofstream tar_file;
+  std::unique_ptr<tar_writer> writer;
+  fs::path tar_tmp;
+  if (!output_tar.empty())
+    {
+      tar_tmp = output_batch::temporary_path(output_tar);
+      tar_file.open(tar_tmp.string(), std::ios::binary);
+      if (!tar_file)
+        {
+          std::cerr << "Error opening file: " << output_tar.string()
+                    << std::endl;
+          return false;
         }
-      else
+      writer.reset(new tar_writer(tar_file));
+    }
+
+  bool ok = true;
+  tar_entry entry;
+  while (tar.next(entry))
+    {
+      // As relative to the root of a directory, without a leading "./".
+      fs::path log;
+      for (auto&& part : fs::path(entry.path))
         {
-          if (rows.size() == 0)
-            {
-              std::cerr << "Malformed top log; logs must start by \"top - \".\n";
-              return 1;
-            }
-          auto row = &rows.back();
-          std::regex_token_iterator<std::string::iterator> it
-          {line.begin(), line.end(), tokenizer};
-          std::regex_token_iterator<std::string::iterator> end;
-          int count = 0;
-          std::string possibly_val, possibly_proc;
-          while (it != end)
-            {
-              if (count == top_column) { possibly_val = *it; }
-              if (count == 11) { possibly_proc = *it; }
-              ++it;
-              ++count;
-            }
-          if (count > 11)
+          if (part != ".") { log /= part; }
+        }
+      if (!entry.regular || !is_top_log(log) || !in_shard(log, shard))
+        { continue; }
+      if (!is_safe_entry_path(log))
+        {
+          std::cerr << "Warning: skipping " << entry.path
+                    << ", which is not a relative path" << std::endl;
+          continue;
+        }
+      if (list_files)
+        {
+          std::cout << "Found: " << archive.string() << ":" << entry.path
+                    << std::endl;
+        }
+      std::istream in(&tar);
+      std::vector<row_type> rows;
+      parse_log(in, processes, top_column, rows);
+      if (tar.failed()) { break; }
+      if (stats) { stats->add(processes, rows); }
+      fs::path output = output_path_for(output_root / log, output_root,
+                                        output_root, top_column);
+      if (writer)
+        {
+          if (list_files)
             {
-              auto found = std::find(processes.begin(), processes.end(),
-                                     possibly_proc);
-              if (found != processes.end())
-                {
-                  float val = std::stof(possibly_val);
-                  if (*--possibly_val.end() == 'm') { val *= 1024.0; }
-                  row->columns[found - processes.begin()] += val;
-                }
+              std::cout << "Writing: " << output_tar.string() << ":"
+                        << output.generic_string() << std::endl;
             }
+          std::ostringstream text;
+          print_rows(text, processes, top_column, rows);
+          writer->add(output.generic_string(), text.str(), entry.mtime);
+        }
+      else if (!write_output(output, processes, top_column, rows, batch))
+        { ok = false; }
+      if (progress) { progress->file_done(); }
+    }
+
+  bool read_ok = !tar.failed() && !file.failed()
+    && !(compressed && gunzip.failed());
+  if (!read_ok)
+    {
+      std::cerr << "Error reading file: " << archive.string() << std::endl;
+      ok = false;
+    }
+  if (writer)
+    {
+      // The new archive is only published if complete.
+      writer->finish();
+      tar_file.close();
+      boost::system::error_code ec;
+      if (!tar_file)
+        {
+          std::cerr << "Error writing file: " << tar_tmp.string()
+                    << std::endl;
+          fs::remove(tar_tmp, ec);
+          ok = false;
         }
+      else if (!read_ok)
+        { fs::remove(tar_tmp, ec); }
+      else if (!batch.add(output_tar, tar_tmp))
+        { ok = false; }
     }
+  return ok;
+}
 
-  std::cout << "Hour,Minute,Second";
-  for (auto&& p : processes) { std::cout << "," << p; }
-  std::cout << "\n";
-  std::cout << std::fixed;
-  if (top_column == VIRT_COL)
-    { std::cout << std::setprecision(0); }
+/**
+ *  Parse a top log from a file and produces its rows one snapshot at a time,
+ *  as soon as each snapshot is complete.
+ *
+ *  Unlike parse_and_print, nothing is kept in memory, so it is suitable for
+ *  logs that are still being written.  When following, the end of the file is
+ *  polled for new lines until SIGINT or SIGTERM is received.  A file
+ *  truncated (copytruncate log rotation) is read again from the start; a file
+ *  renamed (create log rotation) is read to its end, then the new file
+ *  created under its name is read from the start.
+ *
+ *  @param input_path The file to read from; empty for std::cin.
+ *  @param follow Whether to wait for more lines at the end of the file.
+ *  @param processes A list of process names to be analysed.
+ *  @param top_column The column from the top log to be collected.
+ *  @param sink Called with the row of each snapshot.
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int stream_and_print(const std::string& input_path, bool follow,
+                     const std::vector<std::string>& processes, int top_column,
+                     const std::function<void (const row_type&)>& sink)
+{
+  std::ifstream input_file;
+  file_identity opened{};
+  bool draining = false; // reading the rest of a renamed log
+  file_reader compressed_file;
+  gzip_reader gunzip;
+  std::istream gunzipped(&gunzip);
+  bool compressed = !input_path.empty() && is_gzip_file(input_path);
+  if (compressed)
+    {
+      if (!compressed_file.open(input_path) || !gunzip.open(compressed_file))
+        {
+          std::cerr << "Error opening file: " << input_path << std::endl;
+          return 1;
+        }
+      follow = false; // a compressed log is complete
+    }
+  else if (!input_path.empty())
+    {
+      input_file.open(input_path.c_str());
+      if (!input_file)
+        {
+          std::cerr << "Error opening file: " << input_path << std::endl;
+          return 1;
+        }
+      identify(input_path, opened);
+    }
   else
-    { std::cout << std::setprecision(1); }
-  for (auto&& row : rows)
+    { follow = false; } // a pipe that reached its end is closed for good
+  std::istream& in = input_path.empty() ? std::cin
+    : compressed ? gunzipped : input_file;
+
+  snapshot_parser parser(processes, top_column, sink);
+  std::string line, partial;
+  std::size_t unreported = 0;
+  while (!stop_requested)
+    {
+      if (std::getline(in, line))
+        {
+          unreported += line.size() + 1;
+          if (limits && unreported >= LIMITS_REPORT_BYTES)
+            {
+              limits->consumed(unreported);
+              unreported = 0;
+            }
+          partial += line;
+          if (in.eof()) { continue; } // unterminated; wait for the rest
+          if (!parser.feed(partial)) { return 1; }
+          partial.clear();
+          continue;
+        }
+      if (!follow) { break; }
+      in.clear();
+      if (draining)
+        {
+          // All that was written to the renamed log has been read.
+          if (!partial.empty() && !parser.feed(partial)) { return 1; }
+          partial.clear();
+          draining = false;
+          input_file.close();
+          input_file.open(input_path.c_str());
+          identify(input_path, opened);
+          continue;
+        }
+      file_identity current;
+      if (identify(input_path, current) && current != opened)
+        {
+          // Read the rest of the renamed log once more before switching.
+          draining = true;
+          continue;
+        }
+      boost::system::error_code ec;
+      auto size = fs::file_size(input_path, ec);
+      auto pos = in.tellg();
+      if (!ec && pos != std::streampos(-1)
+          && size < static_cast<std::uintmax_t>(pos))
+        {
+          input_file.close();
+          input_file.open(input_path.c_str());
+          identify(input_path, opened);
+          partial.clear();
+          continue;
+        }
+      std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+  if (!partial.empty() && !parser.feed(partial)) { return 1; }
+  parser.finish();
+  if (compressed && (gunzip.failed() || compressed_file.failed()))
     {
-      std::cout << row.hour << "," << row.min << "," << row.sec;
-      for (auto&& col : row.columns) { std::cout << "," << col; }
-      std::cout << "\n";
+      std::cerr << "Error reading file: " << input_path << std::endl;
+      return 1;
     }
-  std::cout.flush();
   return 0;
 }
 
+/**
+ *  Manages the program options of the merge command.
+ *
+ *  @return 0 is everything went fine, 1 otherwise.
+ */
+int merge_main(int argc, char **argv)
+{
+  std::string output_path;
+  po::options_description desc{"Usage: top2csv merge [options] summary...\n\n"
+                               "Merge the summaries written with --summary "
+                               "into a single summary.\n\nAllowed options"};
+  desc.add_options()
+    ("help,h", "Print this help")
+    ("output-file,o", po::value< std::string >(&output_path),
+     "Output file to write to, instead of stdout.")
+    ("summaries", po::value< std::vector<std::string> >(),
+     "Summary files to merge.  The option --summaries can be omitted.")
+    ;
+  po::positional_options_description p;
+  p.add("summaries", -1);
+  po::variables_map vm;
+  try
+    {
+      po::store(po::command_line_parser(argc, argv)
+                .options(desc).positional(p).run(), vm);
+      po::notify(vm);
+    }
+  catch (const po::error& e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+  if (vm.count("help"))
+    {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  if (!vm.count("summaries"))
+    {
+      std::cerr << "Error: at least one summary must be specified."
+                << std::endl;
+      return 1;
+    }
+  return merge_summaries(vm["summaries"].as<std::vector<std::string> >(),
+                         output_path);
+}
+
+/**
+ *  Manages the program options of the index command.
+ *
+ *  @return 0 is everything went fine, 1 otherwise.
+ */
+int index_main(int argc, char **argv)
+{
+  unsigned span_kib = 1024;
+  po::options_description desc{"Usage: top2csv index [options] log.gz...\n\n"
+                               "Build the checkpoint index of gzip "
+                               "compressed top logs, saved next to each of "
+                               "them with .idx appended, which --from and "
+                               "--to use to only decompress what they "
+                               "select.  Indexes are otherwise built by the "
+                               "first query.\n\nAllowed options"};
+  desc.add_options()
+    ("help,h", "Print this help")
+    ("span", po::value< unsigned >(&span_kib),
+     "KiB of decompressed log between two checkpoints.  Smaller spans make "
+     "larger indexes and less data to decompress.  Defaults to 1024.")
+    ("logs", po::value< std::vector<std::string> >(),
+     "Compressed top logs to index.  The option --logs can be omitted.")
+    ;
+  po::positional_options_description p;
+  p.add("logs", -1);
+  po::variables_map vm;
+  try
+    {
+      po::store(po::command_line_parser(argc, argv)
+                .options(desc).positional(p).run(), vm);
+      po::notify(vm);
+    }
+  catch (const po::error& e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+  if (vm.count("help"))
+    {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  if (!vm.count("logs"))
+    {
+      std::cerr << "Error: at least one log must be specified." << std::endl;
+      return 1;
+    }
+  int ret_val = 0;
+  for (auto&& log : vm["logs"].as<std::vector<std::string> >())
+    {
+      gz_index index;
+      if (!index.build(log, std::max(span_kib, 64u) << 10))
+        {
+          std::cerr << "Error reading file: " << log << std::endl;
+          ret_val = 1;
+          continue;
+        }
+      if (!index.save(gz_index::default_path(log)))
+        {
+          std::cerr << "Error writing file: "
+                    << gz_index::default_path(log).string() << std::endl;
+          ret_val = 1;
+          continue;
+        }
+      std::cout << "Indexed: " << log << " (" << index.checkpoints().size()
+                << " checkpoints)" << std::endl;
+    }
+  return ret_val;
+}
+
 /**
  *  Manages program options and calls parse_and_print as needed.
  *
@@ -110,6 +538,11 @@ int parse_and_print(std::vector<std::string> processes, int top_column)
  */
 int main (int argc, char **argv)
 {
+  if (argc > 1 && std::string(argv[1]) == "merge")
+    { return merge_main(argc - 1, argv + 1); }
+  if (argc > 1 && std::string(argv[1]) == "index")
+    { return index_main(argc - 1, argv + 1); }
+
   std::cout.sync_with_stdio(false);
   std::cin.sync_with_stdio(false);
   std::cin.tie(nullptr);
@@ -117,6 +550,39 @@ int main (int argc, char **argv)
   std::string input_path;
   std::string output_path;
   std::string find_path;
+  std::string output_dir;
+  std::string output_tar;
+  std::size_t fsync_batch = 64;
+  std::string rotate_spec;
+  std::string watch_path;
+  std::string watch_status;
+  unsigned watch_workers = std::max(std::thread::hardware_concurrency(), 1u);
+  unsigned format_threads = watch_workers;
+  unsigned decompress_threads = watch_workers;
+  unsigned watch_debounce_ms = 5000;
+  unsigned watch_rescan = 300;
+  std::string shard_spec_text;
+  std::string summary_path;
+  unsigned device_readers = 1;
+  unsigned read_buffer_kib = 0;
+  double max_cpu = 0;
+  double max_io = 0;
+  std::string config_path;
+  std::string from_text;
+  std::string to_text;
+  unsigned resample_step = 0;
+  std::string chart_path;
+  unsigned chart_width = 800;
+  std::string correlate_path;
+  std::string heatmap_path;
+  std::string alert_rules_path;
+  std::string alert_target;
+  unsigned heatmap_window = 3600;
+  std::string heatmap_scale_text = "log";
+  unsigned heatmap_buckets = 20;
+  unsigned join_tolerance = 0;
+  std::string preset_file;
+  std::string preset_cache;
 
   po::options_description desc{"Allowed options"};
   desc.add_options()
@@ -127,15 +593,190 @@ int main (int argc, char **argv)
      "  One of --cpu or --mem must be specified, only.")
     ("find,f", po::value< std::string >(&find_path),
      "Search for all top.log[.*] files and generate outputs at the locations "
-     "where the files have been found.  When --find is used, --input-file and "
-     "--output-file are ignored.")
+     "where the files have been found, or under --output-dir.  When --find "
+     "is used, --input-file and --output-file are ignored.  A tar archive, "
+     "compressed with gzip or not (.tar, .tar.gz or .tgz), can be searched "
+     "instead of a directory: its top logs are converted as it is read, "
+     "without extracting it, and the outputs are written under --output-dir "
+     "or into --output-tar.")
+    ("output-dir,d", po::value< std::string >(&output_dir),
+     "With --find, write the outputs under this directory instead of next to "
+     "the top logs.  The directory structure found under the --find root is "
+     "mirrored.")
+    ("output-tar", po::value< std::string >(&output_tar),
+     "With --find on a tar archive, write the outputs into this new tar "
+     "archive instead of under --output-dir, named after their top logs in "
+     "the searched archive.")
+    ("fsync-batch", po::value< std::size_t >(&fsync_batch),
+     "With --find, number of outputs written before they are synced to disk "
+     "and renamed to their final names, together.  Outputs are always written "
+     "to temporary files first, so that no partial output is ever left "
+     "behind.  Defaults to 64.")
     ("input-file,i", po::value< std::string >(&input_path),
-     "Input file to read from, instead of stdin.")
+     "Input file to read from, instead of stdin.  A file ending with .gz is "
+     "decompressed as it is read.")
     ("output-file,o", po::value< std::string >(&output_path),
      "Output file to write to, instead of stdout.")
+    ("format-threads", po::value< unsigned >(&format_threads),
+     "When converting a single top log, number of threads formatting the "
+     "rows, which also write them to the output file at once.  1 formats and "
+     "writes them in order on one thread.  Defaults to the number of "
+     "processors.")
+    ("shard", po::value< std::string >(&shard_spec_text),
+     "With --find, only convert the top logs of shard i out of N, given as "
+     "'i/N'.  Top logs are assigned to shards from their path under the "
+     "--find root, so that N processes given the same N and each i from 1 "
+     "to N convert every top log exactly once.")
+    ("summary", po::value< std::string >(&summary_path),
+     "With --find, write to this file the statistics of each process over all "
+     "the top logs converted.  The summaries of several shards can then be "
+     "combined with 'top2csv merge'.")
+    ("device-readers", po::value< unsigned >(&device_readers),
+     "With --find, number of top logs read at the same time from each "
+     "storage device.  Top logs are read device by device, in the order they "
+     "are laid out on the device, so 1 is best for rotating disks.  Defaults "
+     "to 1.")
+    ("direct-io",
+     "With --find, --watch or --join, read the top logs with direct I/O, "
+     "bypassing the page cache, so that scanning a large archive does not "
+     "evict the data of other programs from memory.")
+    ("max-cpu", po::value< double >(&max_cpu),
+     "Pause reading, decompressing, parsing and formatting whenever needed to "
+     "use, on average, at most this percentage of one processor.  Above 100, "
+     "several processors can be used.")
+    ("max-io", po::value< double >(&max_io),
+     "Pause reading whenever needed to read, on average, at most this many "
+     "MB per second.")
+    ("idle",
+     "Run with the lowest CPU and I/O priorities, so as to only use what the "
+     "other processes of the host leave: SCHED_IDLE and the idle I/O class on "
+     "Linux, the highest nice value on other Unix systems, and the "
+     "background mode on Windows.")
+    ("read-buffer", po::value< unsigned >(&read_buffer_kib),
+     "KiB read from a top log at once.  Defaults to 1024, or to 4096 with "
+     "--direct-io.")
+    ("tune",
+     "Before converting, measure on a sample of the top logs to convert how "
+     "fast they are read and parsed, and pick --device-readers, "
+     "--read-buffer and --format-threads from the measures, unless they are "
+     "given on the command line.  With --config, the values picked are saved "
+     "to the configuration file for later runs.")
+    ("config", po::value< std::string >(&config_path),
+     "Read options from this file, one 'name = value' per line, such as "
+     "'device-readers = 4'.  Options on the command line take precedence.")
+    ("stats",
+     "At the end, print on stderr the pipeline parameters used, where they "
+     "come from, and the time taken.")
+    ("progress",
+     "With --find, print on stderr, every second, the bytes and top logs "
+     "processed out of those found, the throughput and the estimated time "
+     "left, instead of listing the top logs found and the outputs written.")
+    ("watch,w", po::value< std::string >(&watch_path),
+     "Watch a directory tree and convert top.log[.*] files as soon as they "
+     "are rotated or copied into it, until SIGINT or SIGTERM is received.  "
+     "Outputs are written as with --find, including --output-dir.  Top logs "
+     "with a missing or outdated output are converted at startup.")
+    ("watch-workers", po::value< unsigned >(&watch_workers),
+     "With --watch, number of top logs converted at the same time.  Defaults "
+     "to the number of processors.")
+    ("watch-debounce", po::value< unsigned >(&watch_debounce_ms),
+     "With --watch, milliseconds without any change to a top log before it is "
+     "converted.  Defaults to 5000.")
+    ("watch-rescan", po::value< unsigned >(&watch_rescan),
+     "With --watch, seconds between two full scans of the directory tree, "
+     "which catch changes the system did not notify.  Defaults to 300.")
+    ("watch-status", po::value< std::string >(&watch_status),
+     "With --watch, file rewritten every second with the queue depth, the "
+     "number of conversions done and the conversion lag.")
+    ("follow,F",
+     "Keep reading the input file as it grows and write each row as soon as "
+     "its snapshot is complete.  Stops on SIGINT or SIGTERM.  Not compatible "
+     "with --find.")
+    ("rotate-output", po::value< std::string >(&rotate_spec),
+     "Requires --output-file.  Close the output and start a new one when the "
+     "hour changes ('hourly'), the day changes ('daily') or the output would "
+     "grow beyond a size in bytes (suffixes K, M and G are accepted).  Closed "
+     "outputs are renamed <output-file>.1, <output-file>.2, and so on.")
+    ("rotate-compress",
+     "With --rotate-output, gzip the closed outputs in the background.")
+    ("from", po::value< std::string >(&from_text),
+     "Only output the snapshots from this time, given as "
+     "[<day>+]HH:MM[:SS].  Without a day, the first time this time of day "
+     "occurs in the log is used; days are counted from 0, the day the log "
+     "starts.  On a gzip compressed input file, only the part selected is "
+     "decompressed, found with the index of the file, <input-file>.idx, "
+     "which is built first if missing or stale (see 'top2csv index').  Not "
+     "compatible with --find, --watch and --follow.")
+    ("decompress-threads", po::value< unsigned >(&decompress_threads),
+     "With --from or --to on a gzip compressed input file, number of threads "
+     "decompressing and parsing parts of it at once.  Defaults to the number "
+     "of processors.")
+    ("to", po::value< std::string >(&to_text),
+     "Only output the snapshots up to this time, given as for --from.  "
+     "Without a day, the first time this time of day occurs after --from "
+     "is used.")
+    ("resample", po::value< unsigned >(&resample_step),
+     "Output the average of the snapshots over periods of this many "
+     "seconds instead of every snapshot.  Not compatible with --find, "
+     "--watch and --follow.")
+    ("chart", po::value< std::string >(&chart_path),
+     "Also draw the values of each process over time to this SVG file, one "
+     "plot per process.  Each series is downsampled to the width of the "
+     "plots while the log is read, so logs of any length are drawn quickly.  "
+     "Not compatible with --find, --watch, --from, --to and --resample.")
+    ("chart-width", po::value< unsigned >(&chart_width),
+     "With --chart, width of the plots in pixels.  Defaults to 800.")
+    ("correlate", po::value< std::string >(&correlate_path),
+     "Also write to this file the Pearson correlation between the values of "
+     "every pair of processes, computed as the log is read.  The matrix is "
+     "drawn as a heatmap if the file name ends with .svg and written as CSV "
+     "otherwise.  Not compatible with --find, --watch, --from, --to and "
+     "--resample.")
+    ("alert-rules", po::value< std::string >(&alert_rules_path),
+     "Raise alerts from the rules of this file, one per line, such as "
+     "'dbserver VIRT > 3g for 5min clear 2.5g' or 'SigLoc CPU > 90 for 3 "
+     "snapshots', checked on each snapshot as it is read.  Most useful with "
+     "--follow.  Not compatible with --find, --watch, --from, --to and "
+     "--resample.")
+    ("alert-output", po::value< std::string >(&alert_target),
+     "With --alert-rules, append the alerts to this file, or send them to the "
+     "local socket <path> if given as unix:<path>.  Defaults to the standard "
+     "error.")
+    ("heatmap", po::value< std::string >(&heatmap_path),
+     "Also write to this file how the values of each process are distributed "
+     "over time: for each time window, the number of snapshots in each range "
+     "of values.  Written as CSV, or drawn if the file name ends with .svg.  "
+     "Not compatible with --find, --watch, --from, --to and --resample.")
+    ("heatmap-window", po::value< unsigned >(&heatmap_window),
+     "With --heatmap, seconds per time window.  Defaults to 3600.")
+    ("heatmap-scale", po::value< std::string >(&heatmap_scale_text),
+     "With --heatmap, 'log' for ranges of values doubling from 1 up, or "
+     "'linear:<max>' for --heatmap-buckets ranges of the same size from 0 to "
+     "max.  Defaults to 'log'.")
+    ("heatmap-buckets", po::value< unsigned >(&heatmap_buckets),
+     "With --heatmap-scale linear:<max>, the number of ranges.  Defaults to "
+     "20.")
+    ("join", po::value< std::vector<std::string> >()->composing(),
+     "Top log of a host to write side by side with the top logs of other "
+     "hosts; give --join once per host.  Columns are named "
+     "<host>:<process>, where the host is the name of the directory of the "
+     "top log.  Each top log is parsed on its own thread.  Not compatible "
+     "with the other modes.")
+    ("join-tolerance", po::value< unsigned >(&join_tolerance),
+     "With --join, seconds by which the snapshots of different hosts may "
+     "differ and still be written on the same row.  Defaults to 0.")
     ("preset,p", po::value<std::string>(),
-     "Preset is one of 'all', 'ats', 'cms', 'dcs', 'ecs', or 'sms'.  "
+     "Preset is one of 'all', 'ats', 'cms', 'dcs', 'ecs', or 'sms', or a "
+     "preset of --preset-file.  "
      "When --preset is used, any processes specified are added to the preset.")
+    ("preset-file", po::value< std::string >(&preset_file),
+     "INI file with more presets: each [section] is a preset, followed by its "
+     "processes separated by spaces or commas.  A preset with the name of a "
+     "built-in preset replaces it.")
+    ("preset-cache", po::value< std::string >(&preset_cache),
+     "With --preset-file, binary file where the presets read from the preset "
+     "file are saved, and read back instead of the preset file for as long as "
+     "the preset file does not change.")
     ("processes", po::value< std::vector<std::string> >(),
      "List of processes used to generate information."
      "  At least one process must be specified.  The option --processes can be "
@@ -145,17 +786,34 @@ int main (int argc, char **argv)
   p.add("processes", -1);
   po::variables_map vm;
 
+  std::set<std::string> on_command_line;
+
   try
     {
       po::store(po::command_line_parser(argc, argv)
                 .options(desc).positional(p).run(), vm);
+      for (auto&& option : vm) { on_command_line.insert(option.first); }
+      if (vm.count("config"))
+        {
+          // Values already stored, from the command line, are kept.
+          std::string config = vm["config"].as<std::string>();
+          std::ifstream config_file(config.c_str());
+          if (config_file)
+            { po::store(po::parse_config_file(config_file, desc), vm); }
+          else if (!vm.count("tune"))
+            {
+              std::cerr << "Error opening file: " << config << std::endl;
+              return 1;
+            }
+        }
       po::notify(vm);
     }
-  catch (const po::unknown_option& e)
+  catch (const po::error& e)
     {
       std::cerr << "Error: " << e.what() << std::endl;
       return 1;
     }
+  auto start_time = std::chrono::steady_clock::now();
 
   if (vm.count("help"))
   {
@@ -176,58 +834,13 @@ int main (int argc, char **argv)
   std::vector<std::string> processes;
   if (vm.count("preset") == 1)
     {
+      preset_registry presets;
+      if (vm.count("preset-file")
+          && !presets.load(preset_file, vm.count("preset-cache")
+                           ? fs::path(preset_cache) : fs::path()))
+        { return 1; }
       std::string preset = vm["preset"].as<std::string>();
-      if (preset == "all")
-        processes = {"ascmanager", "BmfCol", "BmfExcReceiver", "BmfExcSender",
-                     "CctCtl", "ctlkcmdpro", "daccompms", "daccomrss",
-                     "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
-                     "dpckvarmgr", "EcsSmc", "EcsSys", "ftsserver", "HdvServer",
-                     "historyserver", "inputmgr", "LoginServer", "opmserver",
-                     "PasCtl", "PisCtl", "RadCom", "RadCtl", "RadPgr",
-                     "ReaPrgServer", "scsalarmserver", "scsctlgrcserver",
-                     "SigCtlServer", "SigDpc", "SigLdt", "SigLoc",
-                     "taonameserv", "TelSvr", "tmcpex", "tmcsup" };
-      if (preset == "ats")
-        processes = {"ascmanager", "BmfCol", "ctlkcmdpro",
-                     "daccompms", "daccomrss", "daccontrol", "dbpoller",
-                     "dbserver", "dpckeqpmgr", "dpckvarmgr", "ftsserver",
-                     "HdvServer", "inputmgr", "ReaPrgServer", "scsalarmserver",
-                     "SigCtlServer", "SigDpc", "SigLdt", "SigLoc",
-                     "taonameserv", "tmcpex", "tmcsup" };
-      if (preset == "cms")
-        processes = {"ascmanager", "BmfCol", "BmfExcReceiver", "BmfExcSender",
-                     "CctCtl", "ctlkcmdpro", "daccompms", "daccontrol",
-                     "dbpoller", "dbserver", "dpckeqpmgr", "dpckvarmgr",
-                     "ftsserver", "HdvServer", "historyserver", "inputmgr",
-                     "LoginServer", "opmserver", "PasCtl", "PisCtl", "RadCom",
-                     "RadCtl", "ReaPrgServer", "scsalarmserver",
-                     "scsctlgrcserver", "taonameserv", "TelSvr"};
-      if (preset == "sms")
-        processes = {"ascmanager", "BmfCol",
-                     "CctCtl", "ctlkcmdpro", "daccompms", "daccomrss",
-                     "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
-                     "dpckvarmgr", "EcsSmc", "EcsSys", "ftsserver", "HdvServer",
-                     "historyserver", "inputmgr", "LoginServer", "PasCtl",
-                     "PisCtl", "RadCom", "RadCtl", "RadPgr", "ReaPrgServer",
-                     "scsalarmserver", "scsctlgrcserver", "SigCtlServer",
-                     "SigDpc", "SigLdt", "SigLoc", "taonameserv", "TelSvr"};
-      if (preset == "dcs")
-        processes = {"ascmanager", "BmfCol",
-                     "CctCtl", "ctlkcmdpro", "daccompms", "daccomrss",
-                     "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
-                     "dpckvarmgr", "EcsSmc", "EcsSys", "ftsserver", "HdvServer",
-                     "historyserver", "inputmgr", "LoginServer", "PasCtl",
-                     "PisCtl", "RadCom", "RadCtl", "RadPgr", "ReaPrgServer",
-                     "scsalarmserver", "scsctlgrcserver", "SigCtlServer",
-                     "SigDpc", "SigLdt", "SigLoc", "taonameserv", "TelSvr",
-                     "tmcsup"};
-      if (preset == "ecs")
-        processes = {"ascmanager", "BmfCol", "daccompms", "daccomrss",
-                     "daccontrol", "dbpoller", "dbserver", "dpckeqpmgr",
-                     "dpckvarmgr", "EcsSmc", "EcsSys", "HdvServer", "inputmgr",
-                     "ReaPrgServer", "scsalarmserver", "scsctlgrcserver",
-                     "taonameserv" };
-      if (processes.size() == 0)
+      if (!presets.find(preset, processes))
         {
           std::cerr << "Error: unknown preset '" << preset << "'" << std::endl;
           return 1;
@@ -248,10 +861,262 @@ int main (int argc, char **argv)
       return 1;
     }
 
+  rotation_policy rotation{rotation_policy::none, 0};
+  if (vm.count("rotate-output"))
+    {
+      if (!parse_rotation(rotate_spec, rotation))
+        {
+          std::cerr << "Error: invalid rotation '" << rotate_spec << "'"
+                    << std::endl;
+          return 1;
+        }
+      if (!vm.count("output-file"))
+        {
+          std::cerr << "Error: --rotate-output requires --output-file."
+                    << std::endl;
+          return 1;
+        }
+    }
+#ifndef TOP2CSV_HAVE_ZLIB
+  if (vm.count("rotate-compress"))
+    {
+      std::cerr << "Error: this build does not support compression."
+                << std::endl;
+      return 1;
+    }
+#endif
+  if ((vm.count("find") || vm.count("watch"))
+      && (vm.count("follow") || vm.count("rotate-output")))
+    {
+      std::cerr << "Error: --follow and --rotate-output cannot be used with "
+                << "--find or --watch." << std::endl;
+      return 1;
+    }
+  shard_spec shard{0, 0};
+  if (vm.count("shard") && !parse_shard(shard_spec_text, shard))
+    {
+      std::cerr << "Error: invalid shard '" << shard_spec_text << "'"
+                << std::endl;
+      return 1;
+    }
+  if ((vm.count("shard") || vm.count("summary") || vm.count("progress")
+       || vm.count("output-tar"))
+      && !vm.count("find"))
+    {
+      std::cerr << "Error: --shard, --summary, --progress and --output-tar "
+                << "require --find." << std::endl;
+      return 1;
+    }
+  if (vm.count("progress")) { list_files = false; }
+  if (vm.count("find") && vm.count("watch"))
+    {
+      std::cerr << "Error: only one of --find or --watch can be specified."
+                << std::endl;
+      return 1;
+    }
+
+  time_query query{false, {-1, 0}, false, {-1, 0}, resample_step};
+  if (vm.count("from"))
+    {
+      query.has_from = true;
+      if (!parse_time_spec(from_text, query.from))
+        {
+          std::cerr << "Error: invalid time '" << from_text << "'" << std::endl;
+          return 1;
+        }
+    }
+  if (vm.count("to"))
+    {
+      query.has_to = true;
+      if (!parse_time_spec(to_text, query.to))
+        {
+          std::cerr << "Error: invalid time '" << to_text << "'" << std::endl;
+          return 1;
+        }
+    }
+  bool querying = query.has_from || query.has_to || query.step > 0;
+  if (querying && (vm.count("find") || vm.count("watch") || vm.count("follow")
+                   || vm.count("rotate-output")))
+    {
+      std::cerr << "Error: --from, --to and --resample cannot be used with "
+                << "--find, --watch, --follow or --rotate-output." << std::endl;
+      return 1;
+    }
+
+  std::unique_ptr<process_chart> chart;
+  if (vm.count("chart"))
+    {
+      if (vm.count("find") || vm.count("watch") || querying)
+        {
+          std::cerr << "Error: --chart cannot be used with --find, --watch, "
+                    << "--from, --to or --resample." << std::endl;
+          return 1;
+        }
+      chart.reset(new process_chart(processes, top_column == VIRT_COL
+                                    ? "KiB" : "%", chart_width));
+    }
+  std::unique_ptr<correlation> correlated;
+  if (vm.count("correlate"))
+    {
+      if (vm.count("find") || vm.count("watch") || querying)
+        {
+          std::cerr << "Error: --correlate cannot be used with --find, "
+                    << "--watch, --from, --to or --resample." << std::endl;
+          return 1;
+        }
+      correlated.reset(new correlation(processes.size()));
+    }
+  std::unique_ptr<value_heatmap> heatmap;
+  if (vm.count("heatmap"))
+    {
+      bucket_scale scale;
+      if (!parse_bucket_scale(heatmap_scale_text, heatmap_buckets, scale))
+        {
+          std::cerr << "Error: invalid heatmap scale '" << heatmap_scale_text
+                    << "'" << std::endl;
+          return 1;
+        }
+      if (vm.count("find") || vm.count("watch") || querying)
+        {
+          std::cerr << "Error: --heatmap cannot be used with --find, "
+                    << "--watch, --from, --to or --resample." << std::endl;
+          return 1;
+        }
+      heatmap.reset(new value_heatmap(processes, heatmap_window, scale));
+    }
+  std::vector<alert_rule> rules;
+  alert_output alert_events;
+  std::unique_ptr<alert_engine> alerts;
+  if (vm.count("alert-rules"))
+    {
+      if (vm.count("find") || vm.count("watch") || querying)
+        {
+          std::cerr << "Error: --alert-rules cannot be used with --find, "
+                    << "--watch, --from, --to or --resample." << std::endl;
+          return 1;
+        }
+      std::ifstream rules_file(alert_rules_path.c_str());
+      if (!rules_file)
+        {
+          std::cerr << "Error opening file: " << alert_rules_path << std::endl;
+          return 1;
+        }
+      if (!parse_alert_rules(rules_file, alert_rules_path, processes,
+                             top_column, rules))
+        { return 1; }
+      if (!alert_events.open(alert_target))
+        {
+          std::cerr << "Error opening file: " << alert_target << std::endl;
+          return 1;
+        }
+      alerts.reset(new alert_engine(rules, alert_events));
+    }
+  auto draw = [&chart, &correlated, &heatmap, &alerts](const row_type& row)
+    {
+      if (alerts) { alerts->add(row); }
+      if (chart) { chart->add(row); }
+      if (correlated) { correlated->add(row.columns); }
+      if (heatmap) { heatmap->add(row); }
+    };
+
+  if (max_cpu < 0 || max_io < 0)
+    {
+      std::cerr << "Error: --max-cpu and --max-io must be positive."
+                << std::endl;
+      return 1;
+    }
+  if (vm.count("idle") && !set_idle_priority())
+    { std::cerr << "Warning: could not lower the priorities" << std::endl; }
+  std::unique_ptr<resource_limits> limiter;
+  if (max_cpu > 0 || max_io > 0)
+    {
+      limiter.reset(new resource_limits(max_cpu, max_io));
+      limits = limiter.get();
+    }
+
+  std::set<std::string> tuned;
+  if (vm.count("tune"))
+    {
+      std::vector<fs::path> sample;
+      if (vm.count("find") || vm.count("watch"))
+        {
+          fs::path root(vm.count("find") ? vm["find"].as<std::string>()
+                        : watch_path);
+          boost::system::error_code ec;
+          for (fs::recursive_directory_iterator it(root, ec), end;
+               !ec && it != end && sample.size() < TUNE_SAMPLE_LOGS;
+               it.increment(ec))
+            {
+              if (is_regular_file(it->path()) && is_top_log(it->path()))
+                { sample.push_back(it->path()); }
+            }
+        }
+      else if (vm.count("join"))
+        {
+          for (auto&& log : vm["join"].as<std::vector<std::string> >())
+            { sample.push_back(log); }
+        }
+      else if (vm.count("input-file"))
+        { sample.push_back(input_path); }
+      if (sample.empty())
+        {
+          std::cerr << "Error: --tune needs top logs to measure, from "
+                    << "--input-file, --find, --watch or --join." << std::endl;
+          return 1;
+        }
+      fs::path scratch = !output_dir.empty() ? fs::path(output_dir)
+        : vm.count("output-file") ? fs::absolute(output_path).parent_path()
+        : fs::temp_directory_path();
+      pipeline_params params{device_readers, read_buffer_kib, format_threads};
+      calibration measured = tune_pipeline(sample, scratch, processes,
+                                           top_column,
+                                           vm.count("direct-io") != 0,
+                                           params);
+      auto pick = [&](const char* name, unsigned& value, unsigned tuned_value)
+        {
+          if (on_command_line.count(name)) { return; }
+          value = tuned_value;
+          tuned.insert(name);
+        };
+      pick("device-readers", device_readers, params.device_readers);
+      pick("read-buffer", read_buffer_kib, params.read_buffer_kib);
+      pick("format-threads", format_threads, params.format_threads);
+      std::ostringstream report;
+      report << std::fixed << std::setprecision(1)
+             << "Tuned on " << sample.size() << " top logs: read "
+             << measured.read << " MB/s, " << device_readers << " readers "
+             << measured.readers << " MB/s, parse " << measured.parse
+             << " MB/s, format " << measured.format << " MB/s, write "
+             << measured.write << " MB/s";
+      std::cerr << report.str() << std::endl;
+      if (vm.count("config")
+          && !save_tuning(config_path, pipeline_params{device_readers,
+                                                       read_buffer_kib,
+                                                       format_threads}))
+        {
+          std::cerr << "Error writing file: " << config_path << std::endl;
+          return 1;
+        }
+    }
+
+  read_options reading{1 << 20, false};
+  if (vm.count("direct-io"))
+    { reading = read_options{4 << 20, true}; }
+  if (read_buffer_kib) { reading.buffer_size = read_buffer_kib << 10; }
+  reading.limits = limits;
+
+  if (vm.count("join")
+      && (vm.count("find") || vm.count("watch") || vm.count("follow")
+          || vm.count("rotate-output") || vm.count("input-file") || querying
+          || chart || correlated || heatmap || alerts))
+    {
+      std::cerr << "Error: --join cannot be used with --input-file or the "
+                << "other modes." << std::endl;
+      return 1;
+    }
+
   // The setup is done! Can start doing some actual processing...
 
-  std::streambuf* rdin = std::cin.rdbuf();
-  std::streambuf* rdout = std::cout.rdbuf();
   int ret_val = 0;
   if (vm.count("find")) // find all possible files, and parse them
     {
@@ -263,40 +1128,96 @@ int main (int argc, char **argv)
               std::cerr << "Error accessing path: " << root << std::endl;
               return 1;
             }
-          if (!is_directory(root))
+          bool archive = is_regular_file(root) && is_tar_archive(root);
+          if (!archive && !is_directory(root))
             {
-              std::cerr << "Error: " << root << " is not a directory" << std::endl;
+              std::cerr << "Error: " << root << " is neither a directory nor "
+                        << "a tar archive" << std::endl;
               return 1;
             }
-          static const std::regex pattern{"top\\.log(\\.[0-9])?"};
-          for (auto&& entry : fs::recursive_directory_iterator(root))
+          if (archive && output_dir.empty() && output_tar.empty())
+            {
+              std::cerr << "Error: --find with a tar archive requires "
+                        << "--output-dir or --output-tar." << std::endl;
+              return 1;
+            }
+          if (!output_tar.empty() && (!archive || !output_dir.empty()))
+            {
+              std::cerr << "Error: --output-tar requires --find with a tar "
+                        << "archive, and no --output-dir." << std::endl;
+              return 1;
+            }
+          output_batch batch(fsync_batch);
+          summary stats;
+          stats.set_column(top_column == VIRT_COL ? "mem" : "cpu");
+          if (shard.count) { stats.add_shard(shard_spec_text); }
+          std::unique_ptr<progress_reporter> progress;
+          std::atomic<bool> failed(false);
+          if (archive)
+            {
+              if (vm.count("progress"))
+                {
+                  progress.reset(new progress_reporter(fs::file_size(root), 0,
+                                                       std::cerr));
+                  reading.bytes_read = &progress->bytes();
+                }
+              if (!convert_archive(root, output_dir, output_tar, processes,
+                                   top_column, reading, shard, batch,
+                                   summary_path.empty() ? nullptr : &stats,
+                                   progress.get()))
+                { failed = true; }
+            }
+          else
             {
-              if (is_regular_file(entry.path())
-                  && std::regex_match(entry.path().filename().string(), pattern))
+              std::vector<fs::path> logs;
+              for (auto&& entry : fs::recursive_directory_iterator(root))
                 {
-                  std::cout << "Found: " << entry.path().string() << std::endl;
-                  std::ifstream ifs(entry.path().string());
-                  if (ifs) // if file cannot be opened, silently skip.
+                  if (is_regular_file(entry.path())
+                      && is_top_log(entry.path())
+                      && in_shard(entry.path().lexically_relative(root),
+                                  shard))
                     {
-                      output_path = entry.path().string();
-                      if (top_column == VIRT_COL) { output_path += "-mem.csv"; }
-                      else { output_path += "-cpu.csv"; }
-                      std::ofstream ofs(output_path);
-                      if (ofs)
+                      if (list_files)
                         {
-                          std::cout << "Writing: " << output_path << std::endl;
-                          std::cout.flush();
-                          std::cin.rdbuf(ifs.rdbuf());
-                          std::cout.rdbuf(ofs.rdbuf());
-                          // Silently ignore errors here.
-                          parse_and_print(processes, top_column);
-                          std::cin.rdbuf(rdin);
-                          std::cout.rdbuf(rdout);
-                          ofs.close();
+                          std::cout << "Found: " << entry.path().string()
+                                    << std::endl;
                         }
-                      ifs.close();
+                      logs.push_back(entry.path());
                     }
                 }
+              std::vector<device_plan> plan = plan_reads(logs);
+              if (vm.count("progress"))
+                {
+                  std::uint64_t total = 0;
+                  for (auto&& device : plan)
+                    {
+                      for (auto&& file : device.files) { total += file.size; }
+                    }
+                  progress.reset(new progress_reporter(total, logs.size(),
+                                                       std::cerr));
+                  reading.bytes_read = &progress->bytes();
+                }
+              run_plan(plan, device_readers,
+                       [&](const planned_file& log)
+                       {
+                         fs::path output = output_path_for(log.path, root,
+                                                           output_dir,
+                                                           top_column);
+                         if (!convert_log(log.path, output, processes,
+                                          top_column, reading, batch,
+                                          summary_path.empty()
+                                          ? nullptr : &stats))
+                           { failed = true; }
+                         if (progress) { progress->file_done(); }
+                       });
+            }
+          if (progress) { progress->stop(); }
+          if (failed) { ret_val = 1; }
+          if (!batch.flush()) { ret_val = 1; }
+          if (!summary_path.empty() && !stats.write(summary_path))
+            {
+              std::cerr << "Error writing file: " << summary_path << std::endl;
+              ret_val = 1;
             }
         }
       catch (const fs::filesystem_error& e)
@@ -305,19 +1226,118 @@ int main (int argc, char **argv)
           return 1;
         }
     }
-  else
+  else if (vm.count("watch"))
+    {
+      std::signal(SIGINT, request_stop);
+      std::signal(SIGTERM, request_stop);
+      watch_options options{watch_path, watch_workers,
+                            std::chrono::milliseconds(watch_debounce_ms),
+                            std::chrono::seconds(watch_rescan),
+                            watch_status};
+      output_batch batch(fsync_batch);
+      fs::path root(watch_path);
+      watch_handler handler;
+      handler.is_stale = [&](const fs::path& log)
+        {
+          boost::system::error_code ec;
+          std::time_t output_time
+            = fs::last_write_time(output_path_for(log, root, output_dir,
+                                                  top_column), ec);
+          return ec || output_time < fs::last_write_time(log, ec);
+        };
+      handler.convert = [&](const fs::path& log)
+        {
+          return convert_log(log, output_path_for(log, root, output_dir,
+                                                  top_column),
+                             processes, top_column, reading, batch, nullptr);
+        };
+      handler.idle = [&batch] { batch.flush(); };
+      ret_val = watch_logs(options, handler, stop_requested);
+      if (!batch.flush()) { ret_val = 1; }
+    }
+  else if (vm.count("join"))
     {
-      std::ifstream input_file;
       std::ofstream output_file;
-      if (vm.count("input-file"))
+      if (vm.count("output-file"))
         {
-          input_file.open(input_path.c_str());
-          if (!input_file)
+          output_file.open(output_path.c_str());
+          if (!output_file)
+            {
+              std::cerr << "Error opening file: " << output_path << std::endl;
+              return 1;
+            }
+        }
+      std::ostream& out = vm.count("output-file") ? output_file : std::cout;
+      std::vector<fs::path> logs;
+      for (auto&& log : vm["join"].as<std::vector<std::string> >())
+        { logs.push_back(log); }
+      ret_val = join_and_print(logs, out, processes, top_column,
+                               join_tolerance, reading);
+    }
+  else if (vm.count("follow") || vm.count("rotate-output"))
+    {
+      std::signal(SIGINT, request_stop);
+      std::signal(SIGTERM, request_stop);
+      std::ostringstream header;
+      print_header(header, processes);
+      if (vm.count("rotate-output"))
+        {
+          rotating_output output(output_path, header.str(), rotation,
+                                 vm.count("rotate-compress") != 0);
+          if (!output.good())
             {
-              std::cerr << "Error opening file: " << input_path << std::endl;
+              std::cerr << "Error opening file: " << output_path << std::endl;
               return 1;
             }
-          rdin = std::cin.rdbuf(input_file.rdbuf());
+          std::ostringstream text;
+          set_value_format(text, top_column);
+          ret_val = stream_and_print(input_path, vm.count("follow") != 0,
+                                     processes, top_column,
+                                     [&](const row_type& row)
+                                     {
+                                       text.str("");
+                                       print_row(text, row);
+                                       output.write(row.hour, text.str());
+                                       draw(row);
+                                     });
+          if (!output.close()) { ret_val = 1; }
+        }
+      else
+        {
+          std::ofstream output_file;
+          if (vm.count("output-file"))
+            {
+              output_file.open(output_path.c_str());
+              if (!output_file)
+                {
+                  std::cerr << "Error opening file: " << output_path
+                            << std::endl;
+                  return 1;
+                }
+            }
+          std::ostream& out = vm.count("output-file") ? output_file : std::cout;
+          out << header.str() << std::flush;
+          set_value_format(out, top_column);
+          ret_val = stream_and_print(input_path, true, processes, top_column,
+                                     [&](const row_type& row)
+                                     {
+                                       print_row(out, row);
+                                       out.flush();
+                                       draw(row);
+                                     });
+        }
+    }
+  else
+    {
+      read_options buffered = reading;
+      buffered.direct = false;
+      file_reader input_reader(buffered);
+      std::istream input_file(&input_reader);
+      std::ofstream output_file;
+      if (vm.count("input-file") && !input_reader.open(input_path))
+        {
+          std::cerr << "Error opening file: " << input_path << std::endl;
+          return 1;
         }
       if (vm.count("output-file"))
         {
@@ -327,12 +1347,108 @@ int main (int argc, char **argv)
               std::cerr << "Error opening file: " << output_path << std::endl;
               return 1;
             }
-          rdout = std::cout.rdbuf(output_file.rdbuf());
         }
-      ret_val = parse_and_print(processes, top_column);
+      gzip_reader gunzip;
+      std::istream gunzipped(&gunzip);
+      bool compressed = vm.count("input-file") && is_gzip_file(input_path);
+      if (compressed && !gunzip.open(input_reader))
+        {
+          std::cerr << "Error: this build does not support compression."
+                    << std::endl;
+          return 1;
+        }
+      // Standard input is paced by the limits as the files are.
+      throttled_reader throttled(*std::cin.rdbuf(), limits);
+      std::istream throttled_cin(&throttled);
+      std::istream& in = vm.count("input-file")
+        ? (compressed ? gunzipped : input_file)
+        : (limits ? throttled_cin : std::cin);
+      std::ostream& out = vm.count("output-file") ? output_file : std::cout;
+      if (compressed && (query.has_from || query.has_to))
+        {
+          gz_index index;
+          fs::path index_path = gz_index::default_path(input_path);
+          if (!index.load(index_path, input_path))
+            {
+              if (!index.build(input_path, 1 << 20, buffered))
+                {
+                  std::cerr << "Error reading file: " << input_path
+                            << std::endl;
+                  return 1;
+                }
+              index.save(index_path);
+            }
+          ret_val = query_gzip_and_print(input_path, index, out, processes,
+                                         top_column, query,
+                                         decompress_threads, buffered);
+        }
+      else if (querying)
+        { ret_val = query_and_print(in, out, processes, top_column, query); }
+      else if (chart || correlated || heatmap || alerts)
+        {
+          // Rows are written and analysed as they are parsed, so that long
+          // logs do not need to be kept in memory.
+          print_header(out, processes);
+          set_value_format(out, top_column);
+          ret_val = stream_and_print(input_path, false, processes, top_column,
+                                     [&](const row_type& row)
+                                     {
+                                       print_row(out, row);
+                                       draw(row);
+                                     });
+          out.flush();
+        }
+      else if (format_threads > 1 || limits)
+        {
+          // The file is written at once by the formatting threads, which
+          // are charged to the limits range by range.
+          if (vm.count("output-file")) { output_file.close(); }
+          ret_val = parse_and_print_parallel(in, out, vm.count("output-file")
+                                             ? output_path : std::string(),
+                                             processes, top_column,
+                                             format_threads, limits);
+        }
+      else
+        { ret_val = parse_and_print(in, out, processes, top_column); }
+      if (compressed && gunzip.failed())
+        {
+          std::cerr << "Error reading file: " << input_path << std::endl;
+          ret_val = 1;
+        }
     }
 
-  std::cin.rdbuf(rdin);
-  std::cout.rdbuf(rdout);
+  if (chart && !chart->write_svg(chart_path))
+    {
+      std::cerr << "Error writing file: " << chart_path << std::endl;
+      ret_val = 1;
+    }
+  if (correlated && !correlated->write(correlate_path, processes))
+    {
+      std::cerr << "Error writing file: " << correlate_path << std::endl;
+      ret_val = 1;
+    }
+  if (heatmap && !heatmap->write(heatmap_path))
+    {
+      std::cerr << "Error writing file: " << heatmap_path << std::endl;
+      ret_val = 1;
+    }
+  if (vm.count("stats"))
+    {
+      auto source = [&](const char* name)
+        {
+          return tuned.count(name) ? "tuned"
+            : on_command_line.count(name) ? "command line"
+            : vm.count(name) ? "config" : "default";
+        };
+      std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start_time;
+      std::cerr << "device-readers: " << device_readers << " ("
+                << source("device-readers") << ")\n"
+                << "read-buffer: " << (reading.buffer_size >> 10) << " KiB ("
+                << source("read-buffer") << ")\n"
+                << "format-threads: " << format_threads << " ("
+                << source("format-threads") << ")\n"
+                << "elapsed: " << elapsed.count() << " s" << std::endl;
+    }
   return ret_val;
 }
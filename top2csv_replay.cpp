@@ -0,0 +1,123 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <boost/program_options.hpp>
+#include "archive.hpp"
+#include "reader.hpp"
+#include "replay.hpp"
+
+namespace po = boost::program_options;
+
+/**
+ *  Writes a top log again, one snapshot at a time, at the pace it was
+ *  recorded at or faster, so that --follow and what reads the CSV output of
+ *  top2csv can be tried and measured without waiting for top.
+ *
+ *  @return 0 if everything went fine, 1 otherwise.
+ */
+int main(int argc, char **argv)
+{
+  std::string input_path, output_path;
+  double speed = 1, rate = 0;
+  po::options_description desc{"Usage: top2csv-replay [options] log\n\n"
+                               "Write a top log again one snapshot at a time, "
+                               "at the pace it was recorded at or faster.\n\n"
+                               "Allowed options"};
+  desc.add_options()
+    ("help,h", "Print this help")
+    ("output-file,o", po::value< std::string >(&output_path),
+     "File or named pipe to write to, instead of stdout.  A file is "
+     "truncated first, unless --append is given.")
+    ("append,a", "Append to the output file.")
+    ("speed,s", po::value< double >(&speed),
+     "How many times faster than recorded the snapshots are written, for "
+     "example 1000.  0 writes them as fast as possible.  Defaults to 1.")
+    ("rate,r", po::value< double >(&rate),
+     "Snapshots written per second, whatever their times, instead of "
+     "--speed.")
+    ("input-file,i", po::value< std::string >(&input_path),
+     "Top log to read from, possibly compressed with gzip.  The option "
+     "--input-file can be omitted.")
+    ;
+  po::positional_options_description p;
+  p.add("input-file", 1);
+  po::variables_map vm;
+  try
+    {
+      po::store(po::command_line_parser(argc, argv)
+                .options(desc).positional(p).run(), vm);
+      po::notify(vm);
+    }
+  catch (const po::error& e)
+    {
+      std::cerr << "Error: " << e.what() << std::endl;
+      return 1;
+    }
+  if (vm.count("help"))
+    {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  if (!vm.count("input-file"))
+    {
+      std::cerr << "Error: a log must be specified." << std::endl;
+      return 1;
+    }
+  if (speed < 0 || rate < 0)
+    {
+      std::cerr << "Error: --speed and --rate cannot be negative."
+                << std::endl;
+      return 1;
+    }
+
+  file_reader input_reader;
+  gzip_reader gunzip;
+  bool compressed = is_gzip_file(input_path);
+  if (!input_reader.open(input_path)
+      || (compressed && !gunzip.open(input_reader)))
+    {
+      std::cerr << "Error opening file: " << input_path << std::endl;
+      return 1;
+    }
+  std::istream in(compressed ? static_cast<std::streambuf*>(&gunzip)
+                  : &input_reader);
+
+  std::ofstream output_file;
+  if (vm.count("output-file"))
+    {
+      output_file.open(output_path.c_str(), vm.count("append")
+                       ? std::ios::app : std::ios::trunc);
+      if (!output_file)
+        {
+          std::cerr << "Error opening file: " << output_path << std::endl;
+          return 1;
+        }
+    }
+  std::ostream& out = vm.count("output-file") ? output_file : std::cout;
+
+  snapshot_source source(in);
+  replay_schedule schedule(speed, rate);
+  std::string text;
+  std::int64_t time;
+  while (source.next(text, time))
+    {
+      std::this_thread::sleep_until(schedule.due(time));
+      // A whole snapshot at once, as top writes it.
+      out.write(text.data(), text.size());
+      out.flush();
+      if (!out)
+        {
+          std::cerr << "Error writing file: "
+                    << (output_path.empty() ? "stdout" : output_path)
+                    << std::endl;
+          return 1;
+        }
+    }
+  if (input_reader.failed() || (compressed && gunzip.failed()))
+    {
+      std::cerr << "Error reading file: " << input_path << std::endl;
+      return 1;
+    }
+  return 0;
+}
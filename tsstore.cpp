@@ -0,0 +1,308 @@
+#include "tsstore.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include "kernels.hpp"
+
+namespace
+{
+  void put_bits(std::vector<std::uint64_t>& words, std::size_t& bits,
+                std::uint64_t value, unsigned n)
+  {
+    std::size_t offset = bits % 64;
+    if (offset == 0) { words.push_back(0); }
+    words.back() |= value << offset;
+    if (offset + n > 64) { words.push_back(value >> (64 - offset)); }
+    bits += n;
+  }
+
+  struct bit_reader
+  {
+    const std::uint64_t* words;
+    std::size_t pos;
+
+    std::uint64_t get(unsigned n)
+    {
+      std::size_t w = pos / 64, offset = pos % 64;
+      std::uint64_t value = words[w] >> offset;
+      if (offset + n > 64) { value |= words[w + 1] << (64 - offset); }
+      pos += n;
+      return n == 64 ? value : value & ((std::uint64_t(1) << n) - 1);
+    }
+  };
+
+  void put_varint(std::vector<std::uint8_t>& bytes, std::int64_t value)
+  {
+    // zigzag, so that small negative values are small as well
+    std::uint64_t v = (static_cast<std::uint64_t>(value) << 1)
+      ^ static_cast<std::uint64_t>(value >> 63);
+    while (v >= 0x80)
+      {
+        bytes.push_back(static_cast<std::uint8_t>(v | 0x80));
+        v >>= 7;
+      }
+    bytes.push_back(static_cast<std::uint8_t>(v));
+  }
+
+  std::int64_t get_varint(const std::uint8_t*& p)
+  {
+    std::uint64_t v = 0;
+    for (unsigned shift = 0; ; shift += 7)
+      {
+        std::uint8_t byte = *p++;
+        v |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) { break; }
+      }
+    return static_cast<std::int64_t>(v >> 1)
+      ^ -static_cast<std::int64_t>(v & 1);
+  }
+
+  std::int64_t period_of(std::int64_t time, std::int64_t step)
+  {
+    std::int64_t q = time / step;
+    if (time % step != 0 && time < 0) { --q; }
+    return q * step;
+  }
+}
+
+ts_store::ts_store(std::size_t columns)
+  : columns_(columns), size_(0)
+{ }
+
+void ts_store::append(std::int64_t time, const std::vector<float>& values)
+{
+  if (blocks_.empty() || blocks_.back().count == BLOCK_SIZE)
+    {
+      if (!blocks_.empty())
+        {
+          // The full block will not grow anymore.
+          blocks_.back().times.shrink_to_fit();
+          for (auto&& c : blocks_.back().columns)
+            { c.stream.words.shrink_to_fit(); }
+        }
+      block b;
+      b.first_time = b.last_time = time;
+      b.last_delta = 0;
+      b.count = 0;
+      b.columns.resize(columns_);
+      for (auto&& c : b.columns)
+        {
+          c.stream.bits = 0;
+          c.last = 0;
+          c.leading = -1;
+          c.trailing = 0;
+          c.sum = 0;
+          c.min = std::numeric_limits<float>::infinity();
+          c.max = -std::numeric_limits<float>::infinity();
+        }
+      blocks_.push_back(std::move(b));
+    }
+  block& b = blocks_.back();
+  if (b.count > 0)
+    {
+      std::int64_t delta = time - b.last_time;
+      put_varint(b.times, b.count == 1 ? delta : delta - b.last_delta);
+      b.last_delta = delta;
+      b.last_time = time;
+    }
+  for (std::size_t i = 0; i < columns_; ++i)
+    {
+      column_block& c = b.columns[i];
+      std::uint32_t bits;
+      std::memcpy(&bits, &values[i], sizeof(bits));
+      auto& words = c.stream.words;
+      auto& n = c.stream.bits;
+      if (b.count == 0)
+        { put_bits(words, n, bits, 32); }
+      else
+        {
+          std::uint32_t x = bits ^ c.last;
+          if (x == 0)
+            { put_bits(words, n, 0, 1); }
+          else
+            {
+              int leading = std::min(__builtin_clz(x), 31);
+              int trailing = __builtin_ctz(x);
+              put_bits(words, n, 1, 1);
+              if (c.leading >= 0 && leading >= c.leading
+                  && trailing >= c.trailing)
+                {
+                  put_bits(words, n, 0, 1);
+                  put_bits(words, n, x >> c.trailing,
+                           32 - c.leading - c.trailing);
+                }
+              else
+                {
+                  int length = 32 - leading - trailing;
+                  put_bits(words, n, 1, 1);
+                  put_bits(words, n, leading, 5);
+                  put_bits(words, n, length - 1, 5);
+                  put_bits(words, n, x >> trailing, length);
+                  c.leading = leading;
+                  c.trailing = trailing;
+                }
+            }
+        }
+      c.last = bits;
+      c.sum += values[i];
+      c.min = std::min(c.min, values[i]);
+      c.max = std::max(c.max, values[i]);
+    }
+  ++b.count;
+  ++size_;
+}
+
+std::size_t ts_store::memory_bytes() const
+{
+  std::size_t bytes = blocks_.capacity() * sizeof(block);
+  for (auto&& b : blocks_)
+    {
+      bytes += b.times.capacity()
+        + b.columns.capacity() * sizeof(column_block);
+      for (auto&& c : b.columns)
+        { bytes += c.stream.words.capacity() * sizeof(std::uint64_t); }
+    }
+  return bytes;
+}
+
+void ts_store::decode(const block& b, decoded_block& out) const
+{
+  out.times.resize(b.count);
+  out.columns.resize(columns_);
+  const std::uint8_t* p = b.times.data();
+  std::int64_t time = b.first_time, delta = 0;
+  for (std::size_t i = 0; i < b.count; ++i)
+    {
+      if (i == 1) { delta = get_varint(p); }
+      else if (i > 1) { delta += get_varint(p); }
+      time += delta;
+      out.times[i] = time;
+    }
+  for (std::size_t c = 0; c < columns_; ++c)
+    {
+      const column_block& cb = b.columns[c];
+      std::vector<float>& values = out.columns[c];
+      values.resize(b.count);
+      bit_reader in{cb.stream.words.data(), 0};
+      std::uint32_t bits = 0;
+      int leading = 0, trailing = 0;
+      for (std::size_t i = 0; i < b.count; ++i)
+        {
+          if (i == 0)
+            { bits = static_cast<std::uint32_t>(in.get(32)); }
+          else if (in.get(1))
+            {
+              if (in.get(1))
+                {
+                  leading = static_cast<int>(in.get(5));
+                  int length = static_cast<int>(in.get(5)) + 1;
+                  trailing = 32 - leading - length;
+                }
+              bits ^= static_cast<std::uint32_t>
+                (in.get(32 - leading - trailing)) << trailing;
+            }
+          std::memcpy(&values[i], &bits, sizeof(bits));
+        }
+    }
+}
+
+void ts_store::scan(std::int64_t from, std::int64_t to,
+                    const std::function<void (const decoded_block&)>& visit)
+  const
+{
+  decoded_block decoded, filtered;
+  for (auto&& b : blocks_)
+    {
+      if (b.last_time < from || b.first_time > to) { continue; }
+      decode(b, decoded);
+      if (b.first_time >= from && b.last_time <= to)
+        {
+          visit(decoded);
+          continue;
+        }
+      auto begin = std::lower_bound(decoded.times.begin(),
+                                    decoded.times.end(), from)
+        - decoded.times.begin();
+      auto end = std::upper_bound(decoded.times.begin(),
+                                  decoded.times.end(), to)
+        - decoded.times.begin();
+      filtered.times.assign(decoded.times.begin() + begin,
+                            decoded.times.begin() + end);
+      filtered.columns.resize(columns_);
+      for (std::size_t c = 0; c < columns_; ++c)
+        {
+          filtered.columns[c].assign(decoded.columns[c].begin() + begin,
+                                     decoded.columns[c].begin() + end);
+        }
+      visit(filtered);
+    }
+}
+
+void ts_store::resample(std::int64_t from, std::int64_t to, std::int64_t step,
+                        const std::function<void (std::int64_t,
+                                                  const std::vector<float>&)>&
+                        visit) const
+{
+  std::int64_t period = std::numeric_limits<std::int64_t>::min();
+  std::uint64_t count = 0;
+  std::vector<double> sums(columns_, 0.);
+  std::vector<float> means(columns_);
+  auto flush = [&]
+    {
+      if (count == 0) { return; }
+      for (std::size_t c = 0; c < columns_; ++c)
+        {
+          means[c] = static_cast<float>(sums[c] / count);
+          sums[c] = 0.;
+        }
+      visit(period, means);
+      count = 0;
+    };
+  auto enter = [&](std::int64_t p)
+    {
+      if (p != period)
+        {
+          flush();
+          period = p;
+        }
+    };
+  decoded_block decoded;
+  for (auto&& b : blocks_)
+    {
+      if (b.last_time < from || b.first_time > to) { continue; }
+      std::int64_t first = period_of(b.first_time, step);
+      if (b.first_time >= from && b.last_time <= to
+          && first == period_of(b.last_time, step))
+        {
+          enter(first);
+          for (std::size_t c = 0; c < columns_; ++c)
+            { sums[c] += b.columns[c].sum; }
+          count += b.count;
+          continue;
+        }
+      decode(b, decoded);
+      for (std::size_t i = 0; i < b.count; )
+        {
+          std::int64_t time = decoded.times[i];
+          if (time < from || time > to)
+            {
+              ++i;
+              continue;
+            }
+          // Times never decrease, so the snapshots of a period are a run of
+          // consecutive values in each column.
+          std::int64_t p = period_of(time, step);
+          std::size_t end = i + 1;
+          while (end < b.count && decoded.times[end] <= to
+                 && period_of(decoded.times[end], step) == p)
+            { ++end; }
+          enter(p);
+          for (std::size_t c = 0; c < columns_; ++c)
+            { sums[c] += column_sum(decoded.columns[c].data() + i, end - i); }
+          count += end - i;
+          i = end;
+        }
+    }
+  flush();
+}
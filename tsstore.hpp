@@ -0,0 +1,109 @@
+#ifndef TOP2CSV_TSSTORE_HPP
+#define TOP2CSV_TSSTORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ *  The values of a block of consecutive snapshots, decoded column by column
+ *  into contiguous arrays.
+ */
+struct decoded_block
+{
+  std::vector<std::int64_t> times;
+  std::vector<std::vector<float> > columns;
+};
+
+/**
+ *  A compressed, in-memory, columnar store of the values of several processes
+ *  over time.
+ *
+ *  Snapshots are stored in blocks of up to BLOCK_SIZE snapshots.  In a block,
+ *  times are encoded as variable length deltas of deltas, which take a single
+ *  byte for a regular sampling period, and the values of each column are XOR
+ *  encoded against the previous value of the column (as in Facebook's
+ *  Gorilla), which takes a single bit for a value that did not change.  Each
+ *  block also keeps the sum, minimum and maximum of each column, so that
+ *  aggregations covering a whole block do not need to decode it.
+ *
+ *  Times are in seconds and must never decrease.
+ */
+class ts_store
+{
+public:
+  static const std::size_t BLOCK_SIZE = 1024;
+
+  explicit ts_store(std::size_t columns);
+
+  /**
+   *  Appends a snapshot; values must have one value per column.
+   */
+  void append(std::int64_t time, const std::vector<float>& values);
+
+  std::size_t columns() const { return columns_; }
+  std::size_t size() const { return size_; }
+
+  /**
+   *  @return The memory used by the compressed data, in bytes.
+   */
+  std::size_t memory_bytes() const;
+
+  /**
+   *  Decodes the snapshots with a time in [from, to], a block at a time, and
+   *  calls visit for each block.  The snapshots of the block given to visit
+   *  are all within the range.
+   */
+  void scan(std::int64_t from, std::int64_t to,
+            const std::function<void (const decoded_block&)>& visit) const;
+
+  /**
+   *  Averages each column over consecutive periods of step seconds, aligned
+   *  on multiples of step, for the snapshots with a time in [from, to].
+   *  Blocks that lie entirely in one period are not decoded.
+   *
+   *  @param visit Called in order, for each period that contains at least one
+   *               snapshot, with the start of the period and the averages.
+   */
+  void resample(std::int64_t from, std::int64_t to, std::int64_t step,
+                const std::function<void (std::int64_t,
+                                          const std::vector<float>&)>&
+                visit) const;
+
+private:
+  struct bit_stream
+  {
+    std::vector<std::uint64_t> words;
+    std::size_t bits;
+  };
+
+  struct column_block
+  {
+    bit_stream stream;
+    std::uint32_t last;
+    int leading;  // of the last meaningful XOR, -1 when none yet
+    int trailing;
+    double sum;
+    float min;
+    float max;
+  };
+
+  struct block
+  {
+    std::int64_t first_time;
+    std::int64_t last_time;
+    std::int64_t last_delta;
+    std::size_t count;
+    std::vector<std::uint8_t> times;
+    std::vector<column_block> columns;
+  };
+
+  void decode(const block& b, decoded_block& out) const;
+
+  std::size_t columns_;
+  std::size_t size_;
+  std::vector<block> blocks_;
+};
+
+#endif // TOP2CSV_TSSTORE_HPP
@@ -0,0 +1,264 @@
+#include "tune.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "format.hpp"
+#include "output.hpp"
+#include "parser.hpp"
+#include "reader.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  typedef std::chrono::steady_clock clock_type;
+
+  // Bytes read from the sample for each measure, spread over its files.
+  const std::uint64_t SAMPLE_BYTES = 64 << 20;
+  // Bytes parsed, at most, and for at most PARSE_SECONDS.
+  const std::size_t PARSE_BYTES = 8 << 20;
+  const double PARSE_SECONDS = 1.;
+  // Bytes parsed between two looks at the clock.
+  const std::size_t PARSE_BLOCK = 64 << 10;
+  const std::size_t WRITE_BYTES = 16 << 20;
+  // A candidate is as good as the best one when within this share of it.
+  const double GOOD_ENOUGH = 0.9;
+
+  double seconds_since(clock_type::time_point start)
+  {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+  }
+
+  /**
+   *  Drops a file from the page cache, so that reading it measures the
+   *  storage.  Does nothing on systems that cannot do it.
+   */
+  void evict(const fs::path& path)
+  {
+#ifdef POSIX_FADV_DONTNEED
+    int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) { return; }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+  }
+
+  /**
+   *  Reads the start of every file of the sample with the given number of
+   *  readers at once.
+   *
+   *  @return The throughput, in MB/s.
+   */
+  double read_throughput(const std::vector<fs::path>& sample,
+                         std::size_t buffer, bool direct, unsigned readers)
+  {
+    for (auto&& path : sample) { evict(path); }
+    const std::uint64_t per_file = SAMPLE_BYTES / sample.size();
+    std::atomic<std::size_t> next(0);
+    std::atomic<std::uint64_t> total(0);
+    auto read = [&]
+      {
+        std::vector<char> chunk(64 << 10);
+        for (std::size_t i = next++; i < sample.size(); i = next++)
+          {
+            file_reader reader(read_options{buffer, direct});
+            if (!reader.open(sample[i])) { continue; }
+            std::uint64_t bytes = 0;
+            std::streamsize n;
+            while (bytes < per_file
+                   && (n = reader.sgetn(chunk.data(), chunk.size())) > 0)
+              { bytes += n; }
+            total += bytes;
+          }
+      };
+    auto start = clock_type::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < readers; ++t) { threads.emplace_back(read); }
+    read();
+    for (auto&& thread : threads) { thread.join(); }
+    return total / 1048576. / std::max(seconds_since(start), 1e-6);
+  }
+
+  /**
+   *  Parses the start of a top log on one thread.
+   *
+   *  @return The throughput, in MB/s.
+   */
+  double parse_throughput(const fs::path& log,
+                          const std::vector<std::string>& processes,
+                          int top_column, std::vector<row_type>& rows)
+  {
+    std::ifstream in(log.string(), std::ios::binary);
+    std::string text(PARSE_BYTES, '\0');
+    in.read(&text[0], text.size());
+    text.resize(static_cast<std::size_t>(in.gcount()));
+    snapshot_parser parser(processes, top_column,
+                           [&rows](const row_type& row)
+                           { rows.push_back(row); });
+    std::size_t bytes = 0;
+    auto start = clock_type::now();
+    while (bytes < text.size() && seconds_since(start) < PARSE_SECONDS)
+      {
+        // Whole lines, a block at a time, as feed_stream does.
+        std::size_t eol = text.find('\n', bytes + std::min(PARSE_BLOCK,
+                                                           text.size()
+                                                           - bytes) - 1);
+        std::size_t end = eol == std::string::npos ? text.size() : eol + 1;
+        parser.feed_block(text.data() + bytes, end - bytes);
+        bytes = end;
+      }
+    parser.finish();
+    return bytes / 1048576. / std::max(seconds_since(start), 1e-6);
+  }
+
+  /**
+   *  Formats the rows on one thread, as many times as needed to measure it.
+   *
+   *  @return The throughput, in MB/s, and the text formatted.
+   */
+  double format_throughput(const std::vector<row_type>& rows, int top_column,
+                           std::string& text)
+  {
+    std::uint64_t bytes = 0;
+    auto start = clock_type::now();
+    do
+      {
+        text.clear();
+        format_rows(text, top_column, rows.data(), rows.data() + rows.size());
+        bytes += text.size();
+      }
+    while (seconds_since(start) < 0.2);
+    return bytes / 1048576. / std::max(seconds_since(start), 1e-6);
+  }
+
+  /**
+   *  Writes a temporary file in the scratch directory.
+   *
+   *  @return The throughput, in MB/s, or 0 if the file could not be written.
+   */
+  double write_throughput(const fs::path& scratch, const std::string& text)
+  {
+    if (text.empty()) { return 0; }
+    fs::path path = scratch / fs::unique_path(".top2csv-tune-%%%%%%%%");
+    std::uint64_t bytes = 0;
+    auto start = clock_type::now();
+    {
+      std::ofstream out(path.string(), std::ios::binary);
+      while (out && bytes < WRITE_BYTES)
+        {
+          out.write(text.data(), text.size());
+          bytes += text.size();
+        }
+      if (!out) { bytes = 0; }
+    }
+    double elapsed = seconds_since(start);
+    boost::system::error_code ec;
+    fs::remove(path, ec);
+    return bytes / 1048576. / std::max(elapsed, 1e-6);
+  }
+}
+
+calibration tune_pipeline(const std::vector<fs::path>& sample,
+                          const fs::path& scratch,
+                          const std::vector<std::string>& processes,
+                          int top_column, bool direct,
+                          pipeline_params& params)
+{
+  calibration measured{0, 0, 0, 0, 0};
+  unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+  if (sample.empty()) { return measured; }
+
+  // The buffer size, with one reader.
+  const unsigned buffers[] = {256, 1024, 4096, 16384};
+  double rates[4];
+  for (int i = 0; i < 4; ++i)
+    { rates[i] = read_throughput(sample, buffers[i] << 10, direct, 1); }
+  double best = *std::max_element(rates, rates + 4);
+  for (int i = 0; i < 4; ++i)
+    {
+      if (rates[i] >= GOOD_ENOUGH * best)
+        {
+          params.read_buffer_kib = buffers[i];
+          measured.read = rates[i];
+          break;
+        }
+    }
+
+  std::vector<row_type> rows;
+  measured.parse = parse_throughput(sample.front(), processes, top_column,
+                                    rows);
+
+  // The readers, which parse what they read: n readers go as fast as the
+  // slowest of the storage and n parsers.
+  std::vector<std::pair<unsigned, double> > effective;
+  std::vector<double> read_rates;
+  for (unsigned n = 1; n <= std::min<std::size_t>(2 * cores, sample.size());
+       n *= 2)
+    {
+      double rate = n == 1 ? measured.read
+        : read_throughput(sample, params.read_buffer_kib << 10, direct, n);
+      effective.emplace_back(n, std::min(rate, n * measured.parse));
+      read_rates.push_back(rate);
+    }
+  double best_effective = 0;
+  for (auto&& e : effective)
+    { best_effective = std::max(best_effective, e.second); }
+  for (std::size_t i = 0; i < effective.size(); ++i)
+    {
+      if (effective[i].second >= GOOD_ENOUGH * best_effective)
+        {
+          params.device_readers = effective[i].first;
+          measured.readers = read_rates[i];
+          break;
+        }
+    }
+
+  std::string text;
+  measured.format = rows.empty() ? 0
+    : format_throughput(rows, top_column, text);
+  measured.write = write_throughput(scratch, text);
+  params.format_threads = measured.format > 0
+    ? std::max(1u, std::min(cores, static_cast<unsigned>
+                            (std::ceil(measured.write / measured.format))))
+    : 1;
+  return measured;
+}
+
+bool save_tuning(const fs::path& config, const pipeline_params& params)
+{
+  const char* keys[] = {"device-readers", "read-buffer", "format-threads"};
+  std::ostringstream content;
+  std::ifstream in(config.string());
+  std::string line;
+  while (std::getline(in, line))
+    {
+      auto begin = line.find_first_not_of(" \t");
+      auto end = line.find_first_of(" \t=", begin);
+      std::string key = begin == std::string::npos ? std::string()
+        : line.substr(begin, end - begin);
+      if (line.compare(0, 7, "# tuned") == 0
+          || std::find(std::begin(keys), std::end(keys), key)
+             != std::end(keys))
+        { continue; }
+      content << line << "\n";
+    }
+  in.close();
+  content << "# tuned by --tune\n"
+          << "device-readers = " << params.device_readers << "\n"
+          << "read-buffer = " << params.read_buffer_kib << "\n"
+          << "format-threads = " << params.format_threads << "\n";
+
+  return write_atomically(config, [&content](std::ostream& out)
+                          { out << content.str(); });
+}
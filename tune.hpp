@@ -0,0 +1,64 @@
+#ifndef TOP2CSV_TUNE_HPP
+#define TOP2CSV_TUNE_HPP
+
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+/**
+ *  The parameters of the pipeline that depend on the machine and the
+ *  storage rather than on the top logs.
+ */
+struct pipeline_params
+{
+  unsigned device_readers;  // --device-readers
+  unsigned read_buffer_kib; // --read-buffer
+  unsigned format_threads;  // --format-threads
+};
+
+/**
+ *  What the calibration measured, in MB/s.
+ */
+struct calibration
+{
+  double read;      // one reader, with the chosen buffer size
+  double readers;   // all the chosen readers together
+  double parse;     // one thread
+  double format;    // one thread
+  double write;
+};
+
+/**
+ *  Measures the storage and the processors on a sample of the top logs to be
+ *  converted, and picks the pipeline parameters from the measures.
+ *
+ *  The start of each sampled log is read, dropped from the page cache
+ *  beforehand where the system allows it, with each candidate buffer size
+ *  and then with more and more readers at once.  The start of a log is also
+ *  parsed and formatted on one thread.  The buffer size is the smallest one
+ *  about as fast as the best; the readers are as few as give about the best
+ *  of the read throughput and the parse throughput of that many threads, so
+ *  that the readers, which also parse, keep up with the storage; and there
+ *  are enough formatting threads to keep up with writing.
+ *
+ *  @param sample Top logs to read, at most a few dozen.
+ *  @param scratch A directory where a temporary file can be written to
+ *                measure writing.
+ *  @param params The parameters to update.
+ */
+calibration tune_pipeline(const std::vector<boost::filesystem::path>& sample,
+                          const boost::filesystem::path& scratch,
+                          const std::vector<std::string>& processes,
+                          int top_column, bool direct,
+                          pipeline_params& params);
+
+/**
+ *  Writes the parameters to a configuration file, as read with --config,
+ *  replacing any previous value of theirs and keeping the other lines.
+ *
+ *  @return false if the file could not be written.
+ */
+bool save_tuning(const boost::filesystem::path& config,
+                 const pipeline_params& params);
+
+#endif // TOP2CSV_TUNE_HPP
@@ -0,0 +1,364 @@
+#include "watch.hpp"
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include "discovery.hpp"
+#include "output.hpp"
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  typedef std::chrono::steady_clock clock_type;
+
+  double seconds(clock_type::duration d)
+  {
+    return std::chrono::duration<double>(d).count();
+  }
+
+  /**
+   *  A pool of threads converting queued top logs.  A top log that is queued
+   *  again while it is being converted is converted once more afterwards.
+   */
+  class work_queue
+  {
+  public:
+    work_queue(unsigned workers,
+               const std::function<bool (const fs::path&)>& convert)
+      : convert_(convert), stopping_(false), running_(0), converted_(0),
+        failed_(0), last_latency_(0)
+    {
+      for (unsigned i = 0; i < std::max(workers, 1u); ++i)
+        { threads_.emplace_back(&work_queue::run, this); }
+    }
+
+    ~work_queue()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      wake_.notify_all();
+      for (auto&& t : threads_) { t.join(); }
+    }
+
+    void push(const fs::path& log, clock_type::time_point detected)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (busy_.count(log))
+          {
+            again_.insert(std::make_pair(log, detected));
+            return;
+          }
+        for (auto&& job : jobs_)
+          { if (job.first == log) { return; } }
+        jobs_.emplace_back(log, detected);
+      }
+      wake_.notify_one();
+    }
+
+    bool idle()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return jobs_.empty() && running_ == 0;
+    }
+
+    void write_status(std::ostream& out)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      double lag = jobs_.empty() ? 0.
+        : seconds(clock_type::now() - jobs_.front().second);
+      out << "queue_depth: " << jobs_.size() << "\n"
+          << "in_progress: " << running_ << "\n"
+          << "converted: " << converted_ << "\n"
+          << "failed: " << failed_ << "\n"
+          << "lag_seconds: " << lag << "\n"
+          << "last_latency_seconds: " << last_latency_ << "\n";
+    }
+
+  private:
+    typedef std::pair<fs::path, clock_type::time_point> job_type;
+
+    void run()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (;;)
+        {
+          wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+          if (stopping_) { return; }
+          job_type job = jobs_.front();
+          jobs_.pop_front();
+          busy_.insert(job.first);
+          ++running_;
+          lock.unlock();
+          bool ok = convert_(job.first);
+          lock.lock();
+          --running_;
+          busy_.erase(job.first);
+          ++(ok ? converted_ : failed_);
+          last_latency_ = seconds(clock_type::now() - job.second);
+          auto again = again_.find(job.first);
+          if (again != again_.end())
+            {
+              jobs_.push_back(*again);
+              again_.erase(again);
+              wake_.notify_one();
+            }
+        }
+    }
+
+    std::function<bool (const fs::path&)> convert_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<job_type> jobs_;
+    std::set<fs::path> busy_;
+    std::map<fs::path, clock_type::time_point> again_;
+    bool stopping_;
+    unsigned running_;
+    unsigned long converted_;
+    unsigned long failed_;
+    double last_latency_;
+    std::vector<std::thread> threads_;
+  };
+
+  /**
+   *  Tracks the directories and top logs of the tree, and debounces the
+   *  events on the top logs before queuing them.
+   */
+  class watcher
+  {
+  public:
+    watcher(const watch_options& options, const watch_handler& handler)
+      : options_(options), handler_(handler),
+        queue_(options.workers, handler.convert), fd_(-1)
+    {
+#ifdef __linux__
+      fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (fd_ < 0)
+        {
+          std::cerr << "Warning: inotify is not available, relying on "
+                    << "rescans only." << std::endl;
+        }
+#endif
+    }
+
+    ~watcher()
+    {
+#ifdef __linux__
+      if (fd_ >= 0) { ::close(fd_); }
+#endif
+    }
+
+    int run(const volatile std::sig_atomic_t& stop)
+    {
+      add_watches(options_.root);
+      rescan();
+      auto next_rescan = clock_type::now() + options_.rescan;
+      auto next_status = clock_type::now();
+      while (!stop)
+        {
+          if (read_events()) { next_rescan = clock_type::now(); }
+          auto now = clock_type::now();
+          for (auto it = pending_.begin(); it != pending_.end(); )
+            {
+              if (it->second.second <= now)
+                {
+                  queue_.push(it->first, it->second.first);
+                  it = pending_.erase(it);
+                }
+              else { ++it; }
+            }
+          if (queue_.idle() && handler_.idle) { handler_.idle(); }
+          if (now >= next_rescan)
+            {
+              rescan();
+              next_rescan = now + options_.rescan;
+            }
+          if (!options_.status_file.empty() && now >= next_status)
+            {
+              write_status();
+              next_status = now + std::chrono::seconds(1);
+            }
+        }
+      return 0;
+    }
+
+  private:
+    /**
+     *  Debounces the top log: it is queued only after no event was seen for
+     *  it during the debounce delay.
+     */
+    void touch(const fs::path& log)
+    {
+      auto now = clock_type::now();
+      auto found = pending_.find(log);
+      if (found == pending_.end())
+        { pending_[log] = std::make_pair(now, now + options_.debounce); }
+      else
+        { found->second.second = now + options_.debounce; }
+      boost::system::error_code ec;
+      known_[log] = fs::last_write_time(log, ec);
+    }
+
+    void add_watches(const fs::path& dir)
+    {
+#ifdef __linux__
+      if (fd_ < 0) { return; }
+      add_watch(dir);
+      boost::system::error_code ec;
+      for (fs::recursive_directory_iterator it(dir, ec), end;
+           !ec && it != end; it.increment(ec))
+        {
+          if (is_directory(it->path(), ec)) { add_watch(it->path()); }
+        }
+#else
+      (void) dir;
+#endif
+    }
+
+#ifdef __linux__
+    void add_watch(const fs::path& dir)
+    {
+      if (watched_.count(dir)) { return; }
+      int wd = inotify_add_watch(fd_, dir.string().c_str(),
+                                 IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE
+                                 | IN_ONLYDIR);
+      if (wd < 0) { return; } // rescans will still find the logs in there
+      directories_[wd] = dir;
+      watched_.insert(dir);
+    }
+#endif
+
+    /**
+     *  Waits for inotify events, or sleeps when inotify is not available.
+     *
+     *  @return true if events were lost and a rescan is needed.
+     */
+    bool read_events()
+    {
+#ifdef __linux__
+      if (fd_ >= 0)
+        {
+          pollfd pfd{fd_, POLLIN, 0};
+          if (::poll(&pfd, 1, 200) <= 0) { return false; }
+          bool overflow = false;
+          alignas(inotify_event) char buffer[1 << 16];
+          ssize_t len;
+          while ((len = ::read(fd_, buffer, sizeof(buffer))) > 0)
+            {
+              for (char* p = buffer; p < buffer + len; )
+                {
+                  auto event = reinterpret_cast<const inotify_event*>(p);
+                  p += sizeof(inotify_event) + event->len;
+                  if (event->mask & IN_Q_OVERFLOW) { overflow = true; }
+                  if (event->mask & IN_IGNORED)
+                    {
+                      watched_.erase(directories_[event->wd]);
+                      directories_.erase(event->wd);
+                      continue;
+                    }
+                  auto dir = directories_.find(event->wd);
+                  if (dir == directories_.end() || event->len == 0)
+                    { continue; }
+                  fs::path path = dir->second / event->name;
+                  if (event->mask & IN_ISDIR)
+                    {
+                      // Files may have landed before the watch was added.
+                      add_watches(path);
+                      scan(path, false);
+                    }
+                  else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                           && is_top_log(path))
+                    { touch(path); }
+                }
+            }
+          return overflow;
+        }
+#endif
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      return false;
+    }
+
+    void rescan()
+    {
+      add_watches(options_.root);
+      scan(options_.root, true);
+    }
+
+    /**
+     *  Looks for new or modified top logs under dir.  Top logs seen for the
+     *  first time are only converted if they are stale, and none is picked up
+     *  while it is still being written to.
+     */
+    void scan(const fs::path& dir, bool check_quiet)
+    {
+      std::time_t quiet = std::time(nullptr)
+        - std::chrono::duration_cast<std::chrono::seconds>
+        (options_.debounce).count();
+      boost::system::error_code ec;
+      for (fs::recursive_directory_iterator it(dir, ec), end;
+           !ec && it != end; it.increment(ec))
+        {
+          const fs::path& log = it->path();
+          if (!is_top_log(log) || !is_regular_file(log, ec)) { continue; }
+          std::time_t mtime = fs::last_write_time(log, ec);
+          if (ec || (check_quiet && mtime > quiet)) { continue; }
+          auto known = known_.find(log);
+          if (known == known_.end() ? handler_.is_stale(log)
+              : known->second != mtime)
+            { touch(log); }
+          else
+            { known_[log] = mtime; }
+        }
+    }
+
+    void write_status()
+    {
+      write_atomically(options_.status_file, [this](std::ostream& out)
+        {
+          queue_.write_status(out);
+          out << "pending: " << pending_.size() << "\n"
+              << "watched_directories: " << watched_.size() << "\n";
+        });
+    }
+
+    const watch_options& options_;
+    const watch_handler& handler_;
+    work_queue queue_;
+    int fd_;
+    std::map<int, fs::path> directories_;
+    std::set<fs::path> watched_;
+    // first event and deadline, per top log waiting for the debounce delay
+    std::map<fs::path, std::pair<clock_type::time_point,
+                                 clock_type::time_point> > pending_;
+    // modification time of top logs when they were last queued or seen
+    std::map<fs::path, std::time_t> known_;
+  };
+}
+
+int watch_logs(const watch_options& options, const watch_handler& handler,
+               const volatile std::sig_atomic_t& stop)
+{
+  boost::system::error_code ec;
+  if (!is_directory(options.root, ec))
+    {
+      std::cerr << "Error: " << options.root << " is not a directory"
+                << std::endl;
+      return 1;
+    }
+  watcher w(options, handler);
+  return w.run(stop);
+}
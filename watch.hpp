@@ -0,0 +1,64 @@
+#ifndef TOP2CSV_WATCH_HPP
+#define TOP2CSV_WATCH_HPP
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <boost/filesystem.hpp>
+
+struct watch_options
+{
+  boost::filesystem::path root;
+  unsigned workers;
+  std::chrono::milliseconds debounce;
+  std::chrono::seconds rescan;
+  boost::filesystem::path status_file; // empty for no status file
+};
+
+struct watch_handler
+{
+  /**
+   *  @return true if the output for the top log is missing or out of date.
+   *          Only used for top logs found by rescanning the directory tree.
+   */
+  std::function<bool (const boost::filesystem::path&)> is_stale;
+
+  /**
+   *  Converts a top log.  Called concurrently from the worker threads, but
+   *  never twice at the same time for the same top log.
+   *
+   *  @return false if the conversion failed.
+   */
+  std::function<bool (const boost::filesystem::path&)> convert;
+
+  /**
+   *  Called from the watching thread whenever no conversion is queued or
+   *  running.
+   */
+  std::function<void ()> idle;
+};
+
+/**
+ *  Watches a directory tree and converts top logs as they appear.
+ *
+ *  On Linux, the tree is watched with inotify: a top log is picked up when it
+ *  is closed after writing or moved into place, which is what happens when
+ *  logs are rotated.  The tree is also rescanned periodically, which catches
+ *  anything inotify missed (queue overflows, network file systems) and is the
+ *  only detection method on other systems.
+ *
+ *  Events for the same file are debounced: a top log is only queued once no
+ *  event was seen for it during options.debounce.  Queued top logs are
+ *  converted by a pool of options.workers threads.
+ *
+ *  When options.status_file is set, it is rewritten every second with the
+ *  queue depth, the number of conversions in progress, done and failed, and
+ *  the lag, in seconds, between detecting a top log and converting it.
+ *
+ *  @param stop Watching ends as soon as it becomes non-zero.
+ *  @return 0 if watching ended normally, 1 if the tree could not be watched.
+ */
+int watch_logs(const watch_options& options, const watch_handler& handler,
+               const volatile std::sig_atomic_t& stop);
+
+#endif // TOP2CSV_WATCH_HPP